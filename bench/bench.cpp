@@ -0,0 +1,75 @@
+#include "Cpu.h"
+#include "Memory.h"
+#include "Multiversion.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Usage: chip8-bench [--quirks=cowgod|vip|schip|xochip] [--frames=N] [--ipf=N] <rom>...
+// Runs each ROM headless from power-on, cycling through the keys so input
+// loops make progress, and reports instructions per second. Also the
+// training run for profile-guided builds.
+int main(int argc, char **argv)
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    long frames = 20000;
+    int instructions_per_frame = 1000;
+    vector<string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!parse_quirks(arg.substr(9), quirks))
+            {
+                cerr << "unknown quirks profile " << arg.substr(9) << "\n";
+                return 2;
+            }
+        }
+        else if (arg.compare(0, 9, "--frames=") == 0)
+            frames = atol(arg.c_str() + 9);
+        else if (arg.compare(0, 6, "--ipf=") == 0)
+            instructions_per_frame = atoi(arg.c_str() + 6);
+        else if (arg[0] != '-')
+            roms.push_back(arg);
+        else
+        {
+            roms.clear();
+            break;
+        }
+    }
+    if (roms.empty() || frames <= 0 || instructions_per_frame <= 0)
+    {
+        cerr << "usage: chip8-bench [--quirks=cowgod|vip|schip|xochip] [--frames=N] [--ipf=N] <rom>...\n";
+        return 2;
+    }
+
+    cout << quirks_name(quirks) << ", x86-64 level " << cpu_level() << "\n";
+    for (const string &rom : roms)
+    {
+        Memory mem(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+        mem.set_quirks(quirks);
+        if (!mem.load_rom(rom))
+        {
+            cerr << "can't load " << rom << "\n";
+            return 1;
+        }
+
+        auto start = chrono::steady_clock::now();
+        for (long frame = 0; frame < frames; frame++)
+        {
+            // A new key every 10 frames, held for 5
+            mem.set_keys(frame % 10 < 5 ? 1 << (frame / 10 % 16) : 0);
+            run_frames(mem, 1, instructions_per_frame);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << rom << ": " << mem.get_cycle_count() << " instructions in " << seconds << " s, "
+             << mem.get_cycle_count() / seconds / 1e6 << " M/s\n";
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "Cpu.h"
+#include "Environment.h"
+#include "Memory.h"
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <string>
+#include <vector>
+namespace py = pybind11;
+
+// Python module "chip8":
+//
+//   import chip8
+//   machine = chip8.Machine("schip")
+//   machine.load_rom(open("rom.ch8", "rb").read())
+//   machine.run_frames(600)          # GIL released while it runs
+//   machine.ram[0x300]               # NumPy views into the machine
+//   saved = machine.snapshot()
+//   machine.restore(saved)
+//
+// Calls cost a few microseconds each, so drive machines in batches
+// (run/run_frames, VectorEnv.step), never an instruction at a time.
+
+static QuirksProfile quirks_from(const std::string &name)
+{
+    QuirksProfile quirks;
+    if (!parse_quirks(name, quirks))
+        throw py::value_error("unknown quirks profile " + name);
+    return quirks;
+}
+
+static Memory make_machine(QuirksProfile quirks)
+{
+    Memory mem(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+    mem.set_quirks(quirks);
+    return mem;
+}
+
+static std::vector<uint8_t> rom_bytes(const py::bytes &rom)
+{
+    std::string data = rom;
+    return std::vector<uint8_t>(data.begin(), data.end());
+}
+
+// Array over storage the machine owns; owner stays alive as long as the array
+template <class T>
+static py::array_t<T> view(py::object owner, T *data, std::vector<py::ssize_t> shape)
+{
+    return py::array_t<T>(shape, data, owner);
+}
+
+
+/* Machine */
+
+static void bind_machine(py::module_ &m)
+{
+    py::class_<Memory>(m, "Machine")
+        .def(py::init([](const std::string &quirks) { return make_machine(quirks_from(quirks)); }),
+             py::arg("quirks") = "cowgod")
+        .def("load_rom", [](Memory &mem, py::bytes rom) {
+                if (!mem.load_rom(rom_bytes(rom)))
+                    throw py::value_error("ROM doesn't fit in memory");
+             })
+
+        // Stepping, without the GIL so other Python threads can run machines
+        .def("run", [](Memory &mem, long cycles) {
+                py::gil_scoped_release release;
+                return run(mem, cycles);
+             }, py::arg("cycles"))
+        .def("run_frames", [](Memory &mem, long frames, int instructions_per_frame) {
+                py::gil_scoped_release release;
+                return run_frames(mem, frames, instructions_per_frame);
+             }, py::arg("frames"), py::arg("instructions_per_frame") = 10)
+
+        // Whole machine copies
+        .def("snapshot", [](Memory &mem) { return Memory(mem); })
+        .def("restore", [](Memory &mem, const Memory &saved) {
+                // Same size keeps the views pointing at live storage
+                if (saved.mem_size != mem.mem_size)
+                    throw py::value_error("snapshot is of a machine with a different memory size");
+                mem = saved;
+             })
+
+        // Zero-copy views, writes go straight into the machine
+        .def_property_readonly("ram", [](py::object self) {
+                Memory &mem = self.cast<Memory &>();
+                return view(self, mem.ram_data(), {mem.mem_size});
+             })
+        .def_property_readonly("registers", [](py::object self) {
+                Memory &mem = self.cast<Memory &>();
+                return view(self, mem.register_data(), {16});
+             })
+        .def_property_readonly("screen_words", [](py::object self) {
+                // Plane, row, word; bit 63 of a word is its leftmost pixel
+                Memory &mem = self.cast<Memory &>();
+                return view(self, mem.screen_data(), {2, 64, 2});
+             })
+
+        // Unpacked copy of the visible screen, one 2-bit color a byte
+        .def("pixels", [](Memory &mem) {
+                py::array_t<uint8_t> pixels(std::vector<py::ssize_t> {mem.screen_height, mem.screen_width});
+                uint8_t *out = pixels.mutable_data();
+                for (int address = 0; address < mem.screen_width * mem.screen_height; address++)
+                    out[address] = mem.screen_read(address);
+                return pixels;
+             })
+
+        .def_property("pc", &Memory::get_program_counter, &Memory::set_program_counter)
+        .def_property("i", &Memory::get_address_pointer, &Memory::set_address_pointer)
+        .def_property("delay_timer", &Memory::get_delay_timer, &Memory::set_delay_timer)
+        .def_property("sound_timer", &Memory::get_sound_timer, &Memory::set_sound_timer)
+        .def_property("keys", &Memory::get_keys, &Memory::set_keys)
+        .def_property_readonly("hires", &Memory::is_hires)
+        .def_property_readonly("cycle_count", &Memory::get_cycle_count)
+        .def_property_readonly("screen_hash", &Memory::get_screen_hash)
+        .def_property_readonly("state_hash", &Memory::get_state_hash)
+        .def_property_readonly("quirks", [](Memory &mem) { return std::string(quirks_name(mem.get_quirks())); })
+        .def_property_readonly("halted", &Memory::is_halted)
+        .def_property_readonly("halt", [](Memory &mem) {
+            Halt halt = mem.get_halt();
+            return py::make_tuple(std::string(fault_name(halt.fault)), halt.pc, halt.instruction);
+        })
+        .def("resume", &Memory::resume)
+        .def("set_key", &Memory::set_key)
+        .def("get_key", &Memory::get_key)
+        .def("seed", &Memory::set_random_seed);
+}
+
+
+/* Environment */
+
+static void bind_environment(py::module_ &m)
+{
+    py::class_<VectorEnv>(m, "VectorEnv")
+        .def(py::init([](py::bytes rom, int count, const std::string &quirks, int instructions_per_frame,
+                         int frame_skip, int warmup_frames, int threads, uint64_t seed, bool hires,
+                         std::vector<uint16_t> actions, std::vector<int> score_addresses, bool bcd,
+                         int lives_address, int max_frames) {
+                 EnvConfig config;
+                 config.quirks = quirks_from(quirks);
+                 config.instructions_per_frame = instructions_per_frame;
+                 config.frame_skip = frame_skip;
+                 config.warmup_frames = warmup_frames;
+                 config.threads = threads;
+                 config.seed = seed;
+                 config.hires_observations = hires;
+                 config.actions = actions;
+                 config.reward.score_addresses = score_addresses;
+                 config.reward.bcd = bcd;
+                 config.reward.lives_address = lives_address;
+                 config.reward.max_frames = max_frames;
+                 return new VectorEnv(rom_bytes(rom), count, config);
+             }),
+             py::arg("rom"), py::arg("count"), py::arg("quirks") = "cowgod",
+             py::arg("instructions_per_frame") = 10, py::arg("frame_skip") = 4,
+             py::arg("warmup_frames") = 0, py::arg("threads") = 1, py::arg("seed") = 1,
+             py::arg("hires") = false, py::arg("actions") = std::vector<uint16_t>(),
+             py::arg("score_addresses") = std::vector<int>(), py::arg("bcd") = false,
+             py::arg("lives_address") = -1, py::arg("max_frames") = 0)
+
+        .def_property_readonly("size", &VectorEnv::size)
+        .def_property_readonly("observation_size", &VectorEnv::observation_size)
+        .def_property_readonly("action_count", &VectorEnv::action_count)
+
+        .def("reset", [](VectorEnv &env) {
+                py::array_t<uint8_t> observations(std::vector<py::ssize_t> {env.size(), env.observation_size()});
+                uint8_t *out = observations.mutable_data();
+                py::gil_scoped_release release;
+                env.reset(out);
+                return observations;
+             })
+
+        // One action per machine, returns (observations, rewards, dones)
+        .def("step", [](VectorEnv &env, py::array_t<int, py::array::c_style | py::array::forcecast> actions) {
+                if (actions.ndim() != 1 || actions.shape(0) != env.size())
+                    throw py::value_error("need one action per machine");
+                py::array_t<uint8_t> observations(std::vector<py::ssize_t> {env.size(), env.observation_size()});
+                py::array_t<float> rewards(env.size());
+                py::array_t<bool> dones(env.size());
+                const int *in = actions.data();
+                uint8_t *obs = observations.mutable_data();
+                float *reward = rewards.mutable_data();
+                uint8_t *done = reinterpret_cast<uint8_t *>(dones.mutable_data());
+                {
+                    py::gil_scoped_release release;
+                    env.step(in, obs, reward, done);
+                }
+                return py::make_tuple(observations, rewards, dones);
+             })
+
+        .def("machine", [](py::object self, int index) {
+                // Reference to the live machine, kept valid by the environment
+                VectorEnv &env = self.cast<VectorEnv &>();
+                if (index < 0 || index >= env.size())
+                    throw py::index_error();
+                return py::cast(&env.machine(index), py::return_value_policy::reference_internal, self);
+             });
+}
+
+PYBIND11_MODULE(chip8, m)
+{
+    m.doc() = "CHIP-8, SUPER-CHIP and XO-CHIP emulator core";
+    bind_machine(m);
+    bind_environment(m);
+}
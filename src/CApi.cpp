@@ -0,0 +1,207 @@
+#include "chip8.h"
+#include "Cpu.h"
+#include "Memory.h"
+#include <new>
+
+// Handles are the machine itself, so a snapshot is one more Memory
+struct chip8_machine
+{
+    Memory mem;
+};
+
+struct chip8_snapshot
+{
+    Memory mem;
+};
+
+// The getters on Memory aren't const, reading through them is
+static Memory &machine_of(const chip8_machine *machine)
+{
+    return const_cast<chip8_machine *>(machine)->mem;
+}
+
+static_assert(static_cast<int>(QuirksProfile::Xochip) == CHIP8_QUIRKS_XOCHIP, "chip8_quirks follows QuirksProfile");
+static_assert(static_cast<int>(Fault::InvalidOpcode) == CHIP8_FAULT_INVALID_OPCODE, "chip8_fault follows Fault");
+
+uint32_t chip8_abi_version(void) { return CHIP8_ABI_VERSION; }
+
+// No exceptions across the boundary: writing RAM can allocate, when a
+// page shared with a snapshot or another machine is first copied
+template <class Action>
+static int status_of(Action action)
+{
+    try
+    {
+        action();
+        return CHIP8_OK;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return CHIP8_ERROR_MEMORY;
+    }
+}
+
+
+/* Machines */
+
+chip8_machine *chip8_create(int quirks)
+{
+    if (quirks < CHIP8_QUIRKS_COWGOD || quirks > CHIP8_QUIRKS_XOCHIP)
+        return nullptr;
+    QuirksProfile profile = static_cast<QuirksProfile>(quirks);
+    try
+    {
+        chip8_machine *machine = new chip8_machine {Memory(profile == QuirksProfile::Xochip ? 0x10000 : 4096)};
+        machine->mem.set_quirks(profile);
+        return machine;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void chip8_destroy(chip8_machine *machine) { delete machine; }
+
+int chip8_load_rom(chip8_machine *machine, const uint8_t *rom, size_t length)
+{
+    if (!machine || (!rom && length))
+        return CHIP8_ERROR_ARGUMENT;
+    Memory &mem = machine->mem;
+    if (length > (size_t) (mem.mem_size - 0x200))
+        return CHIP8_ERROR_ROM_SIZE;
+    return status_of([&]() { mem.mem_write_block(0x200, rom, length); });
+}
+
+
+/* Running */
+
+static bool valid_batch(chip8_machine *const *machines, size_t count)
+{
+    if (!machines && count)
+        return false;
+    for (size_t i = 0; i < count; i++)
+        if (!machines[i])
+            return false;
+    return true;
+}
+
+int chip8_run_cycles(chip8_machine *const *machines, size_t count, int64_t cycles)
+{
+    if (!valid_batch(machines, count) || cycles < 0)
+        return CHIP8_ERROR_ARGUMENT;
+    return status_of([&]() {
+        for (size_t i = 0; i < count; i++)
+            run(machines[i]->mem, cycles);
+    });
+}
+
+int chip8_run_frames(chip8_machine *const *machines, size_t count, int64_t frames, int instructions_per_frame)
+{
+    if (!valid_batch(machines, count) || frames < 0 || instructions_per_frame < 0)
+        return CHIP8_ERROR_ARGUMENT;
+    return status_of([&]() {
+        for (size_t i = 0; i < count; i++)
+            run_frames(machines[i]->mem, frames, instructions_per_frame);
+    });
+}
+
+int chip8_set_keys(chip8_machine *const *machines, size_t count, const uint16_t *keys)
+{
+    if (!valid_batch(machines, count) || (!keys && count))
+        return CHIP8_ERROR_ARGUMENT;
+    for (size_t i = 0; i < count; i++)
+        machines[i]->mem.set_keys(keys[i]);
+    return CHIP8_OK;
+}
+
+
+/* State */
+
+const uint64_t *chip8_framebuffer(const chip8_machine *machine)
+{
+    return machine ? machine_of(machine).screen_data() : nullptr;
+}
+
+int chip8_screen_width(const chip8_machine *machine) { return machine ? machine->mem.screen_width : 0; }
+int chip8_screen_height(const chip8_machine *machine) { return machine ? machine->mem.screen_height : 0; }
+
+uint8_t *chip8_ram(chip8_machine *machine)
+{
+    if (!machine)
+        return nullptr;
+    try
+    {
+        return machine->mem.ram_data();
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+size_t chip8_ram_size(const chip8_machine *machine) { return machine ? machine->mem.mem_size : 0; }
+
+uint64_t chip8_cycle_count(const chip8_machine *machine)
+{
+    return machine ? machine_of(machine).get_cycle_count() : 0;
+}
+
+uint64_t chip8_state_hash(const chip8_machine *machine)
+{
+    return machine ? machine_of(machine).get_state_hash() : 0;
+}
+
+int chip8_halt_reason(const chip8_machine *machine, uint16_t *pc, uint16_t *instruction)
+{
+    if (!machine)
+        return CHIP8_ERROR_ARGUMENT;
+    Halt halt = machine_of(machine).get_halt();
+    if (pc)
+        *pc = halt.pc;
+    if (instruction)
+        *instruction = halt.instruction;
+    return static_cast<int>(halt.fault);
+}
+
+int chip8_resume(chip8_machine *machine)
+{
+    if (!machine)
+        return CHIP8_ERROR_ARGUMENT;
+    machine->mem.resume();
+    return CHIP8_OK;
+}
+
+
+/* Snapshots */
+
+chip8_snapshot *chip8_snapshot_create(const chip8_machine *machine)
+{
+    if (!machine)
+        return nullptr;
+    try
+    {
+        return new chip8_snapshot {machine->mem};
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void chip8_snapshot_destroy(chip8_snapshot *snapshot) { delete snapshot; }
+
+int chip8_snapshot_save(const chip8_machine *machine, chip8_snapshot *snapshot)
+{
+    // Same size RAM copies into the snapshot's existing buffer
+    if (!machine || !snapshot || snapshot->mem.mem_size != machine->mem.mem_size)
+        return CHIP8_ERROR_ARGUMENT;
+    return status_of([&]() { snapshot->mem = machine->mem; });
+}
+
+int chip8_snapshot_restore(chip8_machine *machine, const chip8_snapshot *snapshot)
+{
+    if (!machine || !snapshot || snapshot->mem.mem_size != machine->mem.mem_size)
+        return CHIP8_ERROR_ARGUMENT;
+    return status_of([&]() { machine->mem = snapshot->mem; });
+}
@@ -1,10 +1,11 @@
 #include "Memory.h"
 #include "Cpu.h"
-#include <chrono>
+#include "Multiversion.h"
+#include "Opcodes.h"
 #include <cmath>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
-#include <random>
 #include <string>
 #include <sstream>
 using namespace std;
@@ -12,129 +13,193 @@ using OpcodeFunction = function<int(int, Memory&)>;
 
 
 
-int execute(int instruction, Memory &mem)
+int step(Memory &mem)
 {
-    OpcodeFunction opcode = decode(instruction);
-    return opcode(instruction, mem);
+    switch (mem.get_quirks())
+    {
+        case QuirksProfile::Vip: return step<VipQuirks>(mem);
+        case QuirksProfile::Schip: return step<SchipQuirks>(mem);
+        case QuirksProfile::Xochip: return step<XochipQuirks>(mem);
+        default: return step<CowgodQuirks>(mem);
+    }
 }
 
-OpcodeFunction decode(int instruction)
+template <class Quirks>
+int step(Memory &mem)
 {
-    // For decoding instructions
-    int high_nibble = (instruction & 0xF000) >> 12;
-    int low_nibble = instruction & 0x000F;
+    // Fetch, point the program counter at the next instruction, execute
+    int pc = mem.get_program_counter();
+    int instruction = mem.mem_read(pc) << 8 | mem.mem_read(pc + 1);
+    mem.inc_program_counter();
+    mem.inc_cycle_count();
+    return execute<Quirks>(instruction, mem);
+}
+
+// The interpreter loop, defined before its first use so every
+// instantiation is cloned
+template <class Quirks>
+MULTIVERSIONED long run(Memory &mem, long cycles)
+{
+    long i = 0;
+    for (; i < cycles && !mem.is_halted(); i++)
+        step<Quirks>(mem);
+    return i;
+}
 
-    switch (high_nibble) 
+long run(Memory &mem, long cycles)
+{
+    // Pick the interpreter once, not per instruction
+    switch (mem.get_quirks())
+    {
+        case QuirksProfile::Vip: return run<VipQuirks>(mem, cycles);
+        case QuirksProfile::Schip: return run<SchipQuirks>(mem, cycles);
+        case QuirksProfile::Xochip: return run<XochipQuirks>(mem, cycles);
+        default: return run<CowgodQuirks>(mem, cycles);
+    }
+}
+
+long run_frames(Memory &mem, long frames, int instructions_per_frame)
+{
+    long executed = 0;
+    for (long frame = 0; frame < frames && !mem.is_halted(); frame++)
     {
-        case 0x0:
-            switch (low_nibble)
-            {
-                case 0x0:
-                    return &op00E0;
-                case 0xE:
-                    return &op00EE;
-            }
-        case 0x1:
-            return &op1NNN;
-        case 0x2:
-            return &op2NNN;
-        case 0x3:
-            return &op3XKK;
-        case 0x4:
-            return &op4XKK;
-        case 0x5:
-            return &op5XY0;
-        case 0x6:
-            return &op6XKK;
-        case 0x7:
-            return &op7XKK;
-        case 0x8:
-            switch (low_nibble)
-            {
-                case 0x0:
-                    return &op8XY0;
-                case 0x1:
-                    return &op8XY1;
-                case 0x2:
-                    return &op8XY2;
-                case 0x3:
-                    return &op8XY3;
-                case 0x4:
-                    return &op8XY4;
-                case 0x5:
-                    return &op8XY5;
-                case 0x6:
-                    return &op8XY6;
-                case 0x7:
-                    return &op8XY7;
-                case 0xE:
-                    return &op8XYE;
-            }
-        case 0x9:
-            return &op9XY0;
-        case 0xA:
-            return &opANNN;
-        case 0xB:
-            return &opBNNN;
-        case 0xC:
-            return &opCXKK;
-        case 0xD:
-            return &opDXYN;
-        case 0xE:
-            switch (low_nibble)
-            {
-                case 0x1:
-                    return &opEXA1;
-                case 0xE:
-                    return &opEX9E;
-            }
-        case 0xF:
-            switch (low_nibble)
-            {
-                case 0x3:
-                    return &opFX33;
-                case 0x5:
-                    switch ((instruction & 0xF0) >> 4)
-                    {
-                        case 0x1:
-                            return &opFX15;
-                        case 0x5:
-                            return &opFX55;
-                        case 0x6:
-                            return &opFX65;
-                    }
-                case 0x7:
-                    return &opFX07;
-                case 0x8:
-                    return &opFX18;
-                case 0x9:
-                    return &opFX29;
-                case 0xA:
-                    return &opFX0A;
-                case 0xE:
-                    return &opFX1E;
-            }
-        default:
-            return &invalidOpcode;
+        executed += run(mem, instructions_per_frame);
+        mem.tick_timers();
     }
+    return executed;
+}
+
+int execute(int instruction, Memory &mem)
+{
+    switch (mem.get_quirks())
+    {
+        case QuirksProfile::Vip: return execute<VipQuirks>(instruction, mem);
+        case QuirksProfile::Schip: return execute<SchipQuirks>(instruction, mem);
+        case QuirksProfile::Xochip: return execute<XochipQuirks>(instruction, mem);
+        default: return execute<CowgodQuirks>(instruction, mem);
+    }
+}
+
+template <class Quirks>
+int execute(int instruction, Memory &mem)
+{
+    return decode_handler<Quirks>(instruction)(instruction, mem);
+}
+
+int store_length(int instruction)
+{
+    int x = (instruction & 0xF00) >> 8;
+    int y = (instruction & 0xF0) >> 4;
+    if ((instruction & 0xF00F) == 0x5002)
+        return abs(x - y) + 1;
+    if ((instruction & 0xF0FF) == 0xF033)
+        return 3;
+    if ((instruction & 0xF0FF) == 0xF055)
+        return x + 1;
+    return 0;
+}
+
+OpcodeFunction decode(int instruction)
+{
+    return decode<CowgodQuirks>(instruction);
+}
+
+template <class Quirks>
+OpcodeFunction decode(int instruction)
+{
+    return decode_handler<Quirks>(instruction);
+}
+
+// Handlers in opcode_specs order, then the one for anything else
+#define OPCODE_HANDLER(mask, pattern, handler, mnemonic) &handler,
+#define QUIRKED_OPCODE_HANDLER(mask, pattern, handler, mnemonic) &handler<Quirks>,
+template <class Quirks>
+static const OpcodeHandler opcode_handlers[] = {
+    CHIP8_OPCODES(OPCODE_HANDLER, QUIRKED_OPCODE_HANDLER)
+    &invalidOpcode
 };
 
+template <class Quirks>
+OpcodeHandler decode_handler(int instruction)
+{
+    return opcode_handlers<Quirks>[opcode_index(instruction)];
+}
+
+// Stop on the instruction being executed, which the fetch already
+// stepped past
+static int fault(Fault fault, int instruction, Memory &mem)
+{
+    mem.set_program_counter(mem.get_program_counter() - 2);
+    mem.halt(fault, instruction);
+    return -1;
+}
+
 /* Clear the screen */
 int op00E0(int instruction, Memory &mem) 
 { 
-    for (auto i = 0; i != mem.screen_size; ++i)
-        mem.screen_write(i, 0);
+    mem.screen_clear();
     return 0x00E0; 
 }
 
 /* Return from a subroutine */
 int op00EE(int instruction, Memory &mem) 
 { 
+    if (mem.get_stack_pointer() <= 0)
+        return fault(Fault::StackUnderflow, instruction, mem);
     int last_pc = mem.stack_pop();
     mem.set_program_counter(last_pc);
     return 0x00EE; 
 }
 
+/* Scroll the screen down N rows (SUPER-CHIP) */
+int op00CN(int instruction, Memory &mem) 
+{ 
+    mem.screen_scroll_down(instruction & 0xF);
+    return 0x00C0; 
+}
+
+/* Scroll the screen up N rows (XO-CHIP) */
+int op00DN(int instruction, Memory &mem) 
+{ 
+    mem.screen_scroll_up(instruction & 0xF);
+    return 0x00D0; 
+}
+
+/* Scroll the screen right 4 pixels (SUPER-CHIP) */
+int op00FB(int instruction, Memory &mem) 
+{ 
+    mem.screen_scroll_right(4);
+    return 0x00FB; 
+}
+
+/* Scroll the screen left 4 pixels (SUPER-CHIP) */
+int op00FC(int instruction, Memory &mem) 
+{ 
+    mem.screen_scroll_left(4);
+    return 0x00FC; 
+}
+
+/* Exit the interpreter (SUPER-CHIP), halting on this instruction */
+int op00FD(int instruction, Memory &mem) 
+{ 
+    fault(Fault::Exit, instruction, mem);
+    return 0x00FD; 
+}
+
+/* Switch to 64x32 low resolution (SUPER-CHIP) */
+int op00FE(int instruction, Memory &mem) 
+{ 
+    mem.set_hires(false);
+    return 0x00FE; 
+}
+
+/* Switch to 128x64 high resolution (SUPER-CHIP) */
+int op00FF(int instruction, Memory &mem) 
+{ 
+    mem.set_hires(true);
+    return 0x00FF; 
+}
+
 /* Set program counter to NNN */
 int op1NNN(int instruction, Memory &mem) 
 { 
@@ -146,11 +211,13 @@ int op1NNN(int instruction, Memory &mem)
 /* Call subroutine at NNN */
 int op2NNN(int instruction, Memory &mem) 
 { 
+    if (mem.get_stack_pointer() >= 16)
+        return fault(Fault::StackOverflow, instruction, mem);
     // Store current program counter
     int pc = mem.get_program_counter();
     mem.stack_push(pc);
     // Jump to NNN
-    int new_pc = instruction & 0xF00;
+    int new_pc = instruction & 0xFFF;
     mem.set_program_counter(new_pc);
     return 0x2000; 
 }
@@ -161,7 +228,7 @@ int op3XKK(int instruction, Memory &mem)
     int x = (instruction & 0xF00) >> 8;
     int kk = (instruction & 0xFF);
     if (mem.reg_read(x) == kk)
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0x3000; 
 }
 
@@ -171,7 +238,7 @@ int op4XKK(int instruction, Memory &mem)
     int x = (instruction & 0xF00) >> 8;
     int kk = (instruction & 0xFF);
     if (mem.reg_read(x) != kk)
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0x4000; 
 }
 
@@ -183,10 +250,42 @@ int op5XY0(int instruction, Memory &mem)
     int vx = mem.reg_read(x);
     int vy = mem.reg_read(y);
     if (vx == vy)
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0x5000; 
 }
 
+/* Store VX..VY in memory starting at address_pointer (XO-CHIP),
+   in reverse order when X > Y */
+int op5XY2(int instruction, Memory &mem) 
+{ 
+    int x = (instruction & 0xF00) >> 8;
+    int y = (instruction & 0xF0) >> 4;
+    int step = x <= y ? 1 : -1;
+    int count = (y - x) * step + 1;
+
+    uint8_t values[16];
+    for (int i = 0; i < count; i++)
+        values[i] = mem.reg_read(x + i * step);
+    mem.mem_write_block(mem.get_address_pointer(), values, count);
+    return 0x5002; 
+}
+
+/* Load VX..VY from memory starting at address_pointer (XO-CHIP),
+   in reverse order when X > Y */
+int op5XY3(int instruction, Memory &mem) 
+{ 
+    int x = (instruction & 0xF00) >> 8;
+    int y = (instruction & 0xF0) >> 4;
+    int step = x <= y ? 1 : -1;
+    int count = (y - x) * step + 1;
+
+    uint8_t values[16];
+    mem.mem_read_block(mem.get_address_pointer(), values, count);
+    for (int i = 0; i < count; i++)
+        mem.reg_write(x + i * step, values[i]);
+    return 0x5003; 
+}
+
 /* Put the value KK in VX */
 int op6XKK(int instruction, Memory &mem) 
 { 
@@ -216,7 +315,8 @@ int op8XY0(int instruction, Memory &mem)
     return 0x8000; 
 }
 
-/* Put (VX or VY) in VX */
+/* Put (VX or VY) in VX, VF = 0 with logic_reset_vf */
+template <class Quirks>
 int op8XY1(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
@@ -224,10 +324,13 @@ int op8XY1(int instruction, Memory &mem)
     int vx = mem.reg_read(x);
     int vy = mem.reg_read(y);
     mem.reg_write(x, vx | vy);
+    if constexpr (Quirks::logic_reset_vf)
+        mem.reg_write(0xF, 0);
     return 0x8001; 
 }
 
-/* Put (VX and VY) in VX */
+/* Put (VX and VY) in VX, VF = 0 with logic_reset_vf */
+template <class Quirks>
 int op8XY2(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
@@ -235,10 +338,13 @@ int op8XY2(int instruction, Memory &mem)
     int vx = mem.reg_read(x);
     int vy = mem.reg_read(y);
     mem.reg_write(x, vx & vy);
+    if constexpr (Quirks::logic_reset_vf)
+        mem.reg_write(0xF, 0);
     return 0x8002; 
 }
 
-/* Put (VX xor VY) in VX */
+/* Put (VX xor VY) in VX, VF = 0 with logic_reset_vf */
+template <class Quirks>
 int op8XY3(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
@@ -246,6 +352,8 @@ int op8XY3(int instruction, Memory &mem)
     int vx = mem.reg_read(x);
     int vy = mem.reg_read(y);
     mem.reg_write(x, vx ^ vy);
+    if constexpr (Quirks::logic_reset_vf)
+        mem.reg_write(0xF, 0);
     return 0x8003; 
 }
 
@@ -278,11 +386,12 @@ int op8XY5(int instruction, Memory &mem)
     return 0x8005; 
 }
 
-/* VF = least significant bit of VX,  VX >>= 1 */
+/* VF = least significant bit of VX,  VX >>= 1 (VX = VY >> 1 with shift_vy) */
+template <class Quirks>
 int op8XY6(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xFFF) >> 8;
-    int vx = mem.reg_read(x);     
+    int vx = mem.reg_read(Quirks::shift_vy ? (instruction & 0xF0) >> 4 : x);
     mem.reg_write(0xF, vx & 0x1);
     mem.reg_write(x, vx >> 1);
     return 0x8006; 
@@ -304,11 +413,12 @@ int op8XY7(int instruction, Memory &mem)
     return 0x8007; 
 }
 
-/* VF = most significant bit of VX,  VX <<= 1 */
+/* VF = most significant bit of VX,  VX <<= 1 (VX = VY << 1 with shift_vy) */
+template <class Quirks>
 int op8XYE(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xFFF) >> 8;
-    int vx = mem.reg_read(x);
+    int vx = mem.reg_read(Quirks::shift_vy ? (instruction & 0xF0) >> 4 : x);
     mem.reg_write(0xF, vx >> 7);
     mem.reg_write(x, vx << 1 & 0xFF);
     return 0x800E; 
@@ -320,7 +430,7 @@ int op9XY0(int instruction, Memory &mem)
     int vx = mem.reg_read((instruction & 0xF00) >> 8);
     int vy = mem.reg_read((instruction & 0xF0) >> 4);
     if (vx != vy)
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0x9000; 
 }
 
@@ -331,11 +441,12 @@ int opANNN(int instruction, Memory &mem)
     return 0xA000; 
 }
 
-/* Set program counter to NNN + V0 */
+/* Set program counter to NNN + V0 (XNN + VX with jump_vx) */
+template <class Quirks>
 int opBNNN(int instruction, Memory &mem) 
 { 
     int nnn = instruction & 0xFFF;
-    int v0 = mem.reg_read(0x0);
+    int v0 = mem.reg_read(Quirks::jump_vx ? nnn >> 8 : 0x0);
     mem.set_program_counter(nnn + v0);
     return 0xB000; 
 }
@@ -344,52 +455,73 @@ int opBNNN(int instruction, Memory &mem)
 int opCXKK(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
-    int vx = mem.reg_read(x);
     int kk = instruction & 0xFF;
-      
-    // Gen random int [0, 255]
-    unsigned seed = chrono::system_clock::now().time_since_epoch().count();
-    default_random_engine generator (seed);
-    int rand_byte = generator() % 256;
-
-    mem.reg_write(x, rand_byte & kk);
+    mem.reg_write(x, mem.random_byte() & kk);
     return 0xC000; 
 }
 
 // Draw a sprite by XOring the n-bytes beginning at address_pointer
 // with the Nx8 pixel grid starting at coordinate (VX, VY)
+// DXY0 draws a 16x16 sprite from 32 bytes (SUPER-CHIP)
+// With both bit planes selected, plane 1 takes the bytes after plane 0's (XO-CHIP)
+// Sprites wrap around the screen edges, or are cut off with clip_sprites
 // set VF = collision
-int opDXYN(int instruction, Memory &mem) 
-{ 
-    // Start sprite drawing at coordinate (VX, VY)
-    int vx = mem.reg_read((instruction & 0xF00) >> 8);
-    int vy = mem.reg_read((instruction & 0xF0) >> 4);
-    int draw_start = vx + (vy * 64);
+// Only the kernel is cloned, the handler's address goes into the decoder
+template <class Quirks>
+MULTIVERSIONED static void draw_sprite(int instruction, Memory &mem)
+{
+    // Start sprite drawing at coordinate (VX, VY), wrapping around the screen
+    int vx = mem.reg_read((instruction & 0xF00) >> 8) % mem.screen_width;
+    int vy = mem.reg_read((instruction & 0xF0) >> 4) % mem.screen_height;
 
-    // Initialize VF to no collision
-    mem.reg_write(0xF, 0);
+    int num_rows = instruction & 0xF;
+    int row_bytes = 1;
+    if (num_rows == 0)
+    {
+        num_rows = 16;
+        row_bytes = 2;
+    }
 
-    // XOR byte-by-byte
-    int num_bytes = instruction & 0xF;
-    for (int i = 0; i < num_bytes; i++)
+    // Sprite rows land in the word holding VX and spill into the next one,
+    // which is the same word on a 64 pixel wide screen (a rotation)
+    int words = mem.screen_width / 64;
+    int word = vx / 64;
+    int next_word = (word + 1) % words;
+    int shift = vx % 64;
+
+    // XOR a whole screen row per sprite row, plane by plane
+    int collision = 0;
+    int address = mem.get_address_pointer();
+    int planes = mem.get_planes();
+    for (int plane = 0; plane < 2; plane++)
     {
-        // XOR bit-by-bit
-        int sprite_byte = mem.mem_read(mem.get_address_pointer() + i);
-        for (int j = 0; j < 8; j++ )
+        if (!(planes >> plane & 1))
+            continue;
+        for (int i = 0; i < num_rows; i++)
         {
-            // XOR next bit
-            int sprite_bit = (sprite_byte & (int) pow(2, 7 - j)) >> (7 - j);
-            int screen_bit = mem.screen_read(draw_start + (64 * i + j));
-            int xored_bit = sprite_bit ^ screen_bit;
+            uint64_t sprite_row = (uint64_t) (mem.mem_read(address++) & 0xFF) << 56;
+            if (row_bytes == 2)
+                sprite_row |= (uint64_t) (mem.mem_read(address++) & 0xFF) << 48;
 
             // Set VF on collision 
-            if (xored_bit != screen_bit)
-                mem.reg_write(0xF, 1);
-
-            // Update Screen
-            mem.screen_write(draw_start + (64 * i + j), xored_bit);
+            if (Quirks::clip_sprites && vy + i >= mem.screen_height)
+                continue;
+            int row = (vy + i) % mem.screen_height;
+            if (mem.screen_xor_row(row, word, sprite_row >> shift, plane))
+                collision = 1;
+            if (Quirks::clip_sprites && next_word <= word)
+                continue;
+            if (shift && mem.screen_xor_row(row, next_word, sprite_row << (64 - shift), plane))
+                collision = 1;
         }
     }
+    mem.reg_write(0xF, collision);
+}
+
+template <class Quirks>
+int opDXYN(int instruction, Memory &mem) 
+{ 
+    draw_sprite<Quirks>(instruction, mem);
     return 0xD000;
 }
 
@@ -398,7 +530,7 @@ int opEX9E(int instruction, Memory &mem)
 { 
     int vx = mem.reg_read(((instruction & 0xF00) >> 8));
     if (mem.get_key(vx))
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0xE09E; 
 }
 
@@ -407,10 +539,42 @@ int opEXA1(int instruction, Memory &mem)
 { 
     int vx = mem.reg_read((instruction & 0xF00) >> 8);
     if (!mem.get_key(vx))
-        mem.inc_program_counter();
+        mem.skip_instruction();
     return 0xE0A1; 
 }
 
+/* Set address pointer to the 16-bit word after this instruction (XO-CHIP) */
+int opF000(int instruction, Memory &mem) 
+{ 
+    int pc = mem.get_program_counter();
+    mem.set_address_pointer(mem.mem_read(pc) << 8 | mem.mem_read(pc + 1));
+    mem.inc_program_counter();
+    return 0xF000; 
+}
+
+/* Select the bit planes N for drawing, clearing and scrolling (XO-CHIP) */
+int opFN01(int instruction, Memory &mem) 
+{ 
+    mem.set_planes((instruction & 0xF00) >> 8);
+    return 0xF001; 
+}
+
+/* Load 16 bytes of audio pattern from address_pointer (XO-CHIP) */
+int opF002(int instruction, Memory &mem) 
+{ 
+    int a = mem.get_address_pointer();
+    for (int i = 0; i < 16; i++)
+        mem.audio_pattern_write(i, mem.mem_read(a + i));
+    return 0xF002; 
+}
+
+/* Set audio pitch = VX (XO-CHIP) */
+int opFX3A(int instruction, Memory &mem) 
+{ 
+    mem.set_pitch(mem.reg_read((instruction & 0xF00) >> 8));
+    return 0xF03A; 
+}
+
 /* Set register VX equal to the delay timer value */
 int opFX07(int instruction, Memory &mem) 
 { 
@@ -424,13 +588,20 @@ int opFX07(int instruction, Memory &mem)
 int opFX0A(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
-    for (;;)
-        for (int i = 0; i < 16; i ++)
-            if (mem.get_key(i))
-            {
-                mem.reg_write(x, i);
-                return 0xF00A;
-            } 
+    int keys = mem.get_keys();
+
+    // Nothing pressed yet, run FX0A again next cycle
+    if (keys == 0)
+    {
+        mem.set_program_counter(mem.get_program_counter() - 2);
+        return 0xF00A;
+    }
+
+    int key = 0;
+    while (!(keys & (1 << key)))
+        key++;
+    mem.reg_write(x, key);
+    return 0xF00A; 
 }
 
 /* Set delay timer = VX */
@@ -466,6 +637,14 @@ int opFX29(int instruction, Memory &mem)
     return 0xF029; 
 }
 
+/* Set address pointer = location of large sprite for digit VX (SUPER-CHIP) */
+int opFX30(int instruction, Memory &mem) 
+{ 
+    int vx = mem.reg_read((instruction & 0xF00) >> 8);
+    mem.set_address_pointer(Memory::large_font_start + 10 * (vx & 0xF));
+    return 0xF030; 
+}
+
 /* Store BCD representation of VX in memory location
    address_pointer .. address_pointer + 2
 */
@@ -486,21 +665,26 @@ int opFX33(int instruction, Memory &mem)
     return 0xF033; 
 }
 
-/* Store registers V0 through VX in memory starting at address_pointer */
+/* Store registers V0 through VX in memory starting at address_pointer,
+   then move address_pointer past them with increment_i */
+template <class Quirks>
 int opFX55(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
     int a = mem.get_address_pointer();
+    uint8_t values[16];
     for (int i = 0; i <= x; i++)
-    {
-        int val = mem.reg_read(i);
-        mem.mem_write(a + i, val);
-    }
+        values[i] = mem.reg_read(i);
+    mem.mem_write_block(a, values, x + 1);
+    if constexpr (Quirks::increment_i)
+        mem.set_address_pointer(a + x + 1);
     return 0xF055; 
 }
 
 /* Read values into registers V0 through VX from memory,
-   starting at address_pointer */
+   starting at address_pointer, then move address_pointer past them
+   with increment_i */
+template <class Quirks>
 int opFX65(int instruction, Memory &mem) 
 { 
     int x = (instruction & 0xF00) >> 8;
@@ -510,19 +694,39 @@ int opFX65(int instruction, Memory &mem)
         int val = mem.mem_read(a + i);
         mem.reg_write(i, val);
     }
+    if constexpr (Quirks::increment_i)
+        mem.set_address_pointer(a + x + 1);
     return 0xF065; 
 }
 
 
+/* Save registers V0 through VX to the RPL flags (SUPER-CHIP) */
+int opFX75(int instruction, Memory &mem) 
+{ 
+    int x = (instruction & 0xF00) >> 8;
+    for (int i = 0; i <= x; i++)
+        mem.rpl_write(i, mem.reg_read(i));
+    return 0xF075; 
+}
+
+/* Load registers V0 through VX from the RPL flags (SUPER-CHIP) */
+int opFX85(int instruction, Memory &mem) 
+{ 
+    int x = (instruction & 0xF00) >> 8;
+    for (int i = 0; i <= x; i++)
+        mem.reg_write(i, mem.rpl_read(i));
+    return 0xF085; 
+}
+
 /* Testing utilities */
-int invalidOpcode(int instruction, Memory &mem) { return -1; }
+int invalidOpcode(int instruction, Memory &mem) { return fault(Fault::InvalidOpcode, instruction, mem); }
 
-void draw_screen(Memory mem) 
+void draw_screen(Memory &mem) 
 {
     cout << "\n\n";
-    for (auto i = 0; i < 2048; i++)
+    for (auto i = 0; i < mem.screen_size; i++)
     {
-        if (i % 64 == 0)
+        if (i % mem.screen_width == 0)
             cout << "\n";
         if (mem.screen_read(i))
             cout << " ";
@@ -531,3 +735,47 @@ void draw_screen(Memory mem)
     }
     cout << "\n\n";
 }
+
+/* Write only the rows changed since the last call as "row|pixels" lines,
+   returns the number of rows written (0 for an unchanged frame) */
+int draw_dirty_rows(Memory &mem, ostream &out)
+{
+    uint64_t dirty = mem.get_dirty_rows();
+    int rows_written = 0;
+    for (int row = 0; row < mem.screen_height; row++)
+    {
+        if (!(dirty >> row & 1))
+            continue;
+        string line(mem.screen_width, 'X');
+        for (int x = 0; x < mem.screen_width; x++)
+            if (mem.screen_row(row, x / 64) >> (63 - x % 64) & 1)
+                line[x] = ' ';
+        out << row << "|" << line << "\n";
+        rows_written++;
+    }
+    mem.clear_dirty();
+    return rows_written;
+}
+
+
+// Interpreter instantiations, one per quirks profile
+#define INSTANTIATE_QUIRKS(Quirks) \
+    template int step<Quirks>(Memory &mem); \
+    template long run<Quirks>(Memory &mem, long cycles); \
+    template int execute<Quirks>(int instruction, Memory &mem); \
+    template OpcodeFunction decode<Quirks>(int instruction); \
+    template OpcodeHandler decode_handler<Quirks>(int instruction); \
+    template int op8XY1<Quirks>(int instruction, Memory &mem); \
+    template int op8XY2<Quirks>(int instruction, Memory &mem); \
+    template int op8XY3<Quirks>(int instruction, Memory &mem); \
+    template int op8XY6<Quirks>(int instruction, Memory &mem); \
+    template int op8XYE<Quirks>(int instruction, Memory &mem); \
+    template int opBNNN<Quirks>(int instruction, Memory &mem); \
+    template int opDXYN<Quirks>(int instruction, Memory &mem); \
+    template int opFX55<Quirks>(int instruction, Memory &mem); \
+    template int opFX65<Quirks>(int instruction, Memory &mem);
+
+INSTANTIATE_QUIRKS(CowgodQuirks)
+INSTANTIATE_QUIRKS(VipQuirks)
+INSTANTIATE_QUIRKS(SchipQuirks)
+INSTANTIATE_QUIRKS(XochipQuirks)
@@ -1,56 +1,98 @@
 #ifndef CPU_H
 #define CPU_H
 #include "Memory.h"
+#include "Quirks.h"
 #include <string>
 #include <functional>
+#include <ostream>
 using namespace std;
 using OpcodeFunction = function<int(int, Memory&)>;
+using OpcodeHandler = int (*)(int, Memory &);
 
 
+// Fetch and execute the instruction at the program counter, with the
+// machine's quirks profile or a given one
+int step(Memory &mem);
+template <class Quirks> int step(Memory &mem);
+
+// Step cycles times, choosing the profile once up front. Stops early if
+// the machine halts (Memory::get_halt() says why), returning the
+// instructions executed, the halting one included.
+long run(Memory &mem, long cycles);
+template <class Quirks> long run(Memory &mem, long cycles);
+
+// Run frames of instructions_per_frame instructions, ticking the timers
+// (which publishes the frame) after each, until the machine halts.
+// Returns the instructions executed.
+long run_frames(Memory &mem, long frames, int instructions_per_frame);
+
 // Execute opcodes on instructions
 int execute(int instruction, Memory &mem);
+template <class Quirks> int execute(int instruction, Memory &mem);
 
-// Decode instructions into opcodes
+// Decode instructions into opcodes (Cowgod quirks unless given a profile),
+// by table from the list in Opcodes.h; invalidOpcode for anything not in it
 OpcodeFunction decode(int instruction);
+template <class Quirks> OpcodeFunction decode(int instruction);
+template <class Quirks> OpcodeHandler decode_handler(int instruction);
+
+// Bytes the instruction stores to memory at the address pointer (FX33,
+// FX55, 5XY2), 0 if it doesn't write memory
+int store_length(int instruction);
 
 // Opcode implementations
 int op00E0(int instruction, Memory &mem);
 int op00EE(int instruction, Memory &mem);
+int op00CN(int instruction, Memory &mem);
+int op00DN(int instruction, Memory &mem);
+int op00FB(int instruction, Memory &mem);
+int op00FC(int instruction, Memory &mem);
+int op00FD(int instruction, Memory &mem);
+int op00FE(int instruction, Memory &mem);
+int op00FF(int instruction, Memory &mem);
 int op1NNN(int instruction, Memory &mem);
 int op2NNN(int instruction, Memory &mem);
 int op3XKK(int instruction, Memory &mem);
 int op4XKK(int instruction, Memory &mem);
 int op5XY0(int instruction, Memory &mem);
+int op5XY2(int instruction, Memory &mem);
+int op5XY3(int instruction, Memory &mem);
 int op6XKK(int instruction, Memory &mem);
 int op7XKK(int instruction, Memory &mem);
 int op8XY0(int instruction, Memory &mem);
-int op8XY1(int instruction, Memory &mem);
-int op8XY2(int instruction, Memory &mem);
-int op8XY3(int instruction, Memory &mem);
+template <class Quirks> int op8XY1(int instruction, Memory &mem);
+template <class Quirks> int op8XY2(int instruction, Memory &mem);
+template <class Quirks> int op8XY3(int instruction, Memory &mem);
 int op8XY4(int instruction, Memory &mem);
 int op8XY5(int instruction, Memory &mem);
-int op8XY6(int instruction, Memory &mem);
+template <class Quirks> int op8XY6(int instruction, Memory &mem);
 int op8XY7(int instruction, Memory &mem);
-int op8XY8(int instruction, Memory &mem);
-int op8XY9(int instruction, Memory &mem);
-int op8XYE(int instruction, Memory &mem);
+template <class Quirks> int op8XYE(int instruction, Memory &mem);
 int op9XY0(int instruction, Memory &mem);
 int opANNN(int instruction, Memory &mem);
-int opBNNN(int instruction, Memory &mem);
+template <class Quirks> int opBNNN(int instruction, Memory &mem);
 int opCXKK(int instruction, Memory &mem);
-int opDXYN(int instruction, Memory &mem);
+template <class Quirks> int opDXYN(int instruction, Memory &mem);
 int opEX9E(int instruction, Memory &mem);
 int opEXA1(int instruction, Memory &mem);
+int opF000(int instruction, Memory &mem);
+int opFN01(int instruction, Memory &mem);
+int opF002(int instruction, Memory &mem);
 int opFX07(int instruction, Memory &mem);
 int opFX0A(int instruction, Memory &mem);
 int opFX15(int instruction, Memory &mem);
 int opFX18(int instruction, Memory &mem);
 int opFX1E(int instruction, Memory &mem);
 int opFX29(int instruction, Memory &mem);
+int opFX30(int instruction, Memory &mem);
 int opFX33(int instruction, Memory &mem);
-int opFX55(int instruction, Memory &mem);
-int opFX65(int instruction, Memory &mem);
+int opFX3A(int instruction, Memory &mem);
+template <class Quirks> int opFX55(int instruction, Memory &mem);
+template <class Quirks> int opFX65(int instruction, Memory &mem);
+int opFX75(int instruction, Memory &mem);
+int opFX85(int instruction, Memory &mem);
 int invalidOpcode(int instruction, Memory &mem);
-void draw_screen(Memory mem);
+void draw_screen(Memory &mem);
+int draw_dirty_rows(Memory &mem, ostream &out);
 
 #endif
\ No newline at end of file
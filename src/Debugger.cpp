@@ -0,0 +1,222 @@
+#include "Debugger.h"
+#include "Cpu.h"
+using namespace std;
+
+Debugger::Debugger(Memory &mem, int instructions_per_frame)
+    : mem(mem), slots(mem.mem_size), watched(mem.mem_size, 0), instructions_per_frame(instructions_per_frame)
+{
+    for (int &value : register_watches)
+        value = -1;
+    invalidate();
+}
+
+void Debugger::set_instructions_per_frame(int instructions_per_frame)
+{
+    this->instructions_per_frame = instructions_per_frame;
+    frame_position = 0;
+}
+
+
+/* Instruction cache */
+
+void Debugger::invalidate()
+{
+    invalidate(0, mem.mem_size);
+}
+
+void Debugger::invalidate(int address, int length)
+{
+    decoded_quirks = mem.get_quirks();
+    switch (decoded_quirks)
+    {
+        case QuirksProfile::Vip: decode_range<VipQuirks>(address, length); break;
+        case QuirksProfile::Schip: decode_range<SchipQuirks>(address, length); break;
+        case QuirksProfile::Xochip: decode_range<XochipQuirks>(address, length); break;
+        default: decode_range<CowgodQuirks>(address, length); break;
+    }
+}
+
+// The slot at an address holds the instruction starting there, so a byte
+// written at address also changes the slot before it
+template <class Quirks>
+void Debugger::decode_range(int address, int length)
+{
+    int mask = mem.mem_size - 1;
+    for (int i = -1; i < length && i < mem.mem_size - 1; i++)
+    {
+        int slot_address = (address + i) & mask;
+        int instruction = mem.mem_read(slot_address) << 8 | mem.mem_read(slot_address + 1);
+        Slot &slot = slots[slot_address];
+        Handler handler = decode_handler<Quirks>(instruction);
+        bool can_halt = handler == &op00EE || handler == &op2NNN || handler == &op00FD || handler == &invalidOpcode;
+        slot.handler = handler;
+        slot.instruction = instruction;
+        slot.flags = (slot.flags & breakpoint) | (store_length(instruction) ? store : 0) | (can_halt ? halts : 0);
+    }
+}
+
+
+/* Conditions */
+
+void Debugger::add_breakpoint(int address) { slots[address & (mem.mem_size - 1)].flags |= breakpoint; }
+void Debugger::remove_breakpoint(int address) { slots[address & (mem.mem_size - 1)].flags &= ~breakpoint; }
+bool Debugger::has_breakpoint(int address) { return slots[address & (mem.mem_size - 1)].flags & breakpoint; }
+
+// Counts per byte, so overlapping watchpoints come off one at a time
+void Debugger::add_watchpoint(int address, int length)
+{
+    for (int i = 0; i < length; i++)
+        watched[(address + i) & (mem.mem_size - 1)]++;
+    watchpoints++;
+}
+
+void Debugger::remove_watchpoint(int address, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        uint8_t &count = watched[(address + i) & (mem.mem_size - 1)];
+        if (count)
+            count--;
+    }
+    if (watchpoints)
+        watchpoints--;
+}
+
+int Debugger::watched_in(int address, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        int byte = (address + i) & (mem.mem_size - 1);
+        if (watched[byte])
+            return byte;
+    }
+    return -1;
+}
+
+void Debugger::watch_register(int index, int value)
+{
+    if (register_watches[index & 0xF] < 0)
+        register_watch_count++;
+    register_watches[index & 0xF] = value;
+}
+
+void Debugger::unwatch_register(int index)
+{
+    if (register_watches[index & 0xF] >= 0)
+        register_watch_count--;
+    register_watches[index & 0xF] = -1;
+}
+
+void Debugger::watch_screen_hash(uint64_t hash)
+{
+    hash_watched = true;
+    watched_hash = hash;
+}
+
+void Debugger::unwatch_screen_hash() { hash_watched = false; }
+
+void Debugger::clear()
+{
+    for (Slot &slot : slots)
+        slot.flags &= ~breakpoint;
+    watched.assign(mem.mem_size, 0);
+    watchpoints = 0;
+    for (int &value : register_watches)
+        value = -1;
+    register_watch_count = 0;
+    hash_watched = false;
+}
+
+
+/* Running */
+
+RunResult Debugger::step() { return run(1); }
+
+RunResult Debugger::run(uint64_t cycles, uint64_t frames)
+{
+    if (mem.is_halted())
+        return {StopReason::Halted, 0, mem.get_halt().pc};
+    if (mem.get_quirks() != decoded_quirks)
+        invalidate();
+    switch (decoded_quirks)
+    {
+        case QuirksProfile::Vip: return run_cached<VipQuirks>(cycles, frames);
+        case QuirksProfile::Schip: return run_cached<SchipQuirks>(cycles, frames);
+        case QuirksProfile::Xochip: return run_cached<XochipQuirks>(cycles, frames);
+        default: return run_cached<CowgodQuirks>(cycles, frames);
+    }
+}
+
+template <class Quirks>
+RunResult Debugger::run_cached(uint64_t cycles, uint64_t frames)
+{
+    if (register_watch_count || hash_watched)
+        return run_loop<Quirks, true>(cycles, frames);
+    return run_loop<Quirks, false>(cycles, frames);
+}
+
+template <class Quirks, bool conditions>
+RunResult Debugger::run_loop(uint64_t cycles, uint64_t frames)
+{
+    int mask = mem.mem_size - 1;
+    uint64_t executed = 0;
+    uint64_t frames_run = 0;
+    int skip = resume_from;
+    resume_from = -1;
+    while (executed < cycles)
+    {
+        int pc = mem.get_program_counter() & mask;
+        Slot slot = slots[pc];
+
+        int written = -1;
+        int written_length = 0;
+        if (slot.flags)
+        {
+            if ((slot.flags & breakpoint) && !(executed == 0 && pc == skip))
+            {
+                resume_from = pc;
+                return {StopReason::Breakpoint, executed, pc};
+            }
+            if (slot.flags & store)
+            {
+                written = mem.get_address_pointer();
+                written_length = store_length(slot.instruction);
+            }
+        }
+
+        // Same as step(), minus the fetch and decode
+        mem.inc_program_counter();
+        mem.inc_cycle_count();
+        slot.handler(slot.instruction, mem);
+        executed++;
+        if ((slot.flags & halts) && mem.is_halted())
+            return {StopReason::Halted, executed, pc};
+
+        if (++frame_position >= instructions_per_frame)
+        {
+            frame_position = 0;
+            mem.tick_timers();
+            frames_run++;
+        }
+
+        if (written_length)
+        {
+            decode_range<Quirks>(written, written_length);
+            int hit = watchpoints ? watched_in(written, written_length) : -1;
+            if (hit >= 0)
+                return {StopReason::Watchpoint, executed, hit};
+        }
+        if constexpr (conditions)
+        {
+            if (register_watch_count)
+                for (int i = 0; i < 16; i++)
+                    if (register_watches[i] >= 0 && mem.reg_read(i) == register_watches[i])
+                        return {StopReason::Register, executed, -1};
+            if (hash_watched && mem.get_screen_hash() == watched_hash)
+                return {StopReason::ScreenHash, executed, -1};
+        }
+        if (frames && frames_run >= frames)
+            return {StopReason::Frames, executed, -1};
+    }
+    return {StopReason::Cycles, executed, -1};
+}
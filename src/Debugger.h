@@ -0,0 +1,98 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+#include "Memory.h"
+#include <cstdint>
+#include <vector>
+
+// Why Debugger::run() returned
+enum class StopReason
+{
+    Cycles,      // Instruction budget used up
+    Frames,      // Frame budget used up
+    Breakpoint,  // About to execute an instruction at a breakpoint
+    Watchpoint,  // An instruction just wrote to a watched address
+    Register,    // A register just took the value it was watched for
+    ScreenHash,  // The screen just hashed to the value it was watched for
+    Halted,      // The machine halted (Memory::get_halt() says why)
+};
+
+struct RunResult
+{
+    StopReason reason;
+    uint64_t cycles;   // Instructions executed by this run
+    int address;       // Breakpoint or halt PC, first watched address written, else -1
+};
+
+// Runs a machine until a condition, off a cache holding every address
+// pre-decoded to its handler. Breakpoints are flags on cache slots, and
+// instructions that store to memory (FX33, FX55, 5XY2) are flagged too:
+// they check watchpoints and re-decode the bytes they overwrote, and so
+// are instructions that can halt the machine (00EE, 2NNN, 00FD and
+// invalid ones), which check for it. The loop
+// pays for nothing that isn't set, and machines run without a debugger
+// never see any of it.
+//
+// Anything else that changes code (load_rom, restoring a snapshot,
+// writing RAM directly) must be followed by invalidate().
+class Debugger
+{
+public:
+    explicit Debugger(Memory &mem, int instructions_per_frame = 10);
+
+    // Frames tick the timers every instructions_per_frame instructions,
+    // counting on from where the last run stopped
+    void set_instructions_per_frame(int instructions_per_frame);
+
+    // Re-decode all of memory, or the given range
+    void invalidate();
+    void invalidate(int address, int length);
+
+    void add_breakpoint(int address);
+    void remove_breakpoint(int address);
+    bool has_breakpoint(int address);
+    void add_watchpoint(int address, int length = 1);
+    void remove_watchpoint(int address, int length = 1);
+    void watch_register(int index, int value);   // Stop once V[index] == value
+    void unwatch_register(int index);
+    void watch_screen_hash(uint64_t hash);       // Stop once the screen hashes to this
+    void unwatch_screen_hash();
+    void clear();
+
+    // Run at most cycles instructions and (if nonzero) frames frames. After
+    // stopping at a breakpoint, the next run starts by executing the
+    // instruction under it.
+    RunResult run(uint64_t cycles, uint64_t frames = 0);
+    RunResult step();
+
+private:
+    using Handler = int (*)(int, Memory &);
+    enum SlotFlags : uint8_t { breakpoint = 1, store = 2, halts = 4 };
+    struct Slot
+    {
+        Handler handler;
+        uint16_t instruction;
+        uint8_t flags;
+    };
+
+    template <class Quirks> void decode_range(int address, int length);
+    template <class Quirks> RunResult run_cached(uint64_t cycles, uint64_t frames);
+    template <class Quirks, bool conditions> RunResult run_loop(uint64_t cycles, uint64_t frames);
+    int watched_in(int address, int length);
+
+    Memory &mem;
+    QuirksProfile decoded_quirks;
+    std::vector<Slot> slots;            // One per address
+    std::vector<uint8_t> watched;       // One per address
+    int watchpoints = 0;
+    int instructions_per_frame;
+    int frame_position = 0;
+    int resume_from = -1;  // Breakpoint the last run stopped at
+
+    // Conditions checked after every instruction while any is set
+    int register_watches[16];
+    int register_watch_count = 0;
+    bool hash_watched = false;
+    uint64_t watched_hash = 0;
+};
+
+#endif
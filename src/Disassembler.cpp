@@ -0,0 +1,317 @@
+#include "Disassembler.h"
+#include "Opcodes.h"
+#include <cstdio>
+using namespace std;
+
+static string format(const char *fmt, int a = 0, int b = 0, int c = 0)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof buffer, fmt, a, b, c);
+    return buffer;
+}
+
+string disassemble(int instruction)
+{
+    const OpcodeSpec *spec = opcode_spec(instruction);
+    if (!spec)
+        return format("DW 0x%04X", instruction);
+
+    // Fill in the mnemonic's fields
+    int x = (instruction & 0xF00) >> 8;
+    int y = (instruction & 0xF0) >> 4;
+    string text;
+    for (const char *c = spec->mnemonic; *c; c++)
+    {
+        if (*c != '{')
+        {
+            text += *c;
+            continue;
+        }
+        string field;
+        while (*++c != '}')
+            field += *c;
+        if (field == "x")
+            text += format("%X", x);
+        else if (field == "y")
+            text += format("%X", y);
+        else if (field == "X")
+            text += format("%d", x);
+        else if (field == "n")
+            text += format("%d", instruction & 0xF);
+        else if (field == "kk")
+            text += format("0x%02X", instruction & 0xFF);
+        else if (field == "nnn")
+            text += format("0x%03X", instruction & 0xFFF);
+    }
+    return text;
+}
+
+
+/* Control flow */
+
+// How an instruction passes control on
+enum class Flow { Next, Jump, Call, Skip, Return, Indirect, Invalid };
+
+// Whether the interpreter runs the instruction, rather than halting on it
+static bool runs(int instruction)
+{
+    const OpcodeSpec *spec = opcode_spec(instruction);
+    return spec && string(spec->handler) != "invalidOpcode";
+}
+
+static Flow flow_of(int instruction)
+{
+    int kk = instruction & 0xFF;
+    switch (instruction >> 12)
+    {
+        case 0x0:
+            if (instruction == 0x00EE)
+                return Flow::Return;
+            // 00FD (EXIT) ends the program like an invalid instruction, and
+            // 0NNN (zero padding, data) is one
+            return instruction == 0x00FD || !runs(instruction) ? Flow::Invalid : Flow::Next;
+        case 0x1:
+            return Flow::Jump;
+        case 0x2:
+            return Flow::Call;
+        case 0x3:
+        case 0x4:
+            return Flow::Skip;
+        case 0x5:
+            if ((instruction & 0xF) == 2 || (instruction & 0xF) == 3)
+                return Flow::Next;
+            return (instruction & 0xF) == 0 ? Flow::Skip : Flow::Invalid;
+        case 0x9:
+            return (instruction & 0xF) == 0 ? Flow::Skip : Flow::Invalid;
+        case 0xB:
+            return Flow::Indirect;
+        case 0xE:
+            return kk == 0x9E || kk == 0xA1 ? Flow::Skip : Flow::Invalid;
+    }
+    return runs(instruction) ? Flow::Next : Flow::Invalid;
+}
+
+ControlFlowGraph::ControlFlowGraph(const vector<uint8_t> &rom, int origin)
+    : origin(origin), rom(rom), code(rom.size(), false), instructions(rom.size(), false)
+{
+    auto inside = [&](int address) {
+        return address >= origin && address + 1 < origin + (int) rom.size();
+    };
+
+    // Walk every reachable path, collecting block leaders
+    set<int> leaders = {origin};
+    vector<int> work = {origin};
+    while (!work.empty())
+    {
+        int address = work.back();
+        work.pop_back();
+        while (inside(address) && !instructions[address - origin])
+        {
+            int instruction = instruction_at(address);
+            int length = instruction_length(address);
+            int nnn = instruction & 0xFFF;
+            Flow flow = flow_of(instruction);
+
+            instructions[address - origin] = true;
+            for (int i = 0; i < length && address + i - origin < (int) rom.size(); i++)
+                code[address + i - origin] = true;
+            if (instruction >> 12 == 0xA)
+                data_references.insert(nnn);
+            if (instruction == 0xF000)
+                data_references.insert(instruction_at(address + 2));
+
+            if (flow == Flow::Next)
+            {
+                address += length;
+                continue;
+            }
+            leaders.insert(address + 2);
+
+            if (flow == Flow::Jump || flow == Flow::Call || flow == Flow::Indirect)
+            {
+                leaders.insert(nnn);
+                work.push_back(nnn);
+            }
+            if (flow == Flow::Call)
+                subroutines.insert(nnn);
+            if (flow == Flow::Indirect)
+            {
+                // Jump table: consecutive jumps following the base address
+                for (int entry = nnn + 2; inside(entry) && instruction_at(entry) >> 12 == 0x1; entry += 2)
+                {
+                    leaders.insert(entry);
+                    work.push_back(entry);
+                }
+            }
+            if (flow == Flow::Skip)
+            {
+                int skipped = address + 2 + instruction_length(address + 2);
+                leaders.insert(skipped);
+                work.push_back(skipped);
+            }
+
+            if (flow == Flow::Call || flow == Flow::Skip)
+                address += 2;
+            else
+                break;
+        }
+    }
+
+    // Split the reached instructions into blocks at the leaders
+    for (int leader : leaders)
+    {
+        if (!is_instruction(leader))
+            continue;
+        BasicBlock block;
+        block.start = leader;
+        int address = leader;
+        for (;;)
+        {
+            int instruction = instruction_at(address);
+            Flow flow = flow_of(instruction);
+            int nnn = instruction & 0xFFF;
+            address += instruction_length(address);
+
+            if (flow == Flow::Next)
+            {
+                if (leaders.count(address) || !is_instruction(address))
+                {
+                    block.successors.push_back(address);
+                    break;
+                }
+                continue;
+            }
+            if (flow == Flow::Jump)
+                block.successors.push_back(nnn);
+            if (flow == Flow::Call)
+                block.successors = {nnn, address};
+            if (flow == Flow::Skip)
+                block.successors = {address, address + instruction_length(address)};
+            if (flow == Flow::Indirect)
+            {
+                block.indirect = true;
+                block.successors.push_back(nnn);
+                for (int entry = nnn + 2; inside(entry) && instruction_at(entry) >> 12 == 0x1; entry += 2)
+                    block.successors.push_back(entry);
+            }
+            block.returns = flow == Flow::Return;
+            block.halts = flow == Flow::Invalid;
+            break;
+        }
+        block.end = address;
+
+        // Only keep successors that were actually decoded
+        vector<int> successors;
+        for (int successor : block.successors)
+            if (is_instruction(successor))
+                successors.push_back(successor);
+        block.successors = successors;
+        blocks[leader] = block;
+    }
+}
+
+int ControlFlowGraph::instruction_at(int address) const
+{
+    int offset = address - origin;
+    if (offset < 0 || offset + 1 >= (int) rom.size())
+        return 0;
+    return rom[offset] << 8 | rom[offset + 1];
+}
+
+int ControlFlowGraph::instruction_length(int address) const
+{
+    return instruction_at(address) == 0xF000 ? 4 : 2;
+}
+
+bool ControlFlowGraph::is_code(int address) const
+{
+    int offset = address - origin;
+    return 0 <= offset && offset < (int) rom.size() && code[offset];
+}
+
+bool ControlFlowGraph::is_instruction(int address) const
+{
+    int offset = address - origin;
+    return 0 <= offset && offset < (int) rom.size() && instructions[offset];
+}
+
+const BasicBlock *ControlFlowGraph::block_at(int address) const
+{
+    auto next = blocks.upper_bound(address);
+    if (next == blocks.begin())
+        return nullptr;
+    const BasicBlock &block = prev(next)->second;
+    return address < block.end ? &block : nullptr;
+}
+
+
+/* Listing */
+
+static string label(const ControlFlowGraph &cfg, int address)
+{
+    if (cfg.subroutines.count(address))
+        return format("sub_%03X", address);
+    if (cfg.blocks.count(address))
+        return format("L%03X", address);
+    return format("data_%03X", address);
+}
+
+void write_listing(const ControlFlowGraph &cfg, ostream &out)
+{
+    int end = cfg.origin + cfg.rom.size();
+    int code_bytes = 0;
+    for (int address = cfg.origin; address < end; address++)
+        code_bytes += cfg.is_code(address);
+
+    out << "; origin " << format("0x%03X", cfg.origin) << ", " << cfg.rom.size() << " bytes, "
+        << code_bytes << " code, " << cfg.rom.size() - code_bytes << " data\n";
+    out << "; " << cfg.blocks.size() << " blocks, " << cfg.subroutines.size() << " subroutines\n";
+
+    int address = cfg.origin;
+    while (address < end)
+    {
+        bool starts_block = cfg.blocks.count(address);
+        if (starts_block || cfg.data_references.count(address))
+            out << "\n" << label(cfg, address) << ":\n";
+
+        if (cfg.is_instruction(address))
+        {
+            int instruction = cfg.instruction_at(address);
+            int length = cfg.instruction_length(address);
+            out << format("    %03X  %04X  ", address, instruction) << disassemble(instruction);
+            if (length == 4)
+                out << format(" 0x%04X", cfg.instruction_at(address + 2));
+            out << "\n";
+            address += length;
+
+            // Block exits after its last instruction
+            const BasicBlock *block = cfg.block_at(address - length);
+            if (block && block->end == address)
+            {
+                if (block->returns)
+                    out << "          ; return\n";
+                if (block->halts)
+                    out << "          ; invalid instruction\n";
+                if (block->indirect)
+                    out << "          ; indirect jump, V0 + base\n";
+                if (!block->successors.empty())
+                {
+                    out << "          ; ->";
+                    for (int successor : block->successors)
+                        out << " " << label(cfg, successor);
+                    out << "\n";
+                }
+            }
+        }
+        else
+        {
+            // Data drawn as a sprite row
+            int byte = cfg.rom[address - cfg.origin];
+            string pixels;
+            for (int bit = 7; bit >= 0; bit--)
+                pixels += byte >> bit & 1 ? '#' : '.';
+            out << format("    %03X  %02X    ", address, byte) << pixels << "\n";
+            address++;
+        }
+    }
+}
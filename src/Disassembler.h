@@ -0,0 +1,58 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Mnemonic for a single instruction (Cowgod's syntax), "DW 0xNNNN" for
+// anything that isn't an opcode
+std::string disassemble(int instruction);
+
+struct BasicBlock
+{
+    int start;                      // Address of the first instruction
+    int end;                        // One past the last instruction
+    std::vector<int> successors;    // Statically known next blocks
+    bool indirect = false;          // Ends in BNNN, targets depend on V0
+    bool returns = false;           // Ends in 00EE
+    bool halts = false;             // Ends in an invalid instruction or 00FD
+};
+
+// Control flow recovered by walking a ROM from its entry point, following
+// jumps, calls, skips and BNNN jump tables
+class ControlFlowGraph
+{
+public:
+    ControlFlowGraph(const std::vector<uint8_t> &rom, int origin = 0x200);
+
+    // Instruction starting at address (always big endian), and its length
+    // in bytes (4 for F000 NNNN, 2 otherwise)
+    int instruction_at(int address) const;
+    int instruction_length(int address) const;
+
+    // Whether the byte at address was reached as part of an instruction
+    bool is_code(int address) const;
+    bool is_instruction(int address) const;
+
+    // Block containing address, nullptr for data
+    const BasicBlock *block_at(int address) const;
+
+    int origin;
+    std::vector<uint8_t> rom;
+    std::map<int, BasicBlock> blocks;
+    std::set<int> subroutines;      // 2NNN targets
+    std::set<int> data_references;  // ANNN targets (sprites, BCD buffers)
+
+private:
+    std::vector<bool> code;
+    std::vector<bool> instructions;
+};
+
+// Annotated listing: labels, code with mnemonics and successors,
+// data bytes drawn as sprite rows
+void write_listing(const ControlFlowGraph &cfg, std::ostream &out);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Little endian and varint encoding helpers shared by the file formats
+
+inline void put_uint(std::vector<uint8_t> &buf, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        buf.push_back(value >> (8 * i));
+}
+
+inline uint64_t get_uint(const uint8_t *data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) data[i] << (8 * i);
+    return value;
+}
+
+inline void put_varint(std::vector<uint8_t> &buf, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buf.push_back(value | 0x80);
+        value >>= 7;
+    }
+    buf.push_back(value);
+}
+
+// Into a buffer known to have room (10 bytes at most), returning the end
+inline uint8_t *put_varint(uint8_t *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = value | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+}
+
+inline bool get_varint(const uint8_t *data, size_t size, size_t &pos, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; pos < size && shift < 64; shift += 7)
+    {
+        uint8_t byte = data[pos++];
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline bool get_varint(const std::vector<uint8_t> &buf, size_t &pos, uint64_t &value)
+{
+    return get_varint(buf.data(), buf.size(), pos, value);
+}
+
+// Signed values as varints, small magnitudes either way staying short
+inline uint64_t zigzag(int64_t value) { return (uint64_t) value << 1 ^ (uint64_t) (value >> 63); }
+inline int64_t unzigzag(uint64_t value) { return (int64_t) (value >> 1) ^ -(int64_t) (value & 1); }
+
+#endif
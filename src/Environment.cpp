@@ -0,0 +1,209 @@
+#include "Environment.h"
+#include "Cpu.h"
+#include "Image.h"
+#include <algorithm>
+using namespace std;
+
+int64_t RewardSpec::read_score(Memory &mem) const
+{
+    int64_t score = 0;
+    for (int address : score_addresses)
+        score = score * (bcd ? 10 : 256) + mem.mem_read(address);
+    return score;
+}
+
+// Seed for a machine's episode, spread out so neighbors don't correlate
+static uint64_t episode_seed(uint64_t seed, uint64_t machine, uint64_t episode)
+{
+    uint64_t x = seed ^ (machine + 1) * 0x9E3779B97F4A7C15ull ^ episode * 0xC2B2AE3D27D4EB4Full;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+VectorEnv::VectorEnv(const vector<uint8_t> &rom, int count, const EnvConfig &config)
+    : config(config), snapshot(config.quirks == QuirksProfile::Xochip ? 0x10000 : 4096)
+{
+    if (this->config.actions.empty())
+    {
+        this->config.actions.push_back(0);
+        for (int key = 0; key < 16; key++)
+            this->config.actions.push_back(1 << key);
+    }
+
+    // Every episode starts from the same machine state
+    snapshot.set_quirks(config.quirks);
+    snapshot.load_rom(rom);
+    snapshot.set_random_seed(config.seed);
+    run_frames(snapshot, config.warmup_frames, config.instructions_per_frame);
+
+    machines.assign(count, snapshot);
+    scores.assign(count, 0);
+    frames.assign(count, 0);
+    episodes.assign(count, 0);
+
+    int threads = config.threads > 0 ? config.threads : thread::hardware_concurrency();
+    parts = max(1, min(threads, count));
+    for (int part = 1; part < parts; part++)
+        workers.emplace_back(&VectorEnv::worker, this, part);
+}
+
+VectorEnv::~VectorEnv()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    start.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+int VectorEnv::size() { return machines.size(); }
+int VectorEnv::observation_size() { return config.hires_observations ? 128 * 64 / 8 : 64 * 32 / 8; }
+int VectorEnv::action_count() { return config.actions.size(); }
+Memory &VectorEnv::machine(int index) { return machines[index]; }
+
+void VectorEnv::reset(uint8_t *observations)
+{
+    step_is_reset = true;
+    step_observations = observations;
+    run_workers();
+}
+
+void VectorEnv::step(const int *actions, uint8_t *observations, float *rewards, uint8_t *dones)
+{
+    step_is_reset = false;
+    step_actions = actions;
+    step_observations = observations;
+    step_rewards = rewards;
+    step_dones = dones;
+    run_workers();
+}
+
+void VectorEnv::reset_machine(int index)
+{
+    // Copying over an existing machine reuses its storage
+    machines[index] = snapshot;
+    machines[index].set_random_seed(episode_seed(config.seed, index, episodes[index]++));
+    scores[index] = config.reward.read_score(machines[index]);
+    frames[index] = 0;
+}
+
+void VectorEnv::step_range(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        Memory &mem = machines[i];
+        if (step_is_reset)
+        {
+            reset_machine(i);
+            observe(i);
+            continue;
+        }
+
+        // Hold the action's keys for the skipped frames
+        int action = step_actions[i];
+        mem.set_keys(action >= 0 && action < action_count() ? config.actions[action] : 0);
+        run_frames(mem, config.frame_skip, config.instructions_per_frame);
+        frames[i] += config.frame_skip;
+
+        int64_t score = config.reward.read_score(mem);
+        if (step_rewards)
+            step_rewards[i] = score - scores[i];
+        scores[i] = score;
+
+        const RewardSpec &reward = config.reward;
+        bool over = mem.is_halted()
+                    || (reward.lives_address >= 0 && mem.mem_read(reward.lives_address) == 0)
+                    || (reward.max_frames > 0 && frames[i] >= reward.max_frames);
+        if (step_dones)
+            step_dones[i] = over;
+        if (over)
+            reset_machine(i);
+        observe(i);
+    }
+}
+
+void VectorEnv::observe(int index)
+{
+    if (!step_observations)
+        return;
+    uint8_t *observation = step_observations + (size_t) index * observation_size();
+    Memory &mem = machines[index];
+    bool hires = config.hires_observations;
+    int rows = hires ? 64 : 32;
+    for (int row = 0; row < rows; row++)
+    {
+        uint64_t words[2] = {0, 0};
+        if (mem.is_hires() == hires)
+        {
+            words[0] = mem.screen_row(row, 0);
+            words[1] = hires ? mem.screen_row(row, 1) : 0;
+        }
+        else if (hires)
+        {
+            uint64_t lores = mem.screen_row(row / 2, 0);
+            words[0] = double_pixels(lores >> 32);
+            words[1] = double_pixels(lores);
+        }
+        else
+            words[0] = (uint64_t) halve_pixels(mem.screen_row(2 * row, 0)) << 32
+                     | halve_pixels(mem.screen_row(2 * row, 1));
+
+        for (int word = 0; word < (hires ? 2 : 1); word++)
+            for (int shift = 56; shift >= 0; shift -= 8)
+                *observation++ = words[word] >> shift;
+    }
+}
+
+
+/* Threads */
+
+// Share of the machines for part out of parts
+static void share(int count, int part, int parts, int &begin, int &end)
+{
+    begin = (int64_t) count * part / parts;
+    end = (int64_t) count * (part + 1) / parts;
+}
+
+void VectorEnv::run_workers()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        pending = workers.size();
+        generation++;
+    }
+    start.notify_all();
+
+    // The calling thread takes the first share
+    int begin, end;
+    share(size(), 0, parts, begin, end);
+    step_range(begin, end);
+
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [&]() { return pending == 0; });
+}
+
+void VectorEnv::worker(int part)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> guard(lock);
+            start.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        int begin, end;
+        share(size(), part, parts, begin, end);
+        step_range(begin, end);
+
+        lock_guard<mutex> guard(lock);
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+#include "Memory.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where a ROM keeps its score and lives in RAM. The reward for a step is
+// how much the score went up; the episode ends when the lives byte reads
+// 0, after max_frames frames, or when the machine halts.
+struct RewardSpec
+{
+    std::vector<int> score_addresses;  // Most significant byte or digit first
+    bool bcd = false;                  // One decimal digit a byte, as FX33 stores them
+    int lives_address = -1;            // -1 for no lives
+    int max_frames = 0;                // 0 for no limit
+
+    // Score as it reads in a machine's RAM now
+    int64_t read_score(Memory &mem) const;
+};
+
+struct EnvConfig
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    int instructions_per_frame = 10;
+    int frame_skip = 4;           // Frames run per step with the action held
+    int warmup_frames = 0;        // Run before taking the reset snapshot
+    int threads = 1;              // 0 for one per hardware thread
+    uint64_t seed = 1;            // Each machine and episode gets its own seed from this
+    bool hires_observations = false;
+    std::vector<uint16_t> actions;  // Keys held for each action, empty for
+                                    // nothing plus each of the 16 keys
+    RewardSpec reward;
+};
+
+// A batch of machines running the same ROM, stepped together. Observations
+// are the packed plane 0 screen (64x32 or 128x64, 8 pixels a byte, most
+// significant bit first) written straight into caller buffers of
+// size() * observation_size() bytes, machine after machine. Machines whose
+// episode ends are reset from the snapshot taken at construction, and
+// their observation is of the new episode.
+class VectorEnv
+{
+public:
+    VectorEnv(const std::vector<uint8_t> &rom, int count, const EnvConfig &config = EnvConfig());
+    ~VectorEnv();
+
+    int size();
+    int observation_size();
+    int action_count();
+
+    // Start every machine from the snapshot
+    void reset(uint8_t *observations);
+
+    // One action per machine; observations, rewards and dones may be null
+    void step(const int *actions, uint8_t *observations, float *rewards, uint8_t *dones);
+
+    Memory &machine(int index);
+
+private:
+    void reset_machine(int index);
+    void step_range(int begin, int end);
+    void observe(int index);
+    void run_workers();
+    void worker(int part);
+
+    EnvConfig config;
+    Memory snapshot;
+    std::vector<Memory> machines;
+    std::vector<int64_t> scores;
+    std::vector<int> frames;
+    std::vector<uint64_t> episodes;
+
+    // Arguments of the step in progress
+    const int *step_actions = nullptr;
+    uint8_t *step_observations = nullptr;
+    float *step_rewards = nullptr;
+    uint8_t *step_dones = nullptr;
+    bool step_is_reset = false;
+
+    // Worker threads, each taking its share of the machines per step
+    std::vector<std::thread> workers;
+    int parts = 1;
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    int pending = 0;
+    bool stopping = false;
+};
+
+#endif
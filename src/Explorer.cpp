@@ -0,0 +1,221 @@
+#include "Explorer.h"
+#include "Cpu.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+using namespace std;
+
+/* State set */
+
+bool StateSet::insert(uint64_t hash)
+{
+    Shard &shard = shards[hash % shard_count];
+    lock_guard<mutex> guard(shard.lock);
+    return shard.hashes.insert(hash).second;
+}
+bool StateSet::contains(uint64_t hash)
+{
+    Shard &shard = shards[hash % shard_count];
+    lock_guard<mutex> guard(shard.lock);
+    return shard.hashes.count(hash) != 0;
+}
+uint64_t StateSet::size()
+{
+    uint64_t total = 0;
+    for (Shard &shard : shards)
+    {
+        lock_guard<mutex> guard(shard.lock);
+        total += shard.hashes.size();
+    }
+    return total;
+}
+
+/* Exploring */
+
+// Keys held at each decision, a list the branches below a state share
+struct InputPath
+{
+    shared_ptr<const InputPath> parent;
+    uint16_t keys;
+};
+
+struct ExploreNode
+{
+    Memory mem;
+    shared_ptr<const InputPath> path;
+};
+
+static int fetch(Memory &mem)
+{
+    int pc = mem.get_program_counter();
+    return mem.mem_read(pc) << 8 | mem.mem_read(pc + 1);
+}
+
+static bool is_decision(int instruction)
+{
+    int opcode = instruction & 0xF0FF;
+    return opcode == 0xF00A || opcode == 0xE09E || opcode == 0xE0A1;
+}
+
+// Keypads to branch into at the machine's next instruction. A machine
+// that ran out of frames before a decision carries on with what it has.
+static vector<uint16_t> choices(Memory &mem)
+{
+    int instruction = fetch(mem);
+    if ((instruction & 0xF0FF) == 0xF00A)
+    {
+        vector<uint16_t> presses;
+        for (int key = 0; key < 16; key++)
+            presses.push_back(1 << key);
+        return presses;
+    }
+    if (is_decision(instruction))
+    {
+        int key = mem.reg_read((instruction & 0xF00) >> 8) & 0xF;
+        return {(uint16_t) (1 << key), 0};
+    }
+    return {mem.get_keys()};
+}
+
+// The state hash, plus where the machine is in its frame since that
+// decides when the timers next tick
+static uint64_t state_key(Memory &mem, int instructions_per_frame)
+{
+    return mem.get_state_hash() ^ mem.get_cycle_count() % instructions_per_frame * 0x9E3779B97F4A7C15ull;
+}
+
+static vector<uint16_t> inputs(shared_ptr<const InputPath> path)
+{
+    vector<uint16_t> keys;
+    for (; path; path = path->parent)
+        keys.push_back(path->keys);
+    reverse(keys.begin(), keys.end());
+    return keys;
+}
+
+static bool shorter(const ExploredFault &a, const ExploredFault &b)
+{
+    return a.inputs.size() != b.inputs.size() ? a.inputs.size() < b.inputs.size() : a.inputs < b.inputs;
+}
+
+// Faults are listed once for each place they happen, with the shortest
+// way there
+static void add_fault(vector<ExploredFault> &faults, mutex &lock, const ExploredFault &fault)
+{
+    lock_guard<mutex> guard(lock);
+    for (ExploredFault &known : faults)
+        if (known.halt.fault == fault.halt.fault && known.halt.pc == fault.halt.pc)
+        {
+            if (shorter(fault, known))
+                known = fault;
+            return;
+        }
+    faults.push_back(fault);
+}
+
+// Run until the next decision, a halt or max_frames, ticking the timers
+// every instructions_per_frame instructions. Returns the instructions run.
+template <class Quirks>
+static uint64_t advance(Memory &mem, const ExploreConfig &config)
+{
+    uint64_t limit = (uint64_t) config.max_frames * config.instructions_per_frame;
+    uint64_t executed = 0;
+    while (true)
+    {
+        step<Quirks>(mem);
+        executed++;
+        if (mem.is_halted())
+            break;
+        if (mem.get_cycle_count() % config.instructions_per_frame == 0)
+            mem.tick_timers();
+        if (executed >= limit || is_decision(fetch(mem)))
+            break;
+    }
+    return executed;
+}
+
+template <class Quirks>
+static ExploreResult explore(Memory &start, const ExploreConfig &config)
+{
+    ExploreResult result;
+    StateSet seen;
+    atomic<uint64_t> states {0};
+    atomic<uint64_t> instructions {0};
+    mutex faults_lock;
+
+    // Record a state reached, false if it's been seen already
+    auto reached = [&](ExploreNode &node) {
+        if (!seen.insert(state_key(node.mem, config.instructions_per_frame)))
+            return false;
+        states++;
+        if (node.mem.is_halted())
+            add_fault(result.faults, faults_lock, {node.mem.get_halt(), inputs(node.path)});
+        return !node.mem.is_halted();
+    };
+
+    // The first state is the first decision
+    vector<ExploreNode> level;
+    ExploreNode first {start, nullptr};
+    if (!first.mem.is_halted() && !is_decision(fetch(first.mem)))
+        instructions += advance<Quirks>(first.mem, config);
+    if (reached(first))
+        level.push_back(move(first));
+
+    int threads = config.threads > 0 ? config.threads : max(1u, thread::hardware_concurrency());
+    bool full = false;
+    while (!level.empty() && !full && (config.max_depth == 0 || result.depth < config.max_depth))
+    {
+        // Workers take states off the level one at a time and keep the new
+        // states they branch into
+        int parts = max(1, (int) min<size_t>(threads, level.size()));
+        vector<vector<ExploreNode>> next(parts);
+        atomic<size_t> taken {0};
+        atomic<bool> stop {false};
+        auto work = [&](int part) {
+            size_t i;
+            while (!stop && (i = taken++) < level.size())
+                for (uint16_t keys : choices(level[i].mem))
+                {
+                    ExploreNode branch {level[i].mem, make_shared<const InputPath>(InputPath {level[i].path, keys})};
+                    branch.mem.set_keys(keys);
+                    instructions += advance<Quirks>(branch.mem, config);
+                    if (reached(branch))
+                        next[part].push_back(move(branch));
+                    if (states >= config.max_states)
+                        stop = true;
+                }
+        };
+        vector<thread> workers;
+        for (int part = 1; part < parts; part++)
+            workers.emplace_back(work, part);
+        work(0);
+        for (auto &worker : workers)
+            worker.join();
+
+        full = stop;
+        level.clear();
+        for (auto &found : next)
+            move(found.begin(), found.end(), back_inserter(level));
+        if (!level.empty())
+            result.depth++;
+    }
+
+    result.states = states;
+    result.instructions = instructions;
+    result.complete = level.empty() && !full;
+    sort(result.faults.begin(), result.faults.end(), shorter);
+    return result;
+}
+
+ExploreResult explore(const Memory &start, const ExploreConfig &config)
+{
+    Memory mem = start;
+    switch (mem.get_quirks())
+    {
+        case QuirksProfile::Vip: return explore<VipQuirks>(mem, config);
+        case QuirksProfile::Schip: return explore<SchipQuirks>(mem, config);
+        case QuirksProfile::Xochip: return explore<XochipQuirks>(mem, config);
+        default: return explore<CowgodQuirks>(mem, config);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef EXPLORER_H
+#define EXPLORER_H
+#include "Memory.h"
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// Set of 64-bit state hashes that threads can insert into at once, split
+// into shards with a lock each so inserts rarely wait on one another
+class StateSet
+{
+public:
+    // True if the hash wasn't in the set yet
+    bool insert(uint64_t hash);
+    bool contains(uint64_t hash);
+    uint64_t size();
+
+private:
+    static const int shard_count = 64;
+    struct Shard
+    {
+        std::mutex lock;
+        std::unordered_set<uint64_t> hashes;
+    };
+    Shard shards[shard_count];
+};
+
+struct ExploreConfig
+{
+    int instructions_per_frame = 10;
+    uint64_t max_states = 100000;  // Stop once this many states are known
+    int max_depth = 0;             // Input decisions deep, 0 for no limit
+    int max_frames = 600;          // Frames run without reaching a decision
+                                   // before the state counts as one anyway
+    int threads = 0;               // 0 for one per hardware thread
+};
+
+// A halt the explorer ran into, with the keys held at each decision on
+// the shortest way there
+struct ExploredFault
+{
+    Halt halt;
+    std::vector<uint16_t> inputs;
+};
+
+struct ExploreResult
+{
+    uint64_t states = 0;        // Distinct states reached
+    uint64_t instructions = 0;  // Executed over all branches
+    int depth = 0;              // Deepest decision level reached
+    bool complete = false;      // Every reachable state was explored
+    std::vector<ExploredFault> faults;  // One per fault and address, shortest
+                                        // input sequence first
+};
+
+// Explore every state a ROM can reach by branching on input. A state is
+// a machine stopped at an instruction that reads the keypad: FX0A forks
+// into a press of each of the 16 keys, EX9E and EXA1 into the key they
+// test held and not held. Each branch runs on to the next such
+// instruction, and states already seen (by Memory::get_state_hash() and
+// where the machine is in the frame) aren't explored again. Levels are
+// explored breadth first, their states split across threads.
+ExploreResult explore(const Memory &start, const ExploreConfig &config = ExploreConfig());
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+// Why a machine stopped running by itself. A halted machine keeps its
+// program counter on the instruction that stopped it, and every run loop
+// returns as soon as it halts.
+enum class Fault
+{
+    None,
+    Exit,            // 00FD (SUPER-CHIP)
+    StackOverflow,   // 2NNN with all 16 stack entries in use
+    StackUnderflow,  // 00EE with nothing on the stack
+    InvalidOpcode,   // Not an instruction on any supported platform
+};
+
+struct Halt
+{
+    Fault fault = Fault::None;
+    int pc = 0;           // Where the instruction was
+    int instruction = 0;
+};
+
+inline const char *fault_name(Fault fault)
+{
+    switch (fault)
+    {
+        case Fault::Exit: return "exit";
+        case Fault::StackOverflow: return "stack overflow";
+        case Fault::StackUnderflow: return "stack underflow";
+        case Fault::InvalidOpcode: return "invalid opcode";
+        default: return "none";
+    }
+}
+
+#endif
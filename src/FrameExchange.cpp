@@ -0,0 +1,34 @@
+#include "FrameExchange.h"
+using namespace std;
+
+int VideoFrame::pixel(int x, int y) const
+{
+    int index = 2 * y + x / 64;
+    int bit = 63 - x % 64;
+    return (rows[0][index] >> bit & 1) | (rows[1][index] >> bit & 1) << 1;
+}
+
+void capture_frame(Memory &mem, VideoFrame &frame)
+{
+    frame.width = mem.screen_width;
+    frame.height = mem.screen_height;
+    int words = mem.screen_width / 64;
+    frame.planes = mem.get_planes_used() & 2 ? 2 : 1;
+    for (int plane = 0; plane < frame.planes; plane++)
+        for (int row = 0; row < mem.screen_height; row++)
+            for (int word = 0; word < words; word++)
+                frame.rows[plane][2 * row + word] = mem.screen_row(row, word, plane);
+    frame.sound = mem.get_sound_timer() > 0;
+    frame.pitch = mem.get_pitch();
+}
+
+void FrameExchange::publish(Memory &mem)
+{
+    VideoFrame &frame = frames.back();
+    capture_frame(mem, frame);
+    frame.number = ++published;
+    frames.publish();
+}
+
+bool FrameExchange::update() { return frames.update(); }
+const VideoFrame &FrameExchange::front() const { return frames.front(); }
@@ -0,0 +1,55 @@
+#ifndef FRAME_EXCHANGE_H
+#define FRAME_EXCHANGE_H
+#include "Memory.h"
+#include "TripleBuffer.h"
+#include <cstdint>
+
+// A finished 60 Hz frame, as seen by threads other than the CPU's
+struct VideoFrame
+{
+    uint64_t number = 0;
+    int width = 64;
+    int height = 32;
+    int planes = 1;            // Planes copied, the rest are blank
+    uint64_t rows[2][128] {};  // Per plane, packed like the machine's screen
+    bool sound = false;        // Sound timer running
+    int pitch = 64;
+
+    // Pixel color at (x, y), bit n from plane n
+    int pixel(int x, int y) const;
+};
+
+// Copy the screen and sound state of a machine into a frame. Only the
+// rows of the current resolution and the planes the program has used
+// are copied, 256 bytes for a plain CHIP-8 screen.
+void capture_frame(Memory &mem, VideoFrame &frame);
+
+// Receives each finished frame from the machine at vblank, on the CPU
+// thread (see Memory::set_frame_publisher)
+class FramePublisher
+{
+public:
+    virtual ~FramePublisher() = default;
+    virtual void publish(Memory &mem) = 0;
+};
+
+// Publishes frames from the CPU thread to one reader thread. The machine
+// calls publish() at vblank; the reader
+// calls update() and reads front(), which stays whole and unchanged until
+// its next update() no matter what the CPU does meanwhile.
+class FrameExchange : public FramePublisher
+{
+public:
+    // CPU thread
+    void publish(Memory &mem) override;
+
+    // Reader thread, true if a newer frame was published since the last call
+    bool update();
+    const VideoFrame &front() const;
+
+private:
+    TripleBuffer<VideoFrame> frames;
+    uint64_t published = 0;
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "Frontend.h"
+#include "Cpu.h"
+#include "Image.h"
+#include "Keypad.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef CHIP8_WITH_SDL
+#include <SDL2/SDL.h>
+#endif
+using namespace std;
+
+// Plane 0 as packed image bytes (see Image.h)
+static vector<uint8_t> frame_plane(const VideoFrame &frame)
+{
+    vector<uint8_t> plane;
+    int words = frame.width / 64;
+    for (int row = 0; row < frame.height; row++)
+        for (int word = 0; word < words; word++)
+            for (int shift = 56; shift >= 0; shift -= 8)
+                plane.push_back(frame.rows[0][2 * row + word] >> shift);
+    return plane;
+}
+
+
+/* Terminal */
+
+TerminalVideo::TerminalVideo(ostream &out) : out(out) {}
+
+void TerminalVideo::present(const VideoFrame &frame)
+{
+    if (drawn && frame.width == last.width && memcmp(frame.rows, last.rows, sizeof frame.rows) == 0)
+        return;
+
+    // Upper and lower half blocks, two pixel rows per line
+    static const char *cells[4] = {" ", "▀", "▄", "█"};
+    string screen = "\x1b[H";
+    if (!drawn || frame.width != last.width)
+        screen += "\x1b[2J";
+    for (int y = 0; y < frame.height; y += 2)
+    {
+        for (int x = 0; x < frame.width; x++)
+            screen += cells[(frame.pixel(x, y) != 0) | (frame.pixel(x, y + 1) != 0) << 1];
+        screen += "\x1b[K\r\n";
+    }
+    out << screen << flush;
+    last = frame;
+    drawn = true;
+}
+
+TerminalAudio::TerminalAudio(ostream &out) : out(out) {}
+
+void TerminalAudio::set_tone(bool on, int pitch)
+{
+    if (on && !playing)
+        out << '\a' << flush;
+    playing = on;
+}
+
+// How long a typed key stays pressed
+static const int key_hold_ms = 100;
+
+static int64_t now_ms()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TerminalInput::TerminalInput()
+{
+    // Unbuffered, unechoed input if stdin is a terminal
+    termios mode;
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &mode) == 0)
+    {
+        saved = new termios(mode);
+        mode.c_lflag &= ~(ICANON | ECHO);
+        mode.c_cc[VMIN] = 0;
+        mode.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+    }
+}
+
+TerminalInput::~TerminalInput()
+{
+    if (saved)
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, saved);
+        delete saved;
+    }
+}
+
+bool TerminalInput::poll(Memory &mem)
+{
+    int64_t now = now_ms();
+    for (int key = 0; key < 16; key++)
+        if (release_at[key] && release_at[key] <= now)
+        {
+            mem.set_key(key, false);
+            release_at[key] = 0;
+        }
+
+    pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    while (::poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN))
+    {
+        char c;
+        if (read(STDIN_FILENO, &c, 1) != 1)
+            break;
+        if (c == 27)
+            return false;
+        int key = key_for_char(c);
+        if (key >= 0)
+        {
+            mem.set_key(key, true);
+            release_at[key] = now + key_hold_ms;
+        }
+    }
+    return true;
+}
+
+
+/* Images */
+
+ImageVideo::ImageVideo(const string &prefix, bool png, int every, int scale)
+    : prefix(prefix), png(png), every(every), scale(scale) {}
+
+int ImageVideo::get_images_written() { return images_written; }
+
+void ImageVideo::present(const VideoFrame &frame)
+{
+    if (frame.number % every)
+        return;
+
+    char number[16];
+    snprintf(number, sizeof number, "%06llu", (unsigned long long) frame.number);
+    ofstream out(prefix + number + (png ? ".png" : ".ppm"), ios::binary);
+    if (png)
+        write_png(frame_plane(frame), frame.width, frame.height, out, scale);
+    else
+        write_ppm(frame_plane(frame), frame.width, frame.height, out, scale);
+    if (out)
+        images_written++;
+}
+
+
+/* SDL */
+
+#ifdef CHIP8_WITH_SDL
+struct SdlFrontend::State
+{
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    SDL_Texture *texture = nullptr;
+    SDL_AudioDeviceID audio = 0;
+    atomic<bool> tone {false};
+    atomic<double> frequency {4000};
+    double phase = 0;
+};
+
+SdlFrontend::SdlFrontend(int scale) : state(new State)
+{
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    state->window = SDL_CreateWindow("CHIP-8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                     128 * scale / 2, 64 * scale / 2, 0);
+    state->renderer = SDL_CreateRenderer(state->window, -1, SDL_RENDERER_PRESENTVSYNC);
+    state->texture = SDL_CreateTexture(state->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_STREAMING, 128, 64);
+
+    SDL_AudioSpec want = {}, have;
+    want.freq = 44100;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;
+    // Square wave at the current pitch while the tone is on
+    want.callback = [](void *data, Uint8 *stream, int length) {
+        auto *state = (State *) data;
+        auto *samples = (int16_t *) stream;
+        double step = state->frequency / 44100;
+        for (int i = 0; i < length / 2; i++)
+        {
+            samples[i] = state->tone ? (state->phase < 0.5 ? 3000 : -3000) : 0;
+            state->phase = fmod(state->phase + step, 1.0);
+        }
+    };
+    want.userdata = state;
+    state->audio = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+    if (state->audio)
+        SDL_PauseAudioDevice(state->audio, 0);
+}
+
+SdlFrontend::~SdlFrontend()
+{
+    if (state->audio)
+        SDL_CloseAudioDevice(state->audio);
+    SDL_DestroyTexture(state->texture);
+    SDL_DestroyRenderer(state->renderer);
+    SDL_DestroyWindow(state->window);
+    SDL_Quit();
+    delete state;
+}
+
+void SdlFrontend::present(const VideoFrame &frame)
+{
+    static const uint32_t palette[4] = {0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555};
+    uint32_t pixels[128 * 64];
+    for (int y = 0; y < frame.height; y++)
+        for (int x = 0; x < frame.width; x++)
+            pixels[y * frame.width + x] = palette[frame.pixel(x, y)];
+
+    SDL_Rect area = {0, 0, frame.width, frame.height};
+    SDL_UpdateTexture(state->texture, &area, pixels, frame.width * 4);
+    SDL_RenderClear(state->renderer);
+    SDL_RenderCopy(state->renderer, state->texture, &area, nullptr);
+    SDL_RenderPresent(state->renderer);
+}
+
+void SdlFrontend::set_tone(bool on, int pitch)
+{
+    // XO-CHIP pitch 64 is 4000 Hz, 48 steps an octave
+    state->frequency = 4000 * pow(2.0, (pitch - 64) / 48.0);
+    state->tone = on;
+}
+
+bool SdlFrontend::poll(Memory &mem)
+{
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        if (event.type == SDL_QUIT)
+            return false;
+        if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP)
+            continue;
+        SDL_Keycode code = event.key.keysym.sym;
+        if (code == SDLK_ESCAPE)
+            return false;
+        int key = code < 256 ? key_for_char(code) : -1;
+        if (key >= 0)
+            mem.set_key(key, event.type == SDL_KEYDOWN);
+    }
+    return true;
+}
+#endif
+
+
+/* Event loop */
+
+Frontend::Frontend(Memory &mem, VideoSink &video, AudioSink &audio, InputSource &input)
+    : mem(mem), video(video), audio(audio), input(input) {}
+
+void Frontend::set_instructions_per_frame(int instructions) { instructions_per_frame = instructions; }
+void Frontend::set_throttle(bool throttle) { this->throttle = throttle; }
+void Frontend::set_debug_server(GdbServer *server) { debug_server = server; }
+
+// CPU thread
+void Frontend::emulate(int64_t frame_limit)
+{
+    const auto frame_time = chrono::nanoseconds(1000000000 / 60);
+    auto deadline = chrono::steady_clock::now();
+    for (int64_t frame = 1; running && (frame_limit < 0 || frame <= frame_limit); frame++)
+    {
+        // Ticking the timers publishes the frame
+        ::run(mem, instructions_per_frame);
+        bool halted = mem.is_halted();
+        mem.tick_timers();
+        frames_emulated = frame;
+
+        // The session runs the machine itself, pick up the pace after it
+        if (debug_server && debug_server->has_client())
+        {
+            debug_server->serve(instructions_per_frame);
+            deadline = chrono::steady_clock::now();
+        }
+
+        // A halted machine is done, unless a debugger may come to look at it
+        if (halted && !debug_server)
+            break;
+
+        if (throttle)
+        {
+            deadline += frame_time;
+            this_thread::sleep_until(deadline);
+        }
+    }
+    running = false;
+}
+
+uint64_t Frontend::run(int64_t frame_limit)
+{
+    running = true;
+    frames_emulated = 0;
+    mem.set_frame_publisher(&frames);
+    thread cpu(&Frontend::emulate, this, frame_limit);
+
+    bool tone = false;
+    auto present = [&]() {
+        const VideoFrame &frame = frames.front();
+        video.present(frame);
+        if (frame.sound != tone)
+            audio.set_tone(frame.sound, frame.pitch);
+        tone = frame.sound;
+    };
+
+    // Single threaded loop: input, then the newest frame if there is one
+    while (running)
+    {
+        if (!input.poll(mem))
+            running = false;
+        if (frames.update())
+            present();
+        else
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    cpu.join();
+    mem.set_frame_publisher(nullptr);
+
+    // The CPU's last frame
+    if (frames.update())
+        present();
+    if (tone)
+        audio.set_tone(false, mem.get_pitch());
+    return frames_emulated;
+}
+
+void Frontend::stop() { running = false; }
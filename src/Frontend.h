@@ -0,0 +1,168 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+#include "FrameExchange.h"
+#include "GdbServer.h"
+#include "Memory.h"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Backends. Video and audio sinks are called on the event loop thread only.
+class VideoSink
+{
+public:
+    virtual ~VideoSink() = default;
+    virtual void present(const VideoFrame &frame) = 0;
+};
+
+class AudioSink
+{
+public:
+    virtual ~AudioSink() = default;
+    virtual void set_tone(bool on, int pitch) = 0;
+};
+
+// Polled once per event loop turn, may press and release keys on the
+// machine (the keypad is safe to write from any thread). Returns false
+// to quit.
+class InputSource
+{
+public:
+    virtual ~InputSource() = default;
+    virtual bool poll(Memory &mem) = 0;
+};
+
+// Discards everything, for headless runs
+class NullVideo : public VideoSink
+{
+public:
+    void present(const VideoFrame &frame) override {}
+};
+
+class NullAudio : public AudioSink
+{
+public:
+    void set_tone(bool on, int pitch) override {}
+};
+
+class NullInput : public InputSource
+{
+public:
+    bool poll(Memory &mem) override { return true; }
+};
+
+// Redraws the screen in place on an ANSI terminal, two pixel rows per
+// character cell, only when it changed
+class TerminalVideo : public VideoSink
+{
+public:
+    explicit TerminalVideo(std::ostream &out);
+    void present(const VideoFrame &frame) override;
+
+private:
+    std::ostream &out;
+    VideoFrame last;
+    bool drawn = false;
+};
+
+// Rings the terminal bell when the tone starts
+class TerminalAudio : public AudioSink
+{
+public:
+    explicit TerminalAudio(std::ostream &out);
+    void set_tone(bool on, int pitch) override;
+
+private:
+    std::ostream &out;
+    bool playing = false;
+};
+
+// Keys typed on stdin (1234/QWER/ASDF/ZXCV), held for a few frames since
+// a terminal doesn't report key releases; Escape quits
+class TerminalInput : public InputSource
+{
+public:
+    TerminalInput();
+    ~TerminalInput();
+    bool poll(Memory &mem) override;
+
+private:
+    int64_t release_at[16] {};  // Milliseconds, 0 when not held
+    struct termios *saved = nullptr;  // Terminal settings to restore
+};
+
+// Writes every nth frame to prefix000000.ppm (or .png), plane 0 only
+class ImageVideo : public VideoSink
+{
+public:
+    ImageVideo(const std::string &prefix, bool png = false, int every = 1, int scale = 1);
+    void present(const VideoFrame &frame) override;
+    int get_images_written();
+
+private:
+    std::string prefix;
+    bool png;
+    int every;
+    int scale;
+    int images_written = 0;
+};
+
+// Optional SDL2 window with audio and keyboard input
+#ifdef CHIP8_WITH_SDL
+class SdlFrontend : public VideoSink, public AudioSink, public InputSource
+{
+public:
+    explicit SdlFrontend(int scale = 10);
+    ~SdlFrontend();
+    void present(const VideoFrame &frame) override;
+    void set_tone(bool on, int pitch) override;
+    bool poll(Memory &mem) override;
+
+private:
+    struct State;
+    State *state;
+};
+#endif
+
+
+// Runs a machine on its own thread at 60 frames a second while a single
+// threaded event loop on the calling thread polls input and presents
+// frames. The machine publishes each frame at vblank through a
+// FrameExchange, so a slow sink only ever skips frames and never holds
+// up the CPU.
+class Frontend
+{
+public:
+    Frontend(Memory &mem, VideoSink &video, AudioSink &audio, InputSource &input);
+
+    // Instructions per frame, and whether to keep to 60 Hz or run flat out
+    void set_instructions_per_frame(int instructions);
+    void set_throttle(bool throttle);
+
+    // Hand the machine to a GDB client between frames whenever one
+    // connects (checked once a frame)
+    void set_debug_server(GdbServer *server);
+
+    // Run until the input quits, stop() is called or frames have run
+    // (frames < 0 for no limit), returns the frames emulated
+    uint64_t run(int64_t frames = -1);
+    void stop();
+
+private:
+    void emulate(int64_t frames);
+
+    Memory &mem;
+    VideoSink &video;
+    AudioSink &audio;
+    InputSource &input;
+    int instructions_per_frame = 10;
+    bool throttle = true;
+    GdbServer *debug_server = nullptr;
+
+    FrameExchange frames;
+    std::atomic<bool> running {false};
+    std::atomic<uint64_t> frames_emulated {0};
+};
+
+#endif
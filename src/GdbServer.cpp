@@ -0,0 +1,517 @@
+#include "GdbServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+static const int register_count = 21;
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <feature name=\"org.chip8.core\">\n"
+    "    <reg name=\"v0\" bitsize=\"8\" regnum=\"0\"/>\n"
+    "    <reg name=\"v1\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v2\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v3\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v4\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v5\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v6\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v7\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v8\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v9\" bitsize=\"8\"/>\n"
+    "    <reg name=\"va\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vb\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vc\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vd\" bitsize=\"8\"/>\n"
+    "    <reg name=\"ve\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vf\" bitsize=\"8\"/>\n"
+    "    <reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"8\"/>\n"
+    "    <reg name=\"dt\" bitsize=\"8\"/>\n"
+    "    <reg name=\"st\" bitsize=\"8\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+
+
+/* Encoding */
+
+static string hex_byte(int value)
+{
+    char text[3];
+    snprintf(text, sizeof text, "%02x", value & 0xFF);
+    return text;
+}
+
+static int hex_digit(char c)
+{
+    if ('0' <= c && c <= '9')
+        return c - '0';
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+    if ('A' <= c && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Bytes of hex text, false if it isn't all hex pairs
+static bool parse_bytes(const string &text, vector<uint8_t> &bytes)
+{
+    if (text.size() % 2)
+        return false;
+    bytes.clear();
+    for (size_t i = 0; i < text.size(); i += 2)
+    {
+        int high = hex_digit(text[i]), low = hex_digit(text[i + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        bytes.push_back(high << 4 | low);
+    }
+    return true;
+}
+
+// Comma separated hex numbers ("addr,length"), false on anything else
+static bool parse_numbers(const string &text, long *numbers, int count)
+{
+    const char *p = text.c_str();
+    for (int i = 0; i < count; i++)
+    {
+        char *end;
+        numbers[i] = strtol(p, &end, 16);
+        if (end == p || *end != (i + 1 < count ? ',' : '\0'))
+            return false;
+        p = end + 1;
+    }
+    return true;
+}
+
+static int register_size(int index) { return index == 16 || index == 17 ? 2 : 1; }
+
+static int read_register(Memory &mem, int index)
+{
+    if (index < 16)
+        return mem.reg_read(index);
+    switch (index)
+    {
+        case 16: return mem.get_address_pointer();
+        case 17: return mem.get_program_counter();
+        case 18: return mem.get_stack_pointer();
+        case 19: return mem.get_delay_timer();
+        default: return mem.get_sound_timer();
+    }
+}
+
+static void write_register(Memory &mem, int index, int value)
+{
+    if (index < 16)
+        mem.reg_write(index, value);
+    switch (index)
+    {
+        case 16: mem.set_address_pointer(value); break;
+        case 17: mem.set_program_counter(value); break;
+        case 18: mem.set_stack_pointer(value); break;
+        case 19: mem.set_delay_timer(value); break;
+        case 20: mem.set_sound_timer(value); break;
+    }
+}
+
+// Little endian, as GDB expects register contents
+static string encode_register(Memory &mem, int index)
+{
+    int value = read_register(mem, index);
+    string text = hex_byte(value);
+    if (register_size(index) == 2)
+        text += hex_byte(value >> 8);
+    return text;
+}
+
+
+/* Connections */
+
+GdbServer::GdbServer(Memory &mem, const string &address) : mem(mem)
+{
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        unix_path = address.substr(5);
+        sockaddr_un local {};
+        local.sun_family = AF_UNIX;
+        if (unix_path.size() >= sizeof local.sun_path)
+            return;
+        strcpy(local.sun_path, unix_path.c_str());
+        unlink(unix_path.c_str());
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener >= 0 && bind(listener, (sockaddr *) &local, sizeof local) != 0)
+        {
+            close(listener);
+            listener = -1;
+        }
+    }
+    else
+    {
+        // Loopback only, the protocol has no authentication
+        sockaddr_in local {};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        local.sin_port = htons(atoi(address.c_str()));
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (listener >= 0)
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse);
+        if (listener >= 0 && bind(listener, (sockaddr *) &local, sizeof local) != 0)
+        {
+            close(listener);
+            listener = -1;
+        }
+    }
+    if (listener >= 0 && listen(listener, 1) != 0)
+    {
+        close(listener);
+        listener = -1;
+    }
+    if (listener >= 0)
+        acceptor = thread(&GdbServer::accept_clients, this);
+}
+
+GdbServer::~GdbServer()
+{
+    stopping = true;
+    if (acceptor.joinable())
+        acceptor.join();
+    if (listener >= 0)
+        close(listener);
+    int fd = waiting.exchange(-1);
+    if (fd >= 0)
+        close(fd);
+    if (!unix_path.empty())
+        unlink(unix_path.c_str());
+}
+
+bool GdbServer::is_open() { return listener >= 0; }
+bool GdbServer::has_client() { return waiting.load(memory_order_acquire) >= 0; }
+
+void GdbServer::accept_clients()
+{
+    while (!stopping)
+    {
+        pollfd ready {listener, POLLIN, 0};
+        if (poll(&ready, 1, 100) <= 0)
+            continue;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof nodelay);
+
+        // One client at a time
+        int expected = -1;
+        if (!waiting.compare_exchange_strong(expected, fd, memory_order_release))
+            close(fd);
+    }
+}
+
+int GdbServer::read_byte()
+{
+    if (input_at == input.size())
+    {
+        char buffer[4096];
+        ssize_t length = recv(client, buffer, sizeof buffer, 0);
+        if (length <= 0)
+            return -1;
+        input.assign(buffer, length);
+        input_at = 0;
+    }
+    return (unsigned char) input[input_at++];
+}
+
+// Ctrl-C from the client while the machine runs
+bool GdbServer::interrupted()
+{
+    pollfd ready {client, POLLIN, 0};
+    while (poll(&ready, 1, 0) > 0)
+    {
+        char buffer[256];
+        ssize_t length = recv(client, buffer, sizeof buffer, 0);
+        if (length <= 0)
+            return true;
+        input.append(buffer, length);
+    }
+    size_t at = input.find('\x03', input_at);
+    if (at == string::npos)
+        return false;
+    input.erase(at, 1);
+    return true;
+}
+
+// Next $data#checksum packet, acknowledged, false once the client is gone
+bool GdbServer::read_packet(string &packet)
+{
+    // Drop what the last packet parsed, once rather than byte by byte
+    input.erase(0, input_at);
+    input_at = 0;
+    for (;;)
+    {
+        int c;
+        do
+            c = read_byte();
+        while (c >= 0 && c != '$');
+        if (c < 0)
+            return false;
+
+        packet.clear();
+        uint8_t sum = 0;
+        while ((c = read_byte()) >= 0 && c != '#')
+        {
+            packet += (char) c;
+            sum += c;
+        }
+        int high = read_byte(), low = read_byte();
+        if (c < 0 || low < 0)
+            return false;
+
+        bool valid = hex_digit(high) >= 0 && hex_digit(low) >= 0 && (hex_digit(high) << 4 | hex_digit(low)) == sum;
+        if (acks)
+            send(client, valid ? "+" : "-", 1, MSG_NOSIGNAL);
+        if (valid || !acks)
+            return true;
+    }
+}
+
+void GdbServer::send_packet(const string &data)
+{
+    uint8_t sum = 0;
+    for (char c : data)
+        sum += c;
+    string packet = "$" + data + "#" + hex_byte(sum);
+    for (;;)
+    {
+        send(client, packet.data(), packet.size(), MSG_NOSIGNAL);
+        if (!acks)
+            return;
+        int c;
+        do
+            c = read_byte();
+        while (c >= 0 && c != '+' && c != '-');
+        if (c != '-')
+            return;
+    }
+}
+
+
+/* Sessions */
+
+bool GdbServer::serve(int instructions_per_frame)
+{
+    client = waiting.exchange(-1, memory_order_acquire);
+    if (client < 0)
+        return false;
+    input.clear();
+    input_at = 0;
+    acks = true;
+
+    Debugger debugger(mem, instructions_per_frame);
+    bool done = false;
+    string packet;
+    while (!done && read_packet(packet))
+    {
+        string reply = handle(packet, debugger, done);
+        if (packet != "k")
+            send_packet(reply);
+        if (packet == "QStartNoAckMode")
+            acks = false;
+    }
+    close(client);
+    client = -1;
+    return true;
+}
+
+// Stop reply for a halted machine: exited for 00FD, SIGILL for invalid
+// instructions, SIGSEGV for the stack
+static string halt_reply(Fault fault)
+{
+    switch (fault)
+    {
+        case Fault::Exit: return "W00";
+        case Fault::InvalidOpcode: return "S04";
+        default: return "S0b";
+    }
+}
+
+// Run until a stop, at 60 frames a second so the program behaves as it
+// does undebugged, and report why it stopped
+string GdbServer::resume(Debugger &debugger, bool single_step)
+{
+    RunResult result;
+    if (single_step)
+        result = debugger.step();
+    else
+    {
+        const auto frame_time = chrono::nanoseconds(1000000000 / 60);
+        auto deadline = chrono::steady_clock::now();
+        do
+        {
+            if (interrupted())
+                return "S02";
+            result = debugger.run(UINT64_MAX, 1);
+            deadline += frame_time;
+            this_thread::sleep_until(deadline);
+        }
+        while (result.reason == StopReason::Frames);
+    }
+
+    if (result.reason == StopReason::Halted)
+        return halt_reply(mem.get_halt().fault);
+    char reply[32] = "S05";
+    if (result.reason == StopReason::Watchpoint)
+        snprintf(reply, sizeof reply, "T05watch:%x;", result.address);
+    return reply;
+}
+
+string GdbServer::handle(const string &packet, Debugger &debugger, bool &done)
+{
+    if (packet.empty())
+        return "";
+    string arguments = packet.substr(1);
+    long numbers[3];
+    switch (packet[0])
+    {
+        case '?':
+            return mem.is_halted() && mem.get_halt().fault != Fault::Exit ? halt_reply(mem.get_halt().fault) : "S05";
+
+        case 'g':
+        {
+            string registers;
+            for (int i = 0; i < register_count; i++)
+                registers += encode_register(mem, i);
+            return registers;
+        }
+        case 'G':
+        {
+            vector<uint8_t> bytes;
+            if (!parse_bytes(arguments, bytes) || bytes.size() != (size_t) register_count + 2)
+                return "E01";
+            size_t at = 0;
+            for (int i = 0; i < register_count; i++)
+            {
+                int value = bytes[at++];
+                if (register_size(i) == 2)
+                    value |= bytes[at++] << 8;
+                write_register(mem, i, value);
+            }
+            return "OK";
+        }
+        case 'p':
+        {
+            long index = strtol(arguments.c_str(), nullptr, 16);
+            return index >= 0 && index < register_count ? encode_register(mem, index) : "E01";
+        }
+        case 'P':
+        {
+            size_t equals = arguments.find('=');
+            vector<uint8_t> bytes;
+            if (equals == string::npos || !parse_bytes(arguments.substr(equals + 1), bytes))
+                return "E01";
+            long index = strtol(arguments.c_str(), nullptr, 16);
+            if (index < 0 || index >= register_count || bytes.size() != (size_t) register_size(index))
+                return "E01";
+            write_register(mem, index, bytes[0] | (bytes.size() == 2 ? bytes[1] << 8 : 0));
+            return "OK";
+        }
+
+        case 'm':
+        {
+            if (!parse_numbers(arguments, numbers, 2) || numbers[1] < 0 || numbers[1] > 0x1000)
+                return "E01";
+            string data;
+            for (long i = 0; i < numbers[1]; i++)
+                data += hex_byte(mem.mem_read(numbers[0] + i));
+            return data;
+        }
+        case 'M':
+        {
+            size_t colon = arguments.find(':');
+            vector<uint8_t> bytes;
+            if (colon == string::npos || !parse_numbers(arguments.substr(0, colon), numbers, 2)
+                || !parse_bytes(arguments.substr(colon + 1), bytes) || bytes.size() != (size_t) numbers[1])
+                return "E01";
+            mem.mem_write_block(numbers[0], bytes.data(), bytes.size());
+            debugger.invalidate(numbers[0], bytes.size());
+            return "OK";
+        }
+
+        case 'c':
+        case 's':
+            // Continuing somewhere else gets a halted machine going again
+            if (!arguments.empty())
+            {
+                mem.set_program_counter(strtol(arguments.c_str(), nullptr, 16));
+                mem.resume();
+            }
+            return resume(debugger, packet[0] == 's');
+
+        case 'Z':
+        case 'z':
+        {
+            // Software and hardware breakpoints are the same thing here
+            if (!parse_numbers(arguments, numbers, 3))
+                return "E01";
+            bool insert = packet[0] == 'Z';
+            if (numbers[0] == 0 || numbers[0] == 1)
+            {
+                if (insert)
+                    debugger.add_breakpoint(numbers[1]);
+                else
+                    debugger.remove_breakpoint(numbers[1]);
+                return "OK";
+            }
+            if (numbers[0] == 2)
+            {
+                if (insert)
+                    debugger.add_watchpoint(numbers[1], numbers[2]);
+                else
+                    debugger.remove_watchpoint(numbers[1], numbers[2]);
+                return "OK";
+            }
+            return "";
+        }
+
+        case 'q':
+            if (packet.compare(0, 10, "qSupported") == 0)
+                return "PacketSize=4000;qXfer:features:read+;QStartNoAckMode+";
+            if (packet == "qAttached")
+                return "1";
+            if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0)
+            {
+                if (!parse_numbers(packet.substr(31), numbers, 2))
+                    return "E01";
+                size_t size = sizeof target_xml - 1;
+                size_t offset = min<size_t>(numbers[0], size);
+                size_t length = min<size_t>(numbers[1], size - offset);
+                return (offset + length < size ? "m" : "l") + string(target_xml + offset, length);
+            }
+            return "";
+        case 'Q':
+            return packet == "QStartNoAckMode" ? "OK" : "";
+        case 'H':
+            return "OK";
+
+        case 'D':
+            // The machine carries on without the debugger
+            done = true;
+            return "OK";
+        case 'k':
+            done = true;
+            return "";
+    }
+    return "";
+}
@@ -0,0 +1,63 @@
+#ifndef GDB_SERVER_H
+#define GDB_SERVER_H
+#include "Debugger.h"
+#include "Memory.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+// GDB remote serial protocol stub for one machine. Listens on a local TCP
+// port ("1234") or a Unix socket ("unix:/path") from a background thread
+// that only accepts connections; the machine's own thread picks a waiting
+// client up with serve(), which is one atomic load when nobody is there.
+// While a client is attached the machine runs under a Debugger, so the
+// interpreter is untouched otherwise.
+//
+// Registers, in target.xml order:
+//   0-15  V0-VF  8 bits
+//   16    I      16 bits
+//   17    PC     16 bits
+//   18    SP     8 bits (stack depth)
+//   19    DT     8 bits
+//   20    ST     8 bits
+// Supports ?, g/G, p/P, m/M, c, s, Z0/Z1/Z2 and their z, D, k, Ctrl-C,
+// qSupported, qXfer:features:read and QStartNoAckMode. A machine that
+// halts stops with SIGILL (invalid instruction) or SIGSEGV (stack), or
+// exits for 00FD.
+class GdbServer
+{
+public:
+    GdbServer(Memory &mem, const std::string &address);
+    ~GdbServer();
+    bool is_open();
+
+    // A client is waiting for serve()
+    bool has_client();
+
+    // Debug the waiting client's session to its end (detach, kill or
+    // disconnect), running frames of instructions_per_frame instructions
+    // whenever it lets the machine go. False if nobody was waiting.
+    bool serve(int instructions_per_frame = 10);
+
+private:
+    void accept_clients();
+    int read_byte();
+    bool interrupted();
+    bool read_packet(std::string &packet);
+    void send_packet(const std::string &data);
+    std::string handle(const std::string &packet, Debugger &debugger, bool &done);
+    std::string resume(Debugger &debugger, bool single_step);
+
+    Memory &mem;
+    std::string unix_path;
+    int listener = -1;
+    int client = -1;
+    std::string input;       // Received, parsed up to input_at
+    size_t input_at = 0;
+    bool acks = true;
+    std::atomic<int> waiting {-1};
+    std::atomic<bool> stopping {false};
+    std::thread acceptor;
+};
+
+#endif
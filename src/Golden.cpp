@@ -0,0 +1,102 @@
+#include "Golden.h"
+#include "Cpu.h"
+#include <cstdlib>
+#include <sstream>
+#include <string>
+using namespace std;
+
+bool read_golden_trace(istream &in, GoldenTrace &trace)
+{
+    trace = GoldenTrace();
+    string line;
+    while (getline(in, line))
+    {
+        istringstream fields(line.substr(0, line.find('#')));
+        string first;
+        if (!(fields >> first))
+            continue;
+
+        if (first == "ipf")
+        {
+            if (!(fields >> trace.instructions_per_frame) || trace.instructions_per_frame <= 0)
+                return false;
+        }
+        else if (first == "seed")
+        {
+            if (!(fields >> trace.seed))
+                return false;
+        }
+        else
+        {
+            GoldenCheck check;
+            string hash;
+            char *end;
+            check.cycle = strtoull(first.c_str(), &end, 10);
+            if (*end || !(fields >> hash))
+                return false;
+            check.hash = strtoull(hash.c_str(), &end, 16);
+            if (*end)
+                return false;
+            if (!trace.checks.empty() && check.cycle < trace.checks.back().cycle)
+                return false;
+            trace.checks.push_back(check);
+        }
+    }
+    return true;
+}
+
+void write_golden_trace(ostream &out, const GoldenTrace &trace)
+{
+    out << "ipf " << trace.instructions_per_frame << "\n";
+    out << "seed " << trace.seed << "\n";
+    for (auto &check : trace.checks)
+    {
+        ostringstream hash;
+        hash << hex << check.hash;
+        out << check.cycle << " 0x" << hash.str() << "\n";
+    }
+}
+
+// Step until the cycle count is reached (or the machine halts), ticking
+// the timers once a frame
+static void run_to(Memory &mem, uint64_t cycle, int instructions_per_frame)
+{
+    while (mem.get_cycle_count() < cycle && !mem.is_halted())
+    {
+        step(mem);
+        if (mem.get_cycle_count() % instructions_per_frame == 0)
+            mem.tick_timers();
+    }
+}
+
+void record_golden_trace(Memory &mem, GoldenTrace &trace)
+{
+    mem.set_random_seed(trace.seed);
+    for (size_t i = 0; i < trace.checks.size(); i++)
+    {
+        run_to(mem, trace.checks[i].cycle, trace.instructions_per_frame);
+        if (mem.get_cycle_count() < trace.checks[i].cycle)
+        {
+            trace.checks.resize(i);
+            return;
+        }
+        trace.checks[i].hash = mem.get_screen_hash();
+    }
+}
+
+int verify_golden_trace(Memory &mem, const GoldenTrace &trace, uint64_t *actual_hash)
+{
+    mem.set_random_seed(trace.seed);
+    for (size_t i = 0; i < trace.checks.size(); i++)
+    {
+        run_to(mem, trace.checks[i].cycle, trace.instructions_per_frame);
+        // Halting short of the check fails it, whatever is on screen
+        if (mem.get_cycle_count() < trace.checks[i].cycle || mem.get_screen_hash() != trace.checks[i].hash)
+        {
+            if (actual_hash)
+                *actual_hash = mem.get_screen_hash();
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,42 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+#include "Memory.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Golden trace file, expected screen hashes at given cycle counts:
+//
+//   # comments and blank lines are ignored
+//   ipf 10                      instructions per 60 Hz timer tick
+//   seed 1                      random seed for CXKK
+//   1000 0x3c5f09a2b3d6e1f0     screen hash after 1000 instructions
+//   ...                         (cycles in increasing order)
+//
+struct GoldenCheck
+{
+    uint64_t cycle;
+    uint64_t hash;
+};
+
+struct GoldenTrace
+{
+    int instructions_per_frame = 10;
+    uint64_t seed = 1;
+    std::vector<GoldenCheck> checks;
+};
+
+bool read_golden_trace(std::istream &in, GoldenTrace &trace);
+void write_golden_trace(std::ostream &out, const GoldenTrace &trace);
+
+// Run a machine with a ROM loaded, filling in the hash at each check.
+// Checks the machine halts before are dropped.
+void record_golden_trace(Memory &mem, GoldenTrace &trace);
+
+// Run a machine and compare hashes, returns the index of the first
+// failing check or -1 if they all match. A check the machine halts
+// before fails.
+int verify_golden_trace(Memory &mem, const GoldenTrace &trace, uint64_t *actual_hash = nullptr);
+
+#endif
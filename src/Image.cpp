@@ -0,0 +1,287 @@
+#include "Image.h"
+#include <algorithm>
+#include <unordered_map>
+using namespace std;
+
+// Pixel at (x, y) of a packed 1-bit plane
+static int pixel(const vector<uint8_t> &plane, int width, int x, int y)
+{
+    return (plane[y * (width / 8) + x / 8] >> (7 - x % 8)) & 1;
+}
+
+uint64_t double_pixels(uint32_t bits)
+{
+    uint64_t doubled = 0;
+    for (int i = 0; i < 32; i++)
+        if (bits >> i & 1)
+            doubled |= 3ull << (2 * i);
+    return doubled;
+}
+
+uint32_t halve_pixels(uint64_t bits)
+{
+    uint32_t halved = 0;
+    for (int i = 0; i < 32; i++)
+        halved |= (bits >> (2 * i + 1) & 1) << i;
+    return halved;
+}
+
+static void put_u32_be(vector<uint8_t> &buf, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        buf.push_back(value >> shift);
+}
+
+static void put_u16_le(ostream &out, int value)
+{
+    out.put(value & 0xFF);
+    out.put((value >> 8) & 0xFF);
+}
+
+
+/* PNG */
+
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    static bool table_ready = false;
+    if (!table_ready)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        table_ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void write_chunk(ostream &out, const char *type, const vector<uint8_t> &data)
+{
+    vector<uint8_t> chunk(type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+
+    vector<uint8_t> header;
+    put_u32_be(header, data.size());
+    put_u32_be(chunk, crc32(chunk.data(), chunk.size()));
+    out.write((const char *) header.data(), header.size());
+    out.write((const char *) chunk.data(), chunk.size());
+}
+
+void write_ppm(const vector<uint8_t> &plane, int width, int height,
+               ostream &out, int scale)
+{
+    int out_width = width * scale;
+    int out_height = height * scale;
+    out << "P6\n" << out_width << " " << out_height << "\n255\n";
+
+    // Three bytes a pixel, white or black
+    vector<uint8_t> row(3 * out_width);
+    for (int y = 0; y < out_height; y++)
+    {
+        for (int x = 0; x < out_width; x++)
+            row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = pixel(plane, width, x / scale, y / scale) ? 0xFF : 0;
+        out.write((const char *) row.data(), row.size());
+    }
+}
+
+void write_png(const vector<uint8_t> &plane, int width, int height,
+               ostream &out, int scale)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.write((const char *) signature, 8);
+
+    int out_width = width * scale;
+    int out_height = height * scale;
+
+    // 1-bit greyscale
+    vector<uint8_t> ihdr;
+    put_u32_be(ihdr, out_width);
+    put_u32_be(ihdr, out_height);
+    ihdr.insert(ihdr.end(), {1, 0, 0, 0, 0});
+    write_chunk(out, "IHDR", ihdr);
+
+    // Scanlines, each prefixed with filter type 0
+    int stride = (out_width + 7) / 8;
+    vector<uint8_t> raw;
+    raw.reserve(out_height * (stride + 1));
+    for (int y = 0; y < out_height; y++)
+    {
+        raw.push_back(0);
+        size_t start = raw.size();
+        raw.resize(start + stride, 0);
+        for (int x = 0; x < out_width; x++)
+            if (pixel(plane, width, x / scale, y / scale))
+                raw[start + x / 8] |= 0x80 >> (x % 8);
+    }
+
+    // zlib stream made of stored deflate blocks, the images are tiny
+    vector<uint8_t> idat = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    size_t pos = 0;
+    do
+    {
+        size_t len = min<size_t>(raw.size() - pos, 0xFFFF);
+        bool last = pos + len == raw.size();
+        idat.push_back(last);
+        idat.push_back(len & 0xFF);
+        idat.push_back(len >> 8);
+        idat.push_back(~len & 0xFF);
+        idat.push_back((~len >> 8) & 0xFF);
+        idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+    } while (pos < raw.size());
+    put_u32_be(idat, b << 16 | a);
+    write_chunk(out, "IDAT", idat);
+
+    write_chunk(out, "IEND", {});
+}
+
+
+/* GIF */
+
+GifWriter::GifWriter(ostream &out, int width, int height, int scale)
+    : out(out), width(width), height(height), scale(scale)
+{
+    out.write("GIF89a", 6);
+    put_u16_le(out, width * scale);
+    put_u16_le(out, height * scale);
+
+    // Two entry global palette: black, white
+    out.put((char) 0x80);
+    out.put(0);
+    out.put(0);
+    static const char palette[6] = {0, 0, 0, (char) 0xFF, (char) 0xFF, (char) 0xFF};
+    out.write(palette, 6);
+
+    // Loop forever
+    static const char loop[19] = {
+        0x21, (char) 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E',
+        '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00,
+    };
+    out.write(loop, 19);
+}
+
+GifWriter::~GifWriter() { finish(); }
+
+void GifWriter::add_frame(const vector<uint8_t> &plane, int delay)
+{
+    if (!pending.empty() && plane == pending)
+    {
+        pending_delay += delay;
+        return;
+    }
+    write_frame();
+    pending = plane;
+    pending_delay = delay;
+}
+
+void GifWriter::finish()
+{
+    if (finished)
+        return;
+    write_frame();
+    out.put(0x3B);
+    out.flush();
+    finished = true;
+}
+
+void GifWriter::write_frame()
+{
+    if (pending.empty())
+        return;
+
+    // Graphic control extension with the frame delay
+    out.put(0x21);
+    out.put((char) 0xF9);
+    out.put(4);
+    out.put(0);
+    put_u16_le(out, min(pending_delay, 0xFFFF));
+    out.put(0);
+    out.put(0);
+
+    // Full frame image descriptor
+    out.put(0x2C);
+    put_u16_le(out, 0);
+    put_u16_le(out, 0);
+    put_u16_le(out, width * scale);
+    put_u16_le(out, height * scale);
+    out.put(0);
+
+    // LZW compress the palette indices
+    const int min_code_size = 2;
+    const int clear_code = 1 << min_code_size;
+    int code_size = min_code_size + 1;
+    int next_code = clear_code + 2;
+    unordered_map<int, int> dictionary;
+
+    vector<uint8_t> data;
+    uint32_t bit_buffer = 0;
+    int bit_count = 0;
+    auto emit = [&](int code) {
+        bit_buffer |= code << bit_count;
+        bit_count += code_size;
+        while (bit_count >= 8)
+        {
+            data.push_back(bit_buffer & 0xFF);
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    };
+
+    emit(clear_code);
+    int prefix = -1;
+    for (int y = 0; y < height * scale; y++)
+        for (int x = 0; x < width * scale; x++)
+        {
+            int index = pixel(pending, width, x / scale, y / scale);
+            if (prefix < 0)
+            {
+                prefix = index;
+                continue;
+            }
+            auto found = dictionary.find(prefix << 8 | index);
+            if (found != dictionary.end())
+            {
+                prefix = found->second;
+                continue;
+            }
+            emit(prefix);
+            int added = next_code++;
+            dictionary[prefix << 8 | index] = added;
+            if (added >= 1 << code_size)
+                code_size++;
+            if (added == 4095)
+            {
+                emit(clear_code);
+                dictionary.clear();
+                code_size = min_code_size + 1;
+                next_code = clear_code + 2;
+            }
+            prefix = index;
+        }
+    emit(prefix);
+    emit(clear_code + 1);
+    if (bit_count > 0)
+        data.push_back(bit_buffer & 0xFF);
+
+    out.put(min_code_size);
+    for (size_t pos = 0; pos < data.size(); pos += 255)
+    {
+        size_t len = min<size_t>(data.size() - pos, 255);
+        out.put(len);
+        out.write((const char *) data.data() + pos, len);
+    }
+    out.put(0);
+}
@@ -0,0 +1,48 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// 1-bit images are stored row-major, 8 pixels per byte, most significant
+// bit first (the layout of a packed screen row), lit pixels are white.
+
+// Scale packed pixels between resolutions: each low resolution pixel
+// doubled horizontally, or every other high resolution pixel
+uint64_t double_pixels(uint32_t bits);
+uint32_t halve_pixels(uint64_t bits);
+
+// Write a single frame as a PNG, each pixel scaled to scale x scale
+void write_png(const std::vector<uint8_t> &plane, int width, int height,
+               std::ostream &out, int scale = 1);
+
+// Write a single frame as a binary PPM (P6) image
+void write_ppm(const std::vector<uint8_t> &plane, int width, int height,
+               std::ostream &out, int scale = 1);
+
+// Animated GIF built one frame at a time, repeated frames are folded
+// into the previous frame's delay
+class GifWriter
+{
+public:
+    GifWriter(std::ostream &out, int width, int height, int scale = 1);
+    ~GifWriter();
+
+    // Add a frame shown for delay hundredths of a second
+    void add_frame(const std::vector<uint8_t> &plane, int delay = 2);
+    void finish();
+
+private:
+    void write_frame();
+
+    std::ostream &out;
+    int width;
+    int height;
+    int scale;
+    bool finished = false;
+
+    std::vector<uint8_t> pending;
+    int pending_delay = 0;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Host keyboard layout for the 16-key hex keypad
+//
+//   1 2 3 C        1 2 3 4
+//   4 5 6 D   <-   Q W E R
+//   7 8 9 E        A S D F
+//   A 0 B F        Z X C V
+//
+constexpr std::array<int8_t, 256> make_key_table()
+{
+    std::array<int8_t, 256> table {};
+    for (auto &entry : table)
+        entry = -1;
+
+    const char layout[] = "1234QWERASDFZXCV";
+    const int8_t keys[] = {
+        0x1, 0x2, 0x3, 0xC,
+        0x4, 0x5, 0x6, 0xD,
+        0x7, 0x8, 0x9, 0xE,
+        0xA, 0x0, 0xB, 0xF,
+    };
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned char c = layout[i];
+        table[c] = keys[i];
+        // Accept lower case letters as well
+        if ('A' <= c && c <= 'Z')
+            table[c - 'A' + 'a'] = keys[i];
+    }
+    return table;
+}
+
+// Char -> CHIP-8 key lookup, -1 for characters that aren't mapped
+inline constexpr std::array<int8_t, 256> key_table = make_key_table();
+
+constexpr int key_for_char(char c) { return key_table[(unsigned char) c]; }
+
+// Keypad state as a 16-bit mask (bit n set = key n held down).
+// Input threads publish with a single atomic store or read-modify-write,
+// the CPU loop reads the whole pad with a single load.
+class Keypad
+{
+public:
+    Keypad() = default;
+    Keypad(const Keypad &other) : state(other.get_keys()) {}
+    Keypad &operator=(const Keypad &other)
+    {
+        set_keys(other.get_keys());
+        return *this;
+    }
+
+    uint16_t get_keys() const { return state.load(std::memory_order_acquire); }
+    void set_keys(uint16_t keys) { state.store(keys, std::memory_order_release); }
+
+    bool get_key(int key) const { return (get_keys() >> (key & 0xF)) & 1; }
+    void set_key(int key, bool pressed)
+    {
+        uint16_t bit = 1 << (key & 0xF);
+        if (pressed)
+            state.fetch_or(bit, std::memory_order_acq_rel);
+        else
+            state.fetch_and(~bit, std::memory_order_acq_rel);
+    }
+    void flip_key(int key) { state.fetch_xor(1 << (key & 0xF), std::memory_order_acq_rel); }
+
+private:
+    std::atomic<uint16_t> state {0};
+};
+
+#endif
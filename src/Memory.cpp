@@ -1,6 +1,9 @@
 #include "Memory.h"
+#include "FrameExchange.h"
 #include <algorithm>
-#include <unordered_map>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 using namespace std;
 
 // Font set
@@ -23,26 +26,139 @@ int font_set[80] {
 0xF0, 0x80, 0xF0, 0x80, 0x80, // F (75)
 };
 
+// SUPER-CHIP large font, 8x10 digits
+int large_font_set[160] {
+0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0 (Starts at 0xA0)
+0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1 (0xAA)
+0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2 (0xB4)
+0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3 (0xBE)
+0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4 (0xC8)
+0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5 (0xD2)
+0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6 (0xDC)
+0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7 (0xE6)
+0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8 (0xF0)
+0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9 (0xFA)
+0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A (0x104)
+0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B (0x10E)
+0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C (0x118)
+0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D (0x122)
+0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E (0x12C)
+0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F (0x136)
+};
+
+// 64-bit finalizer (splitmix64), for the hashes
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Contribution of a value at a location to the state hash (Zobrist style,
+// the key for each location and value is mixed up on the fly). Zero for 0,
+// so zeroed state costs nothing to hash. RAM addresses are locations 0 to
+// 0xFFFF, the rest of the machine comes after.
+static const int register_location = 0x10000;
+static const int stack_location = 0x10010;
+static const int rpl_location = 0x10020;
+static const int audio_location = 0x10030;
+static const int program_counter_location = 0x10040;
+static const int address_pointer_location = 0x10041;
+static const int stack_pointer_location = 0x10042;
+static const int delay_timer_location = 0x10043;
+static const int sound_timer_location = 0x10044;
+static const int random_location = 0x10045;
+static const int mode_location = 0x10046;
+static const int pitch_location = 0x10047;
+static uint64_t value_hash(int location, uint64_t value)
+{
+    return value ? mix((uint64_t) location << 32 ^ value ^ 0x9E3779B97F4A7C15ull) : 0;
+}
+
+// Stack entries below the stack pointer, the ones the hash covers
+static int live_entries(int stack_pointer) { return max(0, min(stack_pointer, 16)); }
+
 // Constructor
-Memory::Memory() 
+Memory::Memory(int mem_size) : mem_size(mem_size), memory(mem_size)
+{
+    state_hash = hash_scalars();
+    for (int i = 0; i < 80; i++)
+        mem_write(i, font_set[i]);
+    for (int i = 0; i < 160; i++)
+        mem_write(large_font_start + i, large_font_set[i]);
+}
+
+// ROM loading
+bool Memory::load_rom(const vector<uint8_t> &rom)
+{
+    if (rom.size() > (size_t) (mem_size - 0x200))
+        return false;
+    mem_write_block(0x200, rom.data(), rom.size());
+    return true;
+}
+bool Memory::load_rom(const string &path)
 {
-    copy(font_set, font_set + 80, memory); 
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    return load_rom(rom);
 }
 
 // Main memory access
-int Memory::mem_read(int address) { return memory[address]; }
-void Memory::mem_write(int address, int value) { memory[address] = value; }
+int Memory::mem_read(int address) { return memory.read(address & (mem_size - 1)); }
+void Memory::mem_write(int address, int value)
+{
+    address &= mem_size - 1;
+    hash_change(address, memory.read(address), value & 0xFF);
+    memory.write(address, value);
+}
+void Memory::mem_read_block(int address, uint8_t *data, int length)
+{
+    for (int i = 0; i < length; i++)
+        data[i] = memory.read((address + i) & (mem_size - 1));
+}
+void Memory::mem_write_block(int address, const uint8_t *data, int length)
+{
+    // A page at a time: unshare it once, hash the bytes changing, copy the span
+    address &= mem_size - 1;
+    while (length > 0)
+    {
+        int offset = address % RamPages::page_size;
+        int span = min({length, RamPages::page_size - offset, mem_size - address});
+        uint8_t *bytes = memory.writable_page(address) + offset;
+        uint64_t hash = 0;
+        for (int i = 0; i < span; i++)
+            if (bytes[i] != data[i])
+                hash ^= value_hash(address + i, bytes[i]) ^ value_hash(address + i, data[i]);
+        state_hash ^= hash;
+        memcpy(bytes, data, span);
+        address = (address + span) & (mem_size - 1);
+        data += span;
+        length -= span;
+    }
+}
+int Memory::private_ram_pages() { return memory.private_pages(); }
 
 // Register access
 int Memory::reg_read(int address) { return registers[address]; }
-void Memory::reg_write(int address, int value) { registers[address] = value; }
+void Memory::reg_write(int address, int value)
+{
+    hash_change(register_location + address, registers[address], value);
+    registers[address] = value;
+}
 
 // Stack access
 int Memory::stack_pop()
 {
-    stack_pointer--;
-    if (0 <= stack_pointer && stack_pointer <= 15) 
-        return stack[stack_pointer];
+    if (1 <= stack_pointer && stack_pointer <= 16)
+    {
+        int address = stack[stack_pointer - 1];
+        set_stack_pointer(stack_pointer - 1);
+        return address;
+    }
     else
         return -1;
 }
@@ -58,28 +174,323 @@ void Memory::stack_push(int address)
     if (0 <= stack_pointer && stack_pointer <= 15)
     {
         stack[stack_pointer] = address;
-        stack_pointer++;
+        set_stack_pointer(stack_pointer + 1);
     }
 }
 
+int Memory::get_stack_pointer() { return stack_pointer; }
+void Memory::set_stack_pointer(int pointer)
+{
+    // Entries coming into or going out of use
+    int before = live_entries(stack_pointer);
+    int after = live_entries(pointer);
+    for (int i = min(before, after); i < max(before, after); i++)
+        state_hash ^= value_hash(stack_location + i, stack[i]);
+    hash_change(stack_pointer_location, stack_pointer, pointer);
+    stack_pointer = pointer;
+}
+
 // Screen memory access
-int Memory::screen_read(int address) { return screen[address]; }
-void Memory::screen_write(int address, int value) { screen[address] = value; }
+int Memory::screen_read(int address) 
+{ 
+    int x = address % screen_width;
+    int y = address / screen_width;
+    int shift = 63 - x % 64;
+    return (screen_row(y, x / 64, 0) >> shift & 1) | (screen_row(y, x / 64, 1) >> shift & 1) << 1; 
+}
+void Memory::screen_write(int address, int value) 
+{ 
+    int x = address % screen_width;
+    int y = address / screen_width;
+    uint64_t bit = 1ull << (63 - x % 64);
+    for (int plane = 0; plane < 2; plane++)
+    {
+        uint64_t row = screen_row(y, x / 64, plane);
+        screen_xor_row(y, x / 64, (value >> plane & 1 ? row | bit : row & ~bit) ^ row, plane);
+    }
+}
+uint64_t Memory::screen_row(int row, int word, int plane) { return screen[plane][2 * row + word]; }
+
+bool Memory::is_hires() { return screen_width == 128; }
+void Memory::set_hires(bool hires)
+{
+    // Switching resolution starts from a blank screen
+    int selected = planes;
+    planes = 3;
+    screen_clear();
+    planes = selected;
+
+    int before = screen_mode();
+    screen_width = hires ? 128 : 64;
+    screen_height = hires ? 64 : 32;
+    screen_size = screen_width * screen_height;
+    hash_change(mode_location, before, screen_mode());
+}
+
+int Memory::get_planes() { return planes; }
+void Memory::set_planes(int planes)
+{
+    int before = screen_mode();
+    this->planes = planes & 3;
+    planes_used |= this->planes;
+    hash_change(mode_location, before, screen_mode());
+}
+int Memory::get_planes_used() { return planes_used; }
+
+// Word contribution to the screen hash, zero for a blank word so a blank
+// screen hashes to 0
+static uint64_t word_hash(int index, uint64_t bits)
+{
+    uint64_t key = mix((index + 1) * 0x9E3779B97F4A7C15ull);
+    return mix(bits ^ key) ^ mix(key);
+}
+
+// XOR bits into a row word, returns whether any pixel changed
+bool Memory::screen_xor_row(int row, int word, uint64_t bits, int plane)
+{
+    if (!bits)
+        return false;
+    int index = 2 * row + word;
+    uint64_t &target = screen[plane][index];
+    screen_hash ^= word_hash(128 * plane + index, target);
+    target ^= bits;
+    screen_hash ^= word_hash(128 * plane + index, target);
+    dirty_rows |= 1ull << row;
+    dirty_columns[word] |= bits;
+    return true;
+}
+
+// Clearing and scrolling apply to the selected planes. Scrolling shifts
+// whole words; rows are walked so each source row is read before it's
+// overwritten.
+void Memory::screen_clear()
+{
+    for (int plane = 0; plane < 2; plane++)
+        if (planes >> plane & 1)
+            for (int row = 0; row < screen_height; row++)
+                for (int word = 0; word < screen_width / 64; word++)
+                    screen_xor_row(row, word, screen_row(row, word, plane), plane);
+}
+void Memory::screen_scroll_down(int rows)
+{
+    for (int plane = 0; plane < 2; plane++)
+        if (planes >> plane & 1)
+            for (int row = screen_height - 1; row >= 0; row--)
+                for (int word = 0; word < screen_width / 64; word++)
+                {
+                    uint64_t bits = row >= rows ? screen_row(row - rows, word, plane) : 0;
+                    screen_xor_row(row, word, screen_row(row, word, plane) ^ bits, plane);
+                }
+}
+void Memory::screen_scroll_up(int rows)
+{
+    for (int plane = 0; plane < 2; plane++)
+        if (planes >> plane & 1)
+            for (int row = 0; row < screen_height; row++)
+                for (int word = 0; word < screen_width / 64; word++)
+                {
+                    uint64_t bits = row + rows < screen_height ? screen_row(row + rows, word, plane) : 0;
+                    screen_xor_row(row, word, screen_row(row, word, plane) ^ bits, plane);
+                }
+}
+void Memory::screen_scroll_right(int pixels)
+{
+    if (pixels == 0)
+        return;
+    for (int plane = 0; plane < 2; plane++)
+        if (planes >> plane & 1)
+            for (int row = 0; row < screen_height; row++)
+            {
+                uint64_t left = screen_row(row, 0, plane);
+                screen_xor_row(row, 0, left ^ (left >> pixels), plane);
+                if (is_hires())
+                {
+                    uint64_t right = screen_row(row, 1, plane);
+                    screen_xor_row(row, 1, right ^ (right >> pixels | left << (64 - pixels)), plane);
+                }
+            }
+}
+void Memory::screen_scroll_left(int pixels)
+{
+    if (pixels == 0)
+        return;
+    for (int plane = 0; plane < 2; plane++)
+        if (planes >> plane & 1)
+            for (int row = 0; row < screen_height; row++)
+            {
+                uint64_t left = screen_row(row, 0, plane);
+                uint64_t right = is_hires() ? screen_row(row, 1, plane) : 0;
+                screen_xor_row(row, 0, left ^ (left << pixels | right >> (64 - pixels)), plane);
+                if (is_hires())
+                    screen_xor_row(row, 1, right ^ (right << pixels), plane);
+            }
+}
+
+// Screen hash
+uint64_t Memory::get_screen_hash() { return screen_hash; }
+uint64_t Memory::compute_screen_hash()
+{
+    uint64_t hash = 0;
+    for (int plane = 0; plane < 2; plane++)
+        for (int index = 0; index < 128; index++)
+            hash ^= word_hash(128 * plane + index, screen[plane][index]);
+    return hash;
+}
+
+// State hash. The program counter changes every instruction, so rather
+// than keep it hashed it's folded in when the hash is read.
+uint64_t Memory::get_state_hash()
+{
+    return state_hash ^ screen_hash ^ value_hash(program_counter_location, program_counter);
+}
+uint64_t Memory::compute_state_hash()
+{
+    uint64_t hash = compute_screen_hash() ^ hash_scalars() ^ value_hash(program_counter_location, program_counter);
+    for (int address = 0; address < mem_size; address++)
+        hash ^= value_hash(address, memory.read(address));
+    for (int i = 0; i < 16; i++)
+        hash ^= value_hash(register_location + i, registers[i])
+            ^ value_hash(rpl_location + i, rpl_flags[i])
+            ^ value_hash(audio_location + i, audio_pattern[i]);
+    for (int i = 0; i < live_entries(stack_pointer); i++)
+        hash ^= value_hash(stack_location + i, stack[i]);
+    return hash;
+}
+uint64_t Memory::hash_scalars()
+{
+    return value_hash(address_pointer_location, address_pointer)
+        ^ value_hash(stack_pointer_location, stack_pointer)
+        ^ value_hash(delay_timer_location, delay_timer)
+        ^ value_hash(sound_timer_location, sound_timer)
+        ^ value_hash(random_location, random_state)
+        ^ value_hash(mode_location, screen_mode())
+        ^ value_hash(pitch_location, pitch);
+}
+void Memory::hash_change(int location, uint64_t before, uint64_t after)
+{
+    state_hash ^= value_hash(location, before) ^ value_hash(location, after);
+}
+int Memory::screen_mode() { return screen_width | planes << 8 | planes_used << 10; }
+
+// Dirty tracking
+uint64_t Memory::get_dirty_rows() { return dirty_rows; }
+uint64_t Memory::get_dirty_columns(int word) { return dirty_columns[word]; }
+void Memory::clear_dirty() 
+{ 
+    dirty_rows = 0;
+    dirty_columns[0] = 0;
+    dirty_columns[1] = 0;
+}
+
+// RPL flags
+int Memory::rpl_read(int flag) { return rpl_flags[flag]; }
+void Memory::rpl_write(int flag, int value)
+{
+    hash_change(rpl_location + flag, rpl_flags[flag], value);
+    rpl_flags[flag] = value;
+}
 
 // Pointer access
 int Memory::get_address_pointer() { return address_pointer; }
-void Memory::set_address_pointer(int address) { address_pointer = address; }
+void Memory::set_address_pointer(int address)
+{
+    hash_change(address_pointer_location, address_pointer, address);
+    address_pointer = address;
+}
 int Memory::get_program_counter() { return program_counter; }
 void Memory::inc_program_counter() { program_counter += 2; }
+
+// Skip the next instruction, which is 4 bytes long if it's F000 NNNN
+void Memory::skip_instruction() 
+{ 
+    bool long_instruction = mem_read(program_counter) == 0xF0 && mem_read(program_counter + 1) == 0x00;
+    program_counter += long_instruction ? 4 : 2; 
+}
 void Memory::set_program_counter(int address) { program_counter = address; }
 
+// XO-CHIP audio
+int Memory::audio_pattern_read(int index) { return audio_pattern[index]; }
+void Memory::audio_pattern_write(int index, int value)
+{
+    hash_change(audio_location + index, audio_pattern[index], value & 0xFF);
+    audio_pattern[index] = value;
+}
+int Memory::get_pitch() { return pitch; }
+void Memory::set_pitch(int pitch)
+{
+    hash_change(pitch_location, this->pitch, pitch);
+    this->pitch = pitch;
+}
+
 // Timer access
 int Memory::get_delay_timer() { return delay_timer; }
-void Memory::set_delay_timer(int cycles) { delay_timer = cycles; }
+void Memory::set_delay_timer(int cycles)
+{
+    hash_change(delay_timer_location, delay_timer, cycles);
+    delay_timer = cycles;
+}
 int Memory::get_sound_timer() { return sound_timer; }
-void Memory::set_sound_timer(int cycles) { sound_timer = cycles; }
+void Memory::set_sound_timer(int cycles)
+{
+    hash_change(sound_timer_location, sound_timer, cycles);
+    sound_timer = cycles;
+}
+void Memory::tick_timers()
+{
+    if (delay_timer > 0)
+        set_delay_timer(delay_timer - 1);
+    if (sound_timer > 0)
+        set_sound_timer(sound_timer - 1);
+    if (frame_publisher.publisher)
+        frame_publisher.publisher->publish(*this);
+}
+void Memory::set_frame_publisher(FramePublisher *publisher) { frame_publisher.publisher = publisher; }
+
+// Cycle counter
+uint64_t Memory::get_cycle_count() { return cycle_count; }
+void Memory::inc_cycle_count() { cycle_count++; }
+void Memory::add_cycle_count(uint64_t cycles) { cycle_count += cycles; }
+
+// Random numbers (xorshift64*)
+void Memory::set_random_seed(uint64_t seed)
+{
+    uint64_t state = seed ? seed : 1;
+    hash_change(random_location, random_state, state);
+    random_state = state;
+}
+int Memory::random_byte()
+{
+    uint64_t before = random_state;
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    hash_change(random_location, before, random_state);
+    return (random_state * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+// Halting
+void Memory::halt(Fault fault, int instruction)
+{
+    halt_state.fault = fault;
+    halt_state.pc = program_counter;
+    halt_state.instruction = instruction;
+}
+bool Memory::is_halted() { return halt_state.fault != Fault::None; }
+Halt Memory::get_halt() { return halt_state; }
+void Memory::resume() { halt_state = Halt(); }
+
+// Quirks profile
+QuirksProfile Memory::get_quirks() { return quirks; }
+void Memory::set_quirks(QuirksProfile quirks) { this->quirks = quirks; }
 
 // Keyboard access
-bool Memory::get_key(int key) { return keys[key]; }
-void Memory::set_key(int key, bool state) { keys[key] = state; }
-void Memory::flip_key(int key) { keys[key] = !keys[key]; }
\ No newline at end of file
+bool Memory::get_key(int key) { return keypad.get_key(key); }
+void Memory::set_key(int key, bool state) { keypad.set_key(key, state); }
+void Memory::flip_key(int key) { keypad.flip_key(key); }
+uint16_t Memory::get_keys() { return keypad.get_keys(); }
+void Memory::set_keys(uint16_t keys) { keypad.set_keys(keys); }
+
+// Raw storage
+uint8_t *Memory::ram_data() { return memory.flatten(); }
+int *Memory::register_data() { return registers; }
+uint64_t *Memory::screen_data() { return &screen[0][0]; }
\ No newline at end of file
@@ -1,17 +1,38 @@
 #ifndef MEMORY_H
 #define MEMORY_H
-#include <unordered_map>
+#include "Fault.h"
+#include "Keypad.h"
+#include "Quirks.h"
+#include "RamPages.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class FramePublisher;
 
 class Memory
 {
 public:
-    // Constructor
-    Memory();
+    // Constructor, mem_size is 4096 (CHIP-8, SUPER-CHIP) or 65536 (XO-CHIP)
+    explicit Memory(int mem_size = 4096);
+
+    // Where the 8x10 SUPER-CHIP digits live (the 4x5 font is at 0)
+    static const int large_font_start = 0xA0;
+
+    // Copy a program to 0x200, false if it doesn't fit
+    bool load_rom(const std::vector<uint8_t> &rom);
+    bool load_rom(const std::string &path);
 
-    // Main memory access
+    // Main memory access, addresses wrap at mem_size (a power of two)
     int mem_size = 4096;
     int mem_read(int address);
     void mem_write(int address, int value);
+    void mem_read_block(int address, uint8_t *data, int length);
+    void mem_write_block(int address, const uint8_t *data, int length);
+
+    // RAM is shared page by page with copies of the machine until written,
+    // this is how many 256-byte pages are this machine's alone
+    int private_ram_pages();
 
     // Register access
     int reg_read(int address);
@@ -21,37 +42,130 @@ public:
     int stack_pop();
     int stack_peek();
     void stack_push(int address);
+    int get_stack_pointer();
+    void set_stack_pointer(int pointer);
 
-    // Screen memory access
+    // Screen memory access, 64x32 or 128x64 (SUPER-CHIP high resolution).
+    // Pixels are 2-bit colors, bit n from bit plane n (XO-CHIP).
     int screen_size = 2048;
+    int screen_width = 64;
+    int screen_height = 32;
     int screen_read(int address);
     void screen_write(int address, int value);
+    bool is_hires();
+    void set_hires(bool hires);
+
+    // Bit planes that drawing, clearing and scrolling apply to (mask),
+    // and every plane ever selected
+    int get_planes();
+    void set_planes(int planes);
+    int get_planes_used();
+
+    // Packed rows, one word per 64 columns, bit 63 is the leftmost pixel
+    uint64_t screen_row(int row, int word = 0, int plane = 0);
+    bool screen_xor_row(int row, int word, uint64_t bits, int plane = 0);
+    void screen_clear();
+    void screen_scroll_down(int rows);
+    void screen_scroll_up(int rows);
+    void screen_scroll_right(int pixels);
+    void screen_scroll_left(int pixels);
+
+    // Changed screen area since the last clear_dirty()
+    uint64_t get_dirty_rows();
+    uint64_t get_dirty_columns(int word = 0);
+    void clear_dirty();
+
+    // 64-bit fingerprint of the screen, kept up to date on every change
+    uint64_t get_screen_hash();
+    uint64_t compute_screen_hash();
+
+    // 64-bit fingerprint of the whole machine: RAM, registers, pointers,
+    // stack, timers, random state and screen (not the keys, the cycle
+    // count or a halt). Every write keeps it up to date in O(1), so reading
+    // it costs nothing; compute_state_hash() works it out from scratch.
+    uint64_t get_state_hash();
+    uint64_t compute_state_hash();
 
     // ROM access 
     int get_program_counter();
     void inc_program_counter();
+    void skip_instruction();
     void set_program_counter(int address);
 
     // Address pointer access
     int get_address_pointer();
     void set_address_pointer(int address);
 
+    // SUPER-CHIP RPL user flags
+    int rpl_read(int flag);
+    void rpl_write(int flag, int value);
+
+    // XO-CHIP audio, a 128 bit sample pattern played at the pitch register
+    int audio_pattern_read(int index);
+    void audio_pattern_write(int index, int value);
+    int get_pitch();
+    void set_pitch(int pitch);
+
     // Timer access
     int get_delay_timer();
     void set_delay_timer(int cycles);
     int get_sound_timer();
     void set_sound_timer(int cycles);
+    void tick_timers();
+
+    // Where tick_timers() publishes the finished frame at each vblank
+    // (none by default). It belongs to this machine, not its state: a copy
+    // starts without one, and assigning another machine's state keeps it.
+    void set_frame_publisher(FramePublisher *publisher);
+
+    // Instructions executed
+    uint64_t get_cycle_count();
+    void inc_cycle_count();
+    void add_cycle_count(uint64_t cycles);
+
+    // Stopping the machine: halt() records why, at the current program
+    // counter, and the run loops stop until resume()
+    void halt(Fault fault, int instruction);
+    bool is_halted();
+    Halt get_halt();
+    void resume();
+
+    // Random number generator (deterministic for a given seed)
+    void set_random_seed(uint64_t seed);
+    int random_byte();
+
+    // Platform quirks the interpreter runs this machine with
+    QuirksProfile get_quirks();
+    void set_quirks(QuirksProfile quirks);
 
     // Keyboard access
     bool get_key(int key);
     void set_key(int key, bool state);
     void flip_key(int key);
+    uint16_t get_keys();
+    void set_keys(uint16_t keys);
+
+    // Underlying storage, for views that read or write the machine in
+    // place: mem_size bytes of RAM, the 16 registers, and the screen as
+    // 2 planes x 128 words laid out like screen_row(). Writing through
+    // these skips dirty tracking and the hashes. Pointers stay valid
+    // for the machine's lifetime, including across assignment from a copy
+    // of the same size. RAM stops sharing pages with copies once its
+    // storage has been asked for.
+    uint8_t *ram_data();
+    int *register_data();
+    uint64_t *screen_data();
 
 private:
     // Main Memory
-    int memory[4096] {0};
+    RamPages memory;
     int registers[16] {0};
-    int screen[2048] {0};
+    uint64_t screen[2][128] {};  // Per plane, 64 rows of two words, row n at 2 * n
+    int planes = 1;
+    int planes_used = 1;
+    int rpl_flags[16] {0};
+    uint8_t audio_pattern[16] {0};
+    int pitch = 64;
     int stack[16] {0};
 
     // Pointers
@@ -59,18 +173,36 @@ private:
     int address_pointer = 0;
     int stack_pointer = 0;
 
+    // Dirty tracking, bit n of rows = row n, of columns = bit n of a row word
+    uint64_t dirty_rows = 0;
+    uint64_t dirty_columns[2] {0};
+    uint64_t screen_hash = 0;
+
+    // State hash of everything but the screen and program counter
+    uint64_t state_hash = 0;
+    uint64_t hash_scalars();
+    void hash_change(int location, uint64_t before, uint64_t after);
+    int screen_mode();
+
     // Timers
     int delay_timer = -1;
     int sound_timer = -1;
 
-    // Keybooard Memory
-    int keys[16] {0};
-    std::unordered_map<char, int> key_mapping = {
-        {'1', 0x1}, {'2', 0x2}, {'3', 0x3}, {'4', 0xC},
-        {'Q', 0x4}, {'W', 0x4}, {'E', 0x6}, {'R', 0xD},
-        {'A', 0x7}, {'S', 0x8}, {'D', 0x9}, {'F', 0xE},
-        {'Z', 0xA}, {'X', 0x0}, {'C', 0xB}, {'V', 0xF},
+    uint64_t cycle_count = 0;
+    Halt halt_state;
+    uint64_t random_state = 0x853C49E6748FEA9Bull;
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    struct PublisherSlot
+    {
+        FramePublisher *publisher = nullptr;
+        PublisherSlot() = default;
+        PublisherSlot(const PublisherSlot &) {}
+        PublisherSlot &operator=(const PublisherSlot &) { return *this; }
     };
+    PublisherSlot frame_publisher;
+
+    // Keyboard Memory (shared with input threads)
+    Keypad keypad;
 };
 
 #endif
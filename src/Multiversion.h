@@ -0,0 +1,37 @@
+#ifndef MULTIVERSION_H
+#define MULTIVERSION_H
+
+// Hot kernels marked MULTIVERSIONED are compiled once per x86-64
+// microarchitecture level when the build defines CHIP8_MULTIVERSION, and
+// the dynamic loader picks the best clone for the CPU it runs on (GCC 12+
+// target_clones, ELF ifuncs). Elsewhere it expands to nothing.
+// Only mark functions that are called, never ones whose address is kept:
+// under LTO an ifunc's address can differ between translation units.
+#if defined(CHIP8_MULTIVERSION) && defined(__x86_64__) && defined(__ELF__) \
+    && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#define MULTIVERSIONED \
+    __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define MULTIVERSIONED
+#endif
+
+// Highest x86-64 level this CPU supports (1 to 4), 0 on other architectures
+inline int cpu_level()
+{
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("x86-64-v4"))
+        return 4;
+    if (__builtin_cpu_supports("x86-64-v3"))
+        return 3;
+    if (__builtin_cpu_supports("x86-64-v2"))
+        return 2;
+    return 1;
+#elif defined(__x86_64__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "Opcodes.h"
+using namespace std;
+
+#define OPCODE_SPEC(mask, pattern, handler, mnemonic) {mask, pattern, #handler, false, mnemonic},
+#define QUIRKED_OPCODE_SPEC(mask, pattern, handler, mnemonic) {mask, pattern, #handler, true, mnemonic},
+const OpcodeSpec opcode_specs[] = { CHIP8_OPCODES(OPCODE_SPEC, QUIRKED_OPCODE_SPEC) };
+const int opcode_count = sizeof opcode_specs / sizeof opcode_specs[0];
+static_assert(sizeof opcode_specs / sizeof opcode_specs[0] < 256, "opcode indexes are bytes");
+
+// Entry index for every 16-bit instruction, matched once up front
+struct OpcodeTable
+{
+    uint8_t index[0x10000];
+
+    OpcodeTable()
+    {
+        for (int instruction = 0; instruction < 0x10000; instruction++)
+        {
+            int i = 0;
+            while (i < opcode_count && (instruction & opcode_specs[i].mask) != opcode_specs[i].pattern)
+                i++;
+            index[instruction] = i;
+        }
+    }
+};
+
+int opcode_index(int instruction)
+{
+    static const OpcodeTable table;
+    return table.index[instruction & 0xFFFF];
+}
+
+const OpcodeSpec *opcode_spec(int instruction)
+{
+    int index = opcode_index(instruction);
+    return index < opcode_count ? &opcode_specs[index] : nullptr;
+}
@@ -0,0 +1,88 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+#include <cstdint>
+
+// Every instruction, in the one list the decoder, disassembler and
+// recompiler all work from. An instruction is the first entry whose
+// pattern it matches under the mask; one that matches none isn't an
+// instruction. Entries are
+//
+//   OPCODE(mask, pattern, handler, mnemonic)
+//
+// or QUIRKED_OPCODE for handlers with an instantiation per quirks profile.
+// Mnemonics are Cowgod's syntax, with {x} and {y} filled in as register
+// digits, {X} and {n} in decimal, and {kk} and {nnn} as hex constants.
+#define CHIP8_OPCODES(OPCODE, QUIRKED_OPCODE) \
+    OPCODE(0xFFFF, 0x00E0, op00E0, "CLS") \
+    OPCODE(0xFFFF, 0x00EE, op00EE, "RET") \
+    OPCODE(0xFFF0, 0x00C0, op00CN, "SCD {n}") \
+    OPCODE(0xFFF0, 0x00D0, op00DN, "SCU {n}") \
+    OPCODE(0xFFFF, 0x00FB, op00FB, "SCR") \
+    OPCODE(0xFFFF, 0x00FC, op00FC, "SCL") \
+    OPCODE(0xFFFF, 0x00FD, op00FD, "EXIT") \
+    OPCODE(0xFFFF, 0x00FE, op00FE, "LOW") \
+    OPCODE(0xFFFF, 0x00FF, op00FF, "HIGH") \
+    /* Machine code on the original hardware, nothing here can run it */ \
+    OPCODE(0xF000, 0x0000, invalidOpcode, "SYS {nnn}") \
+    OPCODE(0xF000, 0x1000, op1NNN, "JP {nnn}") \
+    OPCODE(0xF000, 0x2000, op2NNN, "CALL {nnn}") \
+    OPCODE(0xF000, 0x3000, op3XKK, "SE V{x}, {kk}") \
+    OPCODE(0xF000, 0x4000, op4XKK, "SNE V{x}, {kk}") \
+    OPCODE(0xF00F, 0x5000, op5XY0, "SE V{x}, V{y}") \
+    OPCODE(0xF00F, 0x5002, op5XY2, "SAVE V{x} - V{y}") \
+    OPCODE(0xF00F, 0x5003, op5XY3, "LOAD V{x} - V{y}") \
+    OPCODE(0xF000, 0x6000, op6XKK, "LD V{x}, {kk}") \
+    OPCODE(0xF000, 0x7000, op7XKK, "ADD V{x}, {kk}") \
+    OPCODE(0xF00F, 0x8000, op8XY0, "LD V{x}, V{y}") \
+    QUIRKED_OPCODE(0xF00F, 0x8001, op8XY1, "OR V{x}, V{y}") \
+    QUIRKED_OPCODE(0xF00F, 0x8002, op8XY2, "AND V{x}, V{y}") \
+    QUIRKED_OPCODE(0xF00F, 0x8003, op8XY3, "XOR V{x}, V{y}") \
+    OPCODE(0xF00F, 0x8004, op8XY4, "ADD V{x}, V{y}") \
+    OPCODE(0xF00F, 0x8005, op8XY5, "SUB V{x}, V{y}") \
+    QUIRKED_OPCODE(0xF00F, 0x8006, op8XY6, "SHR V{x}, V{y}") \
+    OPCODE(0xF00F, 0x8007, op8XY7, "SUBN V{x}, V{y}") \
+    QUIRKED_OPCODE(0xF00F, 0x800E, op8XYE, "SHL V{x}, V{y}") \
+    OPCODE(0xF00F, 0x9000, op9XY0, "SNE V{x}, V{y}") \
+    OPCODE(0xF000, 0xA000, opANNN, "LD I, {nnn}") \
+    QUIRKED_OPCODE(0xF000, 0xB000, opBNNN, "JP V0, {nnn}") \
+    OPCODE(0xF000, 0xC000, opCXKK, "RND V{x}, {kk}") \
+    QUIRKED_OPCODE(0xF000, 0xD000, opDXYN, "DRW V{x}, V{y}, {n}") \
+    OPCODE(0xF0FF, 0xE09E, opEX9E, "SKP V{x}") \
+    OPCODE(0xF0FF, 0xE0A1, opEXA1, "SKNP V{x}") \
+    OPCODE(0xFFFF, 0xF000, opF000, "LD I, long") \
+    OPCODE(0xFFFF, 0xF002, opF002, "AUDIO") \
+    OPCODE(0xF0FF, 0xF001, opFN01, "PLANE {X}") \
+    OPCODE(0xF0FF, 0xF007, opFX07, "LD V{x}, DT") \
+    OPCODE(0xF0FF, 0xF00A, opFX0A, "LD V{x}, K") \
+    OPCODE(0xF0FF, 0xF015, opFX15, "LD DT, V{x}") \
+    OPCODE(0xF0FF, 0xF018, opFX18, "LD ST, V{x}") \
+    OPCODE(0xF0FF, 0xF01E, opFX1E, "ADD I, V{x}") \
+    OPCODE(0xF0FF, 0xF029, opFX29, "LD F, V{x}") \
+    OPCODE(0xF0FF, 0xF030, opFX30, "LD HF, V{x}") \
+    OPCODE(0xF0FF, 0xF033, opFX33, "LD B, V{x}") \
+    OPCODE(0xF0FF, 0xF03A, opFX3A, "PITCH V{x}") \
+    QUIRKED_OPCODE(0xF0FF, 0xF055, opFX55, "LD [I], V{x}") \
+    QUIRKED_OPCODE(0xF0FF, 0xF065, opFX65, "LD V{x}, [I]") \
+    OPCODE(0xF0FF, 0xF075, opFX75, "LD R, V{x}") \
+    OPCODE(0xF0FF, 0xF085, opFX85, "LD V{x}, R")
+
+struct OpcodeSpec
+{
+    uint16_t mask;
+    uint16_t pattern;
+    const char *handler;   // Function name, for generated code
+    bool quirked;          // handler is a template on the quirks profile
+    const char *mnemonic;
+};
+
+extern const OpcodeSpec opcode_specs[];
+extern const int opcode_count;
+
+// Position of an instruction's entry in opcode_specs, opcode_count if it
+// isn't an instruction. One table lookup.
+int opcode_index(int instruction);
+
+// Entry for an instruction, nullptr if it isn't one
+const OpcodeSpec *opcode_spec(int instruction);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+#include <string>
+#include <utility>
+
+// Behavior that differs between CHIP-8 platforms. Each profile is a type
+// whose flags are compile time constants, so the interpreter is
+// instantiated once per profile with the quirks folded away.
+//
+//   shift_vy        8XY6/8XYE shift VY into VX instead of shifting VX
+//   increment_i     FX55/FX65 leave I pointing past the last register
+//   jump_vx         BNNN is BXNN, jumping to XNN + VX instead of NNN + V0
+//   logic_reset_vf  8XY1/8XY2/8XY3 set VF to 0
+//   clip_sprites    DXYN clips at the screen edges instead of wrapping
+
+// Cowgod's reference, what this emulator has always done
+struct CowgodQuirks
+{
+    static constexpr bool shift_vy = false;
+    static constexpr bool increment_i = false;
+    static constexpr bool jump_vx = false;
+    static constexpr bool logic_reset_vf = false;
+    static constexpr bool clip_sprites = false;
+};
+
+// Original COSMAC VIP interpreter
+struct VipQuirks
+{
+    static constexpr bool shift_vy = true;
+    static constexpr bool increment_i = true;
+    static constexpr bool jump_vx = false;
+    static constexpr bool logic_reset_vf = true;
+    static constexpr bool clip_sprites = true;
+};
+
+// SUPER-CHIP 1.1 on the HP 48
+struct SchipQuirks
+{
+    static constexpr bool shift_vy = false;
+    static constexpr bool increment_i = false;
+    static constexpr bool jump_vx = true;
+    static constexpr bool logic_reset_vf = false;
+    static constexpr bool clip_sprites = true;
+};
+
+// XO-CHIP (Octo)
+struct XochipQuirks
+{
+    static constexpr bool shift_vy = true;
+    static constexpr bool increment_i = true;
+    static constexpr bool jump_vx = false;
+    static constexpr bool logic_reset_vf = false;
+    static constexpr bool clip_sprites = false;
+};
+
+// Runtime choice of profile, kept per machine
+enum class QuirksProfile { Cowgod, Vip, Schip, Xochip };
+
+// Profile type name, for generated code
+inline const char *quirks_name(QuirksProfile profile)
+{
+    switch (profile)
+    {
+        case QuirksProfile::Vip: return "VipQuirks";
+        case QuirksProfile::Schip: return "SchipQuirks";
+        case QuirksProfile::Xochip: return "XochipQuirks";
+        default: return "CowgodQuirks";
+    }
+}
+
+// Profile from its command line name (cowgod, vip, schip, xochip)
+inline bool parse_quirks(const std::string &name, QuirksProfile &profile)
+{
+    static const std::pair<const char *, QuirksProfile> names[] = {
+        {"cowgod", QuirksProfile::Cowgod}, {"vip", QuirksProfile::Vip},
+        {"schip", QuirksProfile::Schip}, {"xochip", QuirksProfile::Xochip},
+    };
+    for (auto &entry : names)
+        if (name == entry.first)
+        {
+            profile = entry.second;
+            return true;
+        }
+    return false;
+}
+
+#endif
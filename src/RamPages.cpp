@@ -0,0 +1,129 @@
+#include "RamPages.h"
+#include <cstring>
+using namespace std;
+
+RamPages::Page RamPages::zero_page;
+
+void RamPages::release(Page *page)
+{
+    if (page != &zero_page && page->references.fetch_sub(1, memory_order_acq_rel) == 1)
+        delete page;
+}
+
+RamPages::RamPages(int size)
+    : size(size), slots((size + page_size - 1) / page_size, Slot {zero_page.bytes, &zero_page})
+{
+}
+
+RamPages::RamPages(const RamPages &other)
+    : size(other.size), slots(other.slots.size(), Slot {zero_page.bytes, &zero_page})
+{
+    try
+    {
+        share(other);
+    }
+    catch (...)
+    {
+        clear();
+        throw;
+    }
+}
+
+RamPages &RamPages::operator=(const RamPages &other)
+{
+    if (this == &other)
+        return *this;
+    if (flat && size == other.size)
+    {
+        // Keep the flat copy where views can see it
+        for (size_t i = 0; i < slots.size(); i++)
+            memcpy(flat + i * page_size, other.slots[i].bytes, page_size);
+        return *this;
+    }
+    if (flat || size != other.size)
+    {
+        vector<Slot> zeroes(other.slots.size(), Slot {zero_page.bytes, &zero_page});
+        clear();
+        size = other.size;
+        slots.swap(zeroes);
+    }
+    share(other);
+    return *this;
+}
+
+RamPages::~RamPages() { clear(); }
+
+// Take other's pages, or copies of them if other is flat. Private pages
+// in slots already are kept and copied over, so no page changes hands
+// and a machine saved and restored keeps writing to the pages it has.
+void RamPages::share(const RamPages &other)
+{
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        Slot &slot = slots[i];
+        Page *page = other.slots[i].page;
+        if (page && page == slot.page)
+            continue;
+        if (slot.page && !shared(slot.page))
+        {
+            memcpy(slot.bytes, other.slots[i].bytes, page_size);
+            continue;
+        }
+        Page *taken = page;
+        if (!taken)
+        {
+            // Allocated before letting go, so running out leaves slot whole
+            taken = new Page;
+            memcpy(taken->bytes, other.slots[i].bytes, page_size);
+        }
+        else if (taken != &zero_page)
+            taken->references.fetch_add(1, memory_order_relaxed);
+        if (slot.page)
+            release(slot.page);
+        slot = {taken->bytes, taken};
+    }
+}
+
+void RamPages::unshare(Slot &slot)
+{
+    Page *page = new Page;
+    memcpy(page->bytes, slot.bytes, page_size);
+    release(slot.page);
+    slot = {page->bytes, page};
+}
+
+void RamPages::clear()
+{
+    for (Slot &slot : slots)
+        if (slot.page)
+            release(slot.page);
+    slots.clear();
+    delete[] flat;
+    flat = nullptr;
+}
+
+uint8_t *RamPages::flatten()
+{
+    if (!flat)
+    {
+        flat = new uint8_t[slots.size() * page_size];
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            memcpy(flat + i * page_size, slots[i].bytes, page_size);
+            release(slots[i].page);
+            slots[i] = {flat + i * page_size, nullptr};
+        }
+    }
+    return flat;
+}
+
+int RamPages::private_pages() const
+{
+    if (flat)
+        return slots.size();
+    int count = 0;
+    for (const Slot &slot : slots)
+        if (!shared(slot.page))
+            count++;
+    return count;
+}
@@ -0,0 +1,78 @@
+#ifndef RAM_PAGES_H
+#define RAM_PAGES_H
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// RAM as 256-byte pages that copies of a machine share until one of them
+// writes. Copying costs a page table, and a fleet started from one
+// snapshot only pays for the pages each machine has dirtied. Pages that
+// were never written are all one zero page, shared by every machine and
+// never counted or freed.
+//
+// Sharing is safe across threads: a shared page is never written, the
+// first write to one copies it, and the reference count is atomic.
+// flatten() gives the machine its own contiguous copy instead, for views
+// that need a plain array.
+//
+// Assignment copies into pages the destination already has to itself
+// rather than swapping them for the source's, so a machine saved and
+// restored over and over stops allocating once it has dirtied its pages.
+class RamPages
+{
+public:
+    static const int page_size = 256;
+
+    explicit RamPages(int size);
+    RamPages(const RamPages &other);
+    RamPages &operator=(const RamPages &other);
+    ~RamPages();
+
+    // Addresses must be within size
+    uint8_t read(int address) const { return slots[address >> 8].bytes[address & 0xFF]; }
+    void write(int address, uint8_t value) { writable_page(address)[address & 0xFF] = value; }
+
+    // The page holding address, unshared first so it can be written
+    uint8_t *writable_page(int address)
+    {
+        Slot &slot = slots[address >> 8];
+        if (slot.page && shared(slot.page))
+            unshare(slot);
+        return slot.bytes;
+    }
+
+    // Contiguous copy of all of RAM, owned by this machine from here on:
+    // later assignments copy into it, so the pointer stays valid
+    uint8_t *flatten();
+
+    // Pages no other machine shares, i.e. what this copy costs
+    int private_pages() const;
+
+private:
+    struct Page
+    {
+        std::atomic<int> references {1};
+        uint8_t bytes[page_size] {};
+    };
+    struct Slot
+    {
+        uint8_t *bytes;
+        Page *page;   // nullptr once flattened
+    };
+    static Page zero_page;
+    static bool shared(const Page *page)
+    {
+        return page == &zero_page || page->references.load(std::memory_order_acquire) != 1;
+    }
+
+    void release(Page *page);
+    void share(const RamPages &other);
+    void unshare(Slot &slot);
+    void clear();
+
+    int size;
+    std::vector<Slot> slots;
+    uint8_t *flat = nullptr;
+};
+
+#endif
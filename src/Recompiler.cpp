@@ -0,0 +1,242 @@
+#include "Recompiler.h"
+#include "Cpu.h"
+#include "Disassembler.h"
+#include "Opcodes.h"
+#include <cstdio>
+using namespace std;
+
+static string hex(int value, int digits)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof buffer, "0x%0*X", digits, value);
+    return buffer;
+}
+
+static string block_label(int address)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof buffer, "block_%03X", address);
+    return buffer;
+}
+
+// Interpreter handler for instructions that run inside a block, with the
+// profile's instantiation where there's one per profile. Empty for
+// anything that stops the machine, the interpreter deals with those.
+static string handler(int instruction, const string &profile)
+{
+    const OpcodeSpec *spec = opcode_spec(instruction);
+    if (!spec || spec->handler == string("invalidOpcode") || instruction == 0x00FD)
+        return "";
+    return spec->quirked ? string(spec->handler) + "<" + profile + ">" : spec->handler;
+}
+
+// Instructions that never change the program counter themselves
+static bool flow_is_straight(int instruction)
+{
+    int high_nibble = instruction >> 12;
+    if (high_nibble == 0x5)
+        return (instruction & 0xF) == 0x2 || (instruction & 0xF) == 0x3;
+    return high_nibble == 0x0 ? instruction != 0x00EE
+        : !(high_nibble <= 0x5 || high_nibble == 0x9 || high_nibble == 0xB || high_nibble == 0xE);
+}
+
+// Condition under which a skip instruction skips
+static string skip_condition(int instruction)
+{
+    string vx = "mem.reg_read(" + hex((instruction & 0xF00) >> 8, 1) + ")";
+    string vy = "mem.reg_read(" + hex((instruction & 0xF0) >> 4, 1) + ")";
+    string kk = hex(instruction & 0xFF, 2);
+    switch (instruction >> 12)
+    {
+        case 0x3: return vx + " == " + kk;
+        case 0x4: return vx + " != " + kk;
+        case 0x5: return vx + " == " + vy;
+        case 0x9: return vx + " != " + vy;
+    }
+    return (instruction & 0xFF) == 0x9E ? "mem.get_key(" + vx + ")" : "!mem.get_key(" + vx + ")";
+}
+
+void recompile(const vector<uint8_t> &rom, const string &function_name, ostream &out, int origin,
+               QuirksProfile quirks)
+{
+    ControlFlowGraph cfg(rom, origin);
+
+    // Handler call for the chosen profile
+    string profile = quirks_name(quirks);
+    auto call = [&](int instruction) {
+        return handler(instruction, profile) + "(" + hex(instruction, 4) + ", mem);";
+    };
+
+    // Leave control with count instructions of the block done, continuing
+    // at a known block or through the dispatcher
+    auto exit_to = [&](int target, int count, const string &indent) {
+        out << indent << "executed += " << count << ";\n";
+        if (cfg.blocks.count(target))
+            out << indent << "goto " << block_label(target) << ";\n";
+        else
+            out << indent << "pc = " << hex(target, 3) << ";\n"
+                << indent << "goto dispatch;\n";
+    };
+    auto exit_dynamic = [&](int count) {
+        out << "    executed += " << count << ";\n"
+            << "    pc = mem.get_program_counter();\n"
+            << "    goto dispatch;\n";
+    };
+
+    out << "// Generated by chip8-aot, do not edit\n"
+        << "#include \"Memory.h\"\n"
+        << "#include \"Cpu.h\"\n\n";
+
+    // Original code bytes, to notice when the ROM rewrites itself
+    out << "static const int code_start = " << hex(origin, 3) << ";\n";
+    out << "static const unsigned char code_image[" << rom.size() << "] = {";
+    for (size_t i = 0; i < rom.size(); i++)
+        out << (i % 16 ? " " : "\n    ") << hex(rom[i], 2) << ",";
+    out << "\n};\n";
+    out << "static const bool is_code[" << rom.size() << "] = {";
+    for (size_t i = 0; i < rom.size(); i++)
+        out << (i % 32 ? " " : "\n    ") << cfg.is_code(origin + i) << ",";
+    out << "\n};\n\n";
+
+    out << "static bool code_intact(Memory &mem, int start, int end)\n"
+        << "{\n"
+        << "    for (int address = start; address < end; address++)\n"
+        << "    {\n"
+        << "        int offset = address - code_start;\n"
+        << "        if (0 <= offset && offset < (int) sizeof code_image && is_code[offset]\n"
+        << "            && mem.mem_read(address) != code_image[offset])\n"
+        << "            return false;\n"
+        << "    }\n"
+        << "    return true;\n"
+        << "}\n\n";
+
+    out << "long " << function_name << "(Memory &mem, long cycles)\n"
+        << "{\n"
+        << "    long executed = 0;\n"
+        << "    long interpreted = 0;\n"
+        << "    bool compiled = code_intact(mem, code_start, code_start + (int) sizeof code_image);\n"
+        << "    int pc = mem.get_program_counter();\n\n"
+        << "dispatch:\n"
+        << "    if (mem.is_halted())\n"
+        << "    {\n"
+        << "        mem.add_cycle_count(executed - interpreted);\n"
+        << "        return executed;\n"
+        << "    }\n"
+        << "    if (compiled)\n"
+        << "    {\n"
+        << "        switch (pc)\n"
+        << "        {\n";
+    for (auto &entry : cfg.blocks)
+        out << "            case " << hex(entry.first, 3) << ": goto " << block_label(entry.first) << ";\n";
+    out << "        }\n"
+        << "    }\n\n"
+        << "    // Not compiled or out of budget for a whole block, run one\n"
+        << "    // instruction on the interpreter\n"
+        << "interpret:\n"
+        << "    mem.set_program_counter(pc);\n"
+        << "    if (executed >= cycles)\n"
+        << "    {\n"
+        << "        mem.add_cycle_count(executed - interpreted);\n"
+        << "        return executed;\n"
+        << "    }\n"
+        << "    {\n"
+        << "        // Stores run here can rewrite code too\n"
+        << "        int instruction = mem.mem_read(pc) << 8 | mem.mem_read(pc + 1);\n"
+        << "        step<" << profile << ">(mem);\n"
+        << "        if (store_length(instruction))\n"
+        << "            compiled = code_intact(mem, code_start, code_start + (int) sizeof code_image);\n"
+        << "    }\n"
+        << "    executed++;\n"
+        << "    interpreted++;\n"
+        << "    pc = mem.get_program_counter();\n"
+        << "    goto dispatch;\n";
+
+    for (auto &entry : cfg.blocks)
+    {
+        const BasicBlock &block = entry.second;
+        int length = 0;
+        for (int address = block.start; address < block.end; address += cfg.instruction_length(address))
+            length++;
+
+        // Blocks that don't fit in the remaining budget are interpreted
+        out << "\n" << block_label(block.start) << ":\n"
+            << "    if (!compiled || cycles - executed < " << length << ")\n"
+            << "    {\n"
+            << "        pc = " << hex(block.start, 3) << ";\n"
+            << "        goto interpret;\n"
+            << "    }\n";
+
+        bool exited = false;
+        int count = 0;
+        for (int address = block.start; address < block.end && !exited; address += cfg.instruction_length(address))
+        {
+            int instruction = cfg.instruction_at(address);
+            int high_nibble = instruction >> 12;
+            int next = address + cfg.instruction_length(address);
+            count++;
+            out << "    // " << hex(address, 3) << ": " << disassemble(instruction) << "\n";
+
+            exited = true;
+            if ((block.halts && next == block.end) || (flow_is_straight(instruction) && handler(instruction, profile).empty()))
+            {
+                // Not an opcode, let the interpreter deal with it
+                out << "    executed += " << count - 1 << ";\n"
+                    << "    pc = " << hex(address, 3) << ";\n"
+                    << "    goto interpret;\n";
+            }
+            else if (instruction == 0x00EE || high_nibble == 0x2 || high_nibble == 0xB)
+            {
+                // Stack and computed jumps go through their handlers
+                out << "    mem.set_program_counter(" << hex(next, 3) << ");\n"
+                    << "    " << call(instruction) << "\n";
+                exit_dynamic(count);
+            }
+            else if (high_nibble == 0x1)
+                exit_to(instruction & 0xFFF, count, "    ");
+            else if (!flow_is_straight(instruction))
+            {
+                out << "    if (" << skip_condition(instruction) << ")\n"
+                    << "    {\n";
+                exit_to(next + cfg.instruction_length(next), count, "        ");
+                out << "    }\n";
+                exit_to(next, count, "    ");
+            }
+            else if ((instruction & 0xF0FF) == 0xF00A)
+            {
+                // May rewind to wait for a key
+                out << "    mem.set_program_counter(" << hex(next, 3) << ");\n"
+                    << "    opFX0A(" << hex(instruction, 4) << ", mem);\n";
+                exit_dynamic(count);
+            }
+            else
+            {
+                exited = false;
+                if (high_nibble == 0x6)
+                    out << "    mem.reg_write(" << hex((instruction & 0xF00) >> 8, 1) << ", "
+                        << hex(instruction & 0xFF, 2) << ");\n";
+                else if (high_nibble == 0xA)
+                    out << "    mem.set_address_pointer(" << hex(instruction & 0xFFF, 3) << ");\n";
+                else if (instruction == 0xF000)
+                    out << "    mem.set_address_pointer(" << hex(cfg.instruction_at(address + 2), 4) << ");\n";
+                else if (int written = store_length(instruction))
+                {
+                    // Memory writes, drop back to the interpreter if they hit code
+                    out << "    {\n"
+                        << "        int start = mem.get_address_pointer();\n"
+                        << "        " << call(instruction) << "\n"
+                        << "        if (!code_intact(mem, start, start + " << written << "))\n"
+                        << "        {\n"
+                        << "            compiled = false;\n";
+                    exit_to(next, count, "            ");
+                    out << "        }\n"
+                        << "    }\n";
+                }
+                else
+                    out << "    " << call(instruction) << "\n";
+            }
+        }
+        if (!exited)
+            exit_to(block.end, count, "    ");
+    }
+    out << "}\n";
+}
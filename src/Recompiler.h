@@ -0,0 +1,24 @@
+#ifndef RECOMPILER_H
+#define RECOMPILER_H
+#include "Quirks.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Translate a ROM ahead of time into a C++ translation unit defining
+//
+//   long <function_name>(Memory &mem, long cycles);
+//
+// which runs up to `cycles` instructions of the ROM on mem (loaded with
+// the same ROM) and returns how many ran. Every basic block found by the
+// control-flow analysis becomes a label; jumps, skips and fallthroughs
+// between blocks are direct gotos. Computed targets (BNNN, 00EE), code
+// that wasn't found statically, and code the ROM has overwritten run on
+// the interpreter through step(). Quirky opcodes and the interpreter are
+// the instantiations for the given profile.
+void recompile(const std::vector<uint8_t> &rom, const std::string &function_name,
+               std::ostream &out, int origin = 0x200,
+               QuirksProfile quirks = QuirksProfile::Cowgod);
+
+#endif
@@ -0,0 +1,275 @@
+#include "Recorder.h"
+#include "Encoding.h"
+#include "Image.h"
+#include <cstring>
+using namespace std;
+
+static const int format_version = 1;
+
+
+/* Recorder */
+
+Recorder::Recorder(ostream &out, int keyframe_interval, bool hires)
+    : out(out), keyframe_interval(keyframe_interval),
+      width(hires ? 128 : 64), height(hires ? 64 : 32)
+{
+    previous.assign(width * height / 8, 0);
+    current.assign(width * height / 8, 0);
+
+    vector<uint8_t> header = {'C', '8', 'R', 'V'};
+    put_uint(header, format_version, 2);
+    put_uint(header, width, 2);
+    put_uint(header, height, 2);
+    put_uint(header, keyframe_interval, 2);
+    out.write((const char *) header.data(), header.size());
+    offset += header.size();
+}
+
+Recorder::~Recorder() { finish(); }
+
+int Recorder::get_frame_count() { return frame_count; }
+
+// Screen row at the recording resolution
+void Recorder::screen_words(Memory &mem, int row, uint64_t bits[2])
+{
+    if (mem.screen_width == width)
+    {
+        bits[0] = mem.screen_row(row, 0);
+        bits[1] = width == 128 ? mem.screen_row(row, 1) : 0;
+    }
+    else if (width == 128)
+    {
+        uint64_t lores = mem.screen_row(row / 2, 0);
+        bits[0] = double_pixels(lores >> 32);
+        bits[1] = double_pixels(lores);
+    }
+    else
+    {
+        bits[0] = (uint64_t) halve_pixels(mem.screen_row(2 * row, 0)) << 32
+                | halve_pixels(mem.screen_row(2 * row, 1));
+        bits[1] = 0;
+    }
+}
+
+void Recorder::capture(Memory &mem)
+{
+    if (finished)
+        return;
+
+    // Keyframes are encoded against a blank screen
+    if (chunk_frames == 0)
+        fill(previous.begin(), previous.end(), 0);
+
+    // Pack the screen rows and compare against the last frame a word at a time
+    int words = width / 64;
+    uint8_t *bytes = current.data();
+    bool changed = false;
+    for (int row = 0; row < height; row++)
+    {
+        uint64_t bits[2];
+        screen_words(mem, row, bits);
+        for (int word = 0; word < words; word++)
+            for (int shift = 56; shift >= 0; shift -= 8)
+                *bytes++ = bits[word] >> shift;
+        changed |= memcmp(bytes - 8 * words, &previous[row * 8 * words], 8 * words) != 0;
+    }
+
+    if (!changed)
+        chunk.push_back(0);
+    else
+    {
+        // XOR against the previous frame and run length encode the result
+        payload.clear();
+        size_t size = current.size();
+        size_t pos = 0;
+        while (pos < size)
+        {
+            size_t zeros = pos;
+            while (zeros < size && current[zeros] == previous[zeros])
+                zeros++;
+            size_t literals = zeros;
+            while (literals < size && current[literals] != previous[literals])
+                literals++;
+            put_varint(payload, zeros - pos);
+            put_varint(payload, literals - zeros);
+            for (size_t i = zeros; i < literals; i++)
+                payload.push_back(current[i] ^ previous[i]);
+            pos = literals;
+        }
+        put_varint(chunk, payload.size());
+        chunk.insert(chunk.end(), payload.begin(), payload.end());
+        swap(previous, current);
+    }
+
+    frame_count++;
+    if (++chunk_frames == keyframe_interval)
+        flush_chunk();
+}
+
+void Recorder::flush_chunk()
+{
+    if (chunk_frames == 0)
+        return;
+
+    vector<uint8_t> header = {'C', '8', 'R', 'K'};
+    put_uint(header, chunk_first_frame, 4);
+    put_uint(header, chunk_frames, 4);
+    put_uint(header, chunk.size(), 4);
+    out.write((const char *) header.data(), header.size());
+    out.write((const char *) chunk.data(), chunk.size());
+
+    index.push_back({chunk_first_frame, offset});
+    offset += header.size() + chunk.size();
+    chunk.clear();
+    chunk_first_frame = frame_count;
+    chunk_frames = 0;
+}
+
+void Recorder::finish()
+{
+    if (finished)
+        return;
+    flush_chunk();
+
+    vector<uint8_t> trailer = {'C', '8', 'R', 'I'};
+    put_uint(trailer, index.size(), 4);
+    for (auto &entry : index)
+    {
+        put_uint(trailer, entry.first, 4);
+        put_uint(trailer, entry.second, 8);
+    }
+    put_uint(trailer, offset, 8);
+    trailer.insert(trailer.end(), {'C', '8', 'R', 'E'});
+    out.write((const char *) trailer.data(), trailer.size());
+    out.flush();
+    finished = true;
+}
+
+
+/* Playback */
+
+Playback::Playback(istream &in) : in(in)
+{
+    uint8_t header[12];
+    in.seekg(0);
+    if (!in.read((char *) header, 12) || memcmp(header, "C8RV", 4) != 0)
+        return;
+    if (get_uint(header + 4, 2) != format_version)
+        return;
+    width = get_uint(header + 6, 2);
+    height = get_uint(header + 8, 2);
+
+    // Footer points at the index
+    uint8_t footer[12];
+    in.seekg(-12, ios::end);
+    if (!in.read((char *) footer, 12) || memcmp(footer + 8, "C8RE", 4) != 0)
+        return;
+    in.seekg(get_uint(footer, 8));
+
+    uint8_t index_header[8];
+    if (!in.read((char *) index_header, 8) || memcmp(index_header, "C8RI", 4) != 0)
+        return;
+    int chunks = get_uint(index_header + 4, 4);
+    for (int i = 0; i < chunks; i++)
+    {
+        uint8_t entry[12];
+        if (!in.read((char *) entry, 12))
+            return;
+        index.push_back({(uint32_t) get_uint(entry, 4), get_uint(entry + 4, 8)});
+    }
+
+    // Frame count comes from the last chunk header
+    if (!index.empty())
+    {
+        if (!load_chunk(index.size() - 1))
+            return;
+        frame_count = chunk_end_frame;
+    }
+    frame_state.assign(width * height / 8, 0);
+    valid = true;
+}
+
+bool Playback::is_valid() { return valid; }
+int Playback::get_frame_count() { return frame_count; }
+int Playback::get_width() { return width; }
+int Playback::get_height() { return height; }
+
+bool Playback::load_chunk(int chunk_number)
+{
+    uint8_t header[16];
+    in.clear();
+    in.seekg(index[chunk_number].second);
+    if (!in.read((char *) header, 16) || memcmp(header, "C8RK", 4) != 0)
+        return false;
+    chunk.resize(get_uint(header + 12, 4));
+    if (!in.read((char *) chunk.data(), chunk.size()))
+        return false;
+
+    loaded_chunk = chunk_number;
+    cursor = 0;
+    next_frame = get_uint(header + 4, 4);
+    chunk_end_frame = next_frame + get_uint(header + 8, 4);
+    fill(frame_state.begin(), frame_state.end(), 0);
+    return true;
+}
+
+bool Playback::read_frame(int frame_number, Frame &frame)
+{
+    if (!valid || frame_number < 0 || frame_number >= frame_count)
+        return false;
+
+    // Seek to the chunk holding the frame unless we can decode forward
+    if (loaded_chunk < 0 || frame_number < next_frame || frame_number >= chunk_end_frame)
+    {
+        int chunk_number = 0;
+        while (chunk_number + 1 < (int) index.size() && index[chunk_number + 1].first <= (uint32_t) frame_number)
+            chunk_number++;
+        if (!load_chunk(chunk_number))
+            return false;
+    }
+
+    // Apply deltas up to the requested frame
+    while (next_frame <= frame_number)
+    {
+        uint64_t size;
+        if (!get_varint(chunk, cursor, size) || cursor + size > chunk.size())
+            return false;
+        size_t end = cursor + size;
+        size_t pos = 0;
+        while (cursor < end)
+        {
+            uint64_t zeros, literals;
+            if (!get_varint(chunk, cursor, zeros) || !get_varint(chunk, cursor, literals))
+                return false;
+            pos += zeros;
+            if (pos + literals > frame_state.size() || cursor + literals > end)
+                return false;
+            for (uint64_t i = 0; i < literals; i++)
+                frame_state[pos++] ^= chunk[cursor++];
+        }
+        next_frame++;
+    }
+    frame = frame_state;
+    return true;
+}
+
+
+/* Exporters */
+
+void export_gif(Playback &playback, ostream &out, int first, int last, int scale)
+{
+    GifWriter gif(out, playback.get_width(), playback.get_height(), scale);
+    Frame frame;
+    for (int i = first; i <= last && playback.read_frame(i, frame); i++)
+        gif.add_frame(frame);
+    gif.finish();
+}
+
+bool export_png(Playback &playback, ostream &out, int frame_number, int scale)
+{
+    Frame frame;
+    if (!playback.read_frame(frame_number, frame))
+        return false;
+    write_png(frame, playback.get_width(), playback.get_height(), out, scale);
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+#include "Memory.h"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Screen recording format (all integers little endian)
+//
+//   header   "C8RV" u16 version, u16 width, u16 height, u16 keyframe interval
+//   chunk    "C8RK" u32 first frame, u32 frame count, u32 size, frames
+//   index    "C8RI" u32 chunk count, (u32 first frame, u64 offset) per chunk
+//   footer   u64 index offset, "C8RE"
+//
+// A frame is a varint payload size followed by the payload. The payload
+// is the frame XORed with the previous one (with a blank screen for the
+// first frame of a chunk, which makes it a keyframe), run length encoded
+// as (varint zero bytes, varint literal bytes, literals) pairs. An empty
+// payload is an unchanged frame.
+
+// Packed screen bytes, row-major, most significant bit = leftmost pixel
+using Frame = std::vector<uint8_t>;
+
+class Recorder
+{
+public:
+    // Records at 64x32, or 128x64 for SUPER-CHIP ROMs. Frames drawn at
+    // the other resolution are scaled (halving 128x64 frames is lossy).
+    Recorder(std::ostream &out, int keyframe_interval = 600, bool hires = false);
+    ~Recorder();
+
+    // Append the current screen as the next frame
+    void capture(Memory &mem);
+
+    // Flush the last chunk and write the index, no captures after this
+    void finish();
+
+    int get_frame_count();
+
+private:
+    void screen_words(Memory &mem, int row, uint64_t bits[2]);
+    void flush_chunk();
+
+    std::ostream &out;
+    uint64_t offset = 0;
+    int keyframe_interval;
+    int frame_count = 0;
+    bool finished = false;
+
+    int width;
+    int height;
+    Frame previous;
+    Frame current;
+
+    // Chunk being built and the index of written chunks, and the frame
+    // being encoded (kept to reuse its storage)
+    std::vector<uint8_t> chunk;
+    std::vector<uint8_t> payload;
+    int chunk_first_frame = 0;
+    int chunk_frames = 0;
+    std::vector<std::pair<uint32_t, uint64_t>> index;
+};
+
+// Random access reader for recordings
+class Playback
+{
+public:
+    explicit Playback(std::istream &in);
+
+    bool is_valid();
+    int get_frame_count();
+    int get_width();
+    int get_height();
+
+    // Decode a frame, sequential reads continue from the last one
+    bool read_frame(int frame_number, Frame &frame);
+
+private:
+    bool load_chunk(int chunk_number);
+
+    std::istream &in;
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    int frame_count = 0;
+    std::vector<std::pair<uint32_t, uint64_t>> index;
+
+    // Decode position inside the loaded chunk
+    int loaded_chunk = -1;
+    std::vector<uint8_t> chunk;
+    size_t cursor = 0;
+    int next_frame = 0;
+    int chunk_end_frame = 0;
+    Frame frame_state;
+};
+
+// Export frames first..last (inclusive) as an animated GIF
+void export_gif(Playback &playback, std::ostream &out, int first, int last, int scale = 4);
+
+// Export one frame as a PNG
+bool export_png(Playback &playback, std::ostream &out, int frame_number, int scale = 4);
+
+#endif
@@ -0,0 +1,140 @@
+#include "SharedFramebuffer.h"
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+using namespace std;
+
+static_assert(offsetof(SharedScreen, sequence) == 8, "shared screen layout");
+static_assert(offsetof(SharedScreen, frame) == 24, "shared screen layout");
+static_assert(offsetof(SharedScreen, rows) == 32, "shared screen layout");
+static_assert(sizeof(atomic<uint32_t>) == 4 && atomic<uint32_t>::is_always_lock_free,
+              "sequence must be a plain lock-free word to share across processes");
+
+static const uint32_t shared_version = 1;
+
+// Segment names need a single leading slash
+static string segment_name(const string &name)
+{
+    return name[0] == '/' ? name : "/" + name;
+}
+
+
+/* Writer */
+
+SharedFramebuffer::SharedFramebuffer(const string &name) : name(segment_name(name))
+{
+    int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return;
+    if (ftruncate(fd, sizeof(SharedScreen)) == 0)
+    {
+        void *mapping = mmap(nullptr, sizeof(SharedScreen), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED)
+            screen = new (mapping) SharedScreen();
+    }
+    close(fd);
+    if (!screen)
+    {
+        shm_unlink(this->name.c_str());
+        return;
+    }
+
+    // Magic last, readers ignore the segment until it's set up
+    screen->version = shared_version;
+    screen->width = 64;
+    screen->height = 32;
+    screen->planes = 1;
+    atomic_thread_fence(memory_order_release);
+    memcpy(screen->magic, "C8FB", 4);
+}
+
+SharedFramebuffer::~SharedFramebuffer()
+{
+    if (!screen)
+        return;
+    munmap(screen, sizeof(SharedScreen));
+    shm_unlink(name.c_str());
+}
+
+bool SharedFramebuffer::is_open() { return screen != nullptr; }
+
+void SharedFramebuffer::publish(Memory &mem)
+{
+    capture_frame(mem, captured);
+    captured.number = screen ? screen->frame + 1 : 0;
+    present(captured);
+}
+
+void SharedFramebuffer::present(const VideoFrame &frame)
+{
+    if (!screen)
+        return;
+    // Seqlock write: odd sequence, data, even sequence
+    uint32_t sequence = screen->sequence.load(memory_order_relaxed);
+    screen->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    screen->width = frame.width;
+    screen->height = frame.height;
+    screen->planes = frame.planes;
+    screen->frame = frame.number;
+    int words = 2 * frame.height;
+    for (int plane = 0; plane < frame.planes; plane++)
+        memcpy(screen->rows[plane], frame.rows[plane], words * sizeof(uint64_t));
+
+    screen->sequence.store(sequence + 2, memory_order_release);
+}
+
+
+/* Reader */
+
+SharedFramebufferReader::SharedFramebufferReader(const string &name)
+{
+    int fd = shm_open(segment_name(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return;
+    void *mapping = mmap(nullptr, sizeof(SharedScreen), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping != MAP_FAILED)
+        screen = (const SharedScreen *) mapping;
+}
+
+SharedFramebufferReader::~SharedFramebufferReader()
+{
+    if (screen)
+        munmap((void *) screen, sizeof(SharedScreen));
+}
+
+bool SharedFramebufferReader::is_open() { return screen != nullptr; }
+
+bool SharedFramebufferReader::read(VideoFrame &frame)
+{
+    if (!screen || memcmp(screen->magic, "C8FB", 4) != 0 || screen->version != shared_version)
+        return false;
+
+    for (;;)
+    {
+        uint32_t before = screen->sequence.load(memory_order_acquire);
+        if (before & 1)
+            continue;
+        if (before == 0)
+            return false;
+
+        frame.width = screen->width;
+        frame.height = screen->height;
+        frame.number = screen->frame;
+        frame.planes = screen->planes;
+        if (frame.height > 64 || frame.planes < 1 || frame.planes > 2)
+            continue;
+        memcpy(frame.rows, screen->rows, sizeof frame.rows[0] * frame.planes);
+        if (frame.planes == 1)
+            memset(frame.rows[1], 0, sizeof frame.rows[1]);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (screen->sequence.load(memory_order_relaxed) == before)
+            return true;
+    }
+}
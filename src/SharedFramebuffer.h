@@ -0,0 +1,71 @@
+#ifndef SHARED_FRAMEBUFFER_H
+#define SHARED_FRAMEBUFFER_H
+#include "FrameExchange.h"
+#include "Frontend.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Layout of a machine's POSIX shared memory segment (/dev/shm/<name>),
+// native byte order, for readers in any language:
+//
+//   offset  size
+//        0     4  magic "C8FB"
+//        4     4  version (1)
+//        8     4  sequence, odd while the frame is being written
+//       12     4  width in pixels (64 or 128)
+//       16     4  height in pixels (32 or 64)
+//       20     4  planes in use (1 or 2)
+//       24     8  frame counter
+//       32  2048  rows, 2 planes x 128 words, row n at words 2n and 2n + 1,
+//                 bit 63 of a word is its leftmost pixel
+//
+// To read a frame: load the sequence, retry while it's odd, copy what's
+// needed, then load the sequence again and retry if it changed.
+struct SharedScreen
+{
+    char magic[4];
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t width;
+    uint32_t height;
+    uint32_t planes;
+    uint64_t frame;
+    uint64_t rows[2][128];
+};
+
+// Writer side, one per machine. Creates the segment and removes it again
+// when destroyed. Works either as the machine's vblank publisher or as a
+// frontend video sink.
+class SharedFramebuffer : public FramePublisher, public VideoSink
+{
+public:
+    explicit SharedFramebuffer(const std::string &name);
+    ~SharedFramebuffer();
+    bool is_open();
+
+    void publish(Memory &mem) override;
+    void present(const VideoFrame &frame) override;
+
+private:
+    std::string name;
+    SharedScreen *screen = nullptr;
+    VideoFrame captured;
+};
+
+// Reader side, maps an existing segment read-only
+class SharedFramebufferReader
+{
+public:
+    explicit SharedFramebufferReader(const std::string &name);
+    ~SharedFramebufferReader();
+    bool is_open();
+
+    // Latest complete frame, false if none was written yet
+    bool read(VideoFrame &frame);
+
+private:
+    const SharedScreen *screen = nullptr;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "Timing.h"
+#include "Cpu.h"
+using namespace std;
+
+// Fetch, decode and dispatch in the interpreter's main loop
+static const int fetch_cycles = 40;
+
+int vip_instruction_cycles(int instruction, Memory &mem)
+{
+    int x = (instruction & 0xF00) >> 8;
+    int vx = mem.reg_read(x) & 0xFF;
+    int vy = mem.reg_read((instruction & 0xF0) >> 4) & 0xFF;
+    int kk = instruction & 0xFF;
+    int n = instruction & 0xF;
+
+    switch (instruction >> 12)
+    {
+        case 0x0:
+            if (instruction == 0x00E0)
+                return fetch_cycles + 24 + 3054;
+            if (instruction == 0x00EE)
+                return fetch_cycles + 10;
+            return fetch_cycles + 26;   // Machine language subroutine call
+        case 0x1: return fetch_cycles + 12;
+        case 0x2: return fetch_cycles + 26;
+        case 0x3: return fetch_cycles + (vx == kk ? 14 : 10);
+        case 0x4: return fetch_cycles + (vx != kk ? 14 : 10);
+        case 0x5: return fetch_cycles + (vx == vy ? 18 : 14);
+        case 0x6: return fetch_cycles + 6;
+        case 0x7: return fetch_cycles + 10;
+        case 0x8: return fetch_cycles + 44;
+        case 0x9: return fetch_cycles + (vx != vy ? 18 : 14);
+        case 0xA: return fetch_cycles + 12;
+        case 0xB: return fetch_cycles + 22;
+        case 0xC: return fetch_cycles + 36;
+        case 0xD:
+        {
+            // Rows straddling two bytes of display memory take longer
+            int row_cycles = vx % 8 ? 46 : 34;
+            return fetch_cycles + 26 + n * row_cycles;
+        }
+        case 0xE:
+        {
+            bool pressed = mem.get_key(vx);
+            bool skips = kk == 0x9E ? pressed : !pressed;
+            return fetch_cycles + (skips ? 18 : 14);
+        }
+        case 0xF:
+            switch (kk)
+            {
+                case 0x07: return fetch_cycles + 10;
+                case 0x0A: return fetch_cycles + 19;
+                case 0x15: return fetch_cycles + 10;
+                case 0x18: return fetch_cycles + 10;
+                case 0x1E: return fetch_cycles + 16;
+                case 0x29: return fetch_cycles + 16;
+                case 0x33: return fetch_cycles + 80 + 16 * (vx / 100 + vx / 10 % 10 + vx % 10);
+                case 0x55: return fetch_cycles + 14 + 14 * (x + 1);
+                case 0x65: return fetch_cycles + 14 + 14 * (x + 1);
+            }
+    }
+    return fetch_cycles;
+}
+
+
+VipTiming::VipTiming(bool display_wait) : display_wait(display_wait) {}
+
+uint64_t VipTiming::get_machine_cycles() { return machine_cycles; }
+
+long VipTiming::run_frame(Memory &mem)
+{
+    long executed = 0;
+    while (balance < vip_cycles_per_frame && !mem.is_halted())
+    {
+        int pc = mem.get_program_counter();
+        int instruction = mem.mem_read(pc) << 8 | mem.mem_read(pc + 1);
+        int cycles = vip_instruction_cycles(instruction, mem);
+        step(mem);
+        executed++;
+        balance += cycles;
+        machine_cycles += cycles;
+
+        // The rest of the frame goes to waiting for the display interrupt
+        if (display_wait && instruction >> 12 == 0xD && balance < vip_cycles_per_frame)
+        {
+            machine_cycles += vip_cycles_per_frame - balance;
+            balance = vip_cycles_per_frame;
+        }
+    }
+    if (mem.is_halted())
+        return executed;
+    balance -= vip_cycles_per_frame;
+    mem.tick_timers();
+    return executed;
+}
+
+long VipTiming::run_frames(Memory &mem, int frames)
+{
+    long executed = 0;
+    for (int i = 0; i < frames && !mem.is_halted(); i++)
+        executed += run_frame(mem);
+    return executed;
+}
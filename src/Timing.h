@@ -0,0 +1,49 @@
+#ifndef TIMING_H
+#define TIMING_H
+#include "Memory.h"
+#include <cstdint>
+
+// COSMAC VIP timing. The VIP runs its 1802 at 1.7609 MHz with 8 clocks per
+// machine cycle, 3668 machine cycles to a 60 Hz frame. The display takes
+// 1024 of them (128 bytes of DMA, 8 cycles each) and the interrupt routine
+// that sets it up and ticks the timers about 46 (23 two-cycle
+// instructions); the interpreter gets the rest.
+static const int vip_frame_cycles = 3668;
+static const int vip_display_dma_cycles = 1024;
+static const int vip_interrupt_cycles = 46;
+static const int vip_cycles_per_frame = vip_frame_cycles - vip_display_dma_cycles - vip_interrupt_cycles;
+
+// Machine cycles the instruction takes on the VIP interpreter, given the
+// state it's about to run in (skips taken, sprite alignment, FX33's digits).
+// Approximations of the interpreter's routines, every instruction also
+// paying for fetch and decode.
+int vip_instruction_cycles(int instruction, Memory &mem);
+
+// Runs a machine a 60 Hz frame at a time, each frame getting the
+// instructions that fit in its share of VIP machine cycles. An instruction
+// that runs over the end of a frame is paid for out of the next one.
+// With display_wait, DXYN waits for the next frame like the VIP's sprite
+// routine waiting for the display interrupt.
+class VipTiming
+{
+public:
+    explicit VipTiming(bool display_wait = true);
+
+    // Run one frame and tick the timers, returns instructions executed.
+    // A machine that halts stops there, without the tick.
+    long run_frame(Memory &mem);
+
+    // As fast as the host allows (headless fast-forward)
+    long run_frames(Memory &mem, int frames);
+
+    // Interpreter machine cycles elapsed since construction, waits
+    // included (the display and interrupt's share isn't counted)
+    uint64_t get_machine_cycles();
+
+private:
+    bool display_wait;
+    long balance = 0;  // Cycles overrun into the current frame
+    uint64_t machine_cycles = 0;
+};
+
+#endif
@@ -0,0 +1,393 @@
+#include "Trace.h"
+#include "Cpu.h"
+#include "Disassembler.h"
+#include "Encoding.h"
+#include <algorithm>
+#include <cstdio>
+using namespace std;
+
+static const char trace_magic[4] = {'C', '8', 'T', 'R'};
+static const int trace_version = 1;
+
+// Record flags
+enum : uint8_t
+{
+    has_gap = 1,
+    has_jump = 2,
+    has_registers = 4,
+    has_i = 8,
+    has_memory = 16,
+    has_sp = 32,
+    has_timers = 64,
+};
+
+// Largest record: flags, gap, jump, instruction, 16 registers, I, a
+// 16 byte store and its position, SP, timers
+static const size_t max_record_size = 1 + 10 + 10 + 2 + 2 + 16 * 10 + 10 + 10 + 10 + 16 + 10 + 20;
+
+
+/* Recording */
+
+TraceRecorder::TraceRecorder(ostream &out, size_t block_size, int max_blocks)
+    : out(out), block_size(block_size), max_blocks(max_blocks < 1 ? 1 : max_blocks)
+{
+    block.insert(block.end(), trace_magic, trace_magic + 4);
+    put_uint(block, trace_version, 2);
+    used = block.size();
+    block.resize(block_size + max_record_size);
+    writer = thread(&TraceRecorder::write_blocks, this);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    flush();
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+long TraceRecorder::run(Memory &mem, long cycles)
+{
+    switch (mem.get_quirks())
+    {
+        case QuirksProfile::Vip: return run_traced<VipQuirks>(mem, cycles);
+        case QuirksProfile::Schip: return run_traced<SchipQuirks>(mem, cycles);
+        case QuirksProfile::Xochip: return run_traced<XochipQuirks>(mem, cycles);
+        default: return run_traced<CowgodQuirks>(mem, cycles);
+    }
+}
+
+long TraceRecorder::run_frames(Memory &mem, long frames, int instructions_per_frame)
+{
+    long executed = 0;
+    for (long frame = 0; frame < frames && !mem.is_halted(); frame++)
+    {
+        executed += run(mem, instructions_per_frame);
+        mem.tick_timers();
+    }
+    return executed;
+}
+
+template <class Quirks>
+long TraceRecorder::run_traced(Memory &mem, long cycles)
+{
+    long i = 0;
+    for (; i < cycles && !mem.is_halted(); i++)
+    {
+        // Same as step(), keeping what the record needs from before
+        int pc = mem.get_program_counter();
+        int instruction = mem.mem_read(pc) << 8 | mem.mem_read(pc + 1);
+        int stored_address = mem.get_address_pointer();
+        mem.inc_program_counter();
+        mem.inc_cycle_count();
+        execute<Quirks>(instruction, mem);
+        record(mem, pc, instruction, stored_address, store_length(instruction));
+    }
+    return i;
+}
+
+// Encoded straight into the block, which always has room for one more
+// record past block_size
+void TraceRecorder::record(Memory &mem, int pc, int instruction, int stored_address, int stored_length)
+{
+    uint8_t *start = block.data() + used;
+    uint8_t *out = start + 1;
+    uint8_t flags = 0;
+
+    uint64_t cycle = mem.get_cycle_count();
+    if (cycle != last.cycle + 1)
+    {
+        flags |= has_gap;
+        out = put_varint(out, cycle - last.cycle - 1);
+    }
+    last.cycle = cycle;
+    if (pc != last.pc + 2)
+    {
+        flags |= has_jump;
+        out = put_varint(out, zigzag(pc - (last.pc + 2)));
+    }
+    last.pc = pc;
+    *out++ = instruction >> 8;
+    *out++ = instruction;
+
+    const int *registers = mem.register_data();
+    int mask = 0;
+    for (int i = 0; i < 16; i++)
+        mask |= (registers[i] != last.registers[i]) << i;
+    if (mask)
+    {
+        flags |= has_registers;
+        *out++ = mask;
+        *out++ = mask >> 8;
+        for (int i = 0; i < 16; i++)
+            if (mask >> i & 1)
+            {
+                out = put_varint(out, zigzag(registers[i]));
+                last.registers[i] = registers[i];
+            }
+    }
+
+    int address_pointer = mem.get_address_pointer();
+    if (address_pointer != last.address_pointer)
+    {
+        flags |= has_i;
+        out = put_varint(out, (uint32_t) address_pointer);
+        last.address_pointer = address_pointer;
+    }
+
+    if (stored_length)
+    {
+        flags |= has_memory;
+        out = put_varint(out, stored_address);
+        out = put_varint(out, stored_length);
+        for (int i = 0; i < stored_length; i++)
+            *out++ = mem.mem_read(stored_address + i);
+    }
+
+    int stack_pointer = mem.get_stack_pointer();
+    if (stack_pointer != last.stack_pointer)
+    {
+        flags |= has_sp;
+        out = put_varint(out, stack_pointer);
+        last.stack_pointer = stack_pointer;
+    }
+
+    int delay = mem.get_delay_timer();
+    int sound = mem.get_sound_timer();
+    if (delay != last.delay_timer || sound != last.sound_timer)
+    {
+        flags |= has_timers;
+        out = put_varint(out, zigzag(delay));
+        out = put_varint(out, zigzag(sound));
+        last.delay_timer = delay;
+        last.sound_timer = sound;
+    }
+
+    *start = flags;
+    used = out - block.data();
+    records++;
+    if (used >= block_size)
+        hand_over();
+}
+
+// Queue the current block for the writer and start a fresh one, waiting
+// only when the writer is max_blocks behind
+void TraceRecorder::hand_over()
+{
+    block.resize(used);
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [this] { return (int) full.size() < max_blocks; });
+    full.push_back(move(block));
+    if (spare.empty())
+        block = vector<uint8_t>();
+    else
+    {
+        block = move(spare.back());
+        spare.pop_back();
+    }
+    block.resize(block_size + max_record_size);
+    used = 0;
+    guard.unlock();
+    changed.notify_all();
+}
+
+void TraceRecorder::write_blocks()
+{
+    unique_lock<mutex> guard(lock);
+    while (true)
+    {
+        changed.wait(guard, [this] { return !full.empty() || stopping; });
+        if (full.empty())
+            return;
+        vector<uint8_t> data = move(full.front());
+        full.pop_front();
+        writing = true;
+        guard.unlock();
+
+        out.write((const char *) data.data(), data.size());
+
+        guard.lock();
+        writing = false;
+        spare.push_back(move(data));
+        changed.notify_all();
+    }
+}
+
+void TraceRecorder::flush()
+{
+    if (used)
+        hand_over();
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [this] { return full.empty() && !writing; });
+    out.flush();
+}
+
+uint64_t TraceRecorder::get_record_count() { return records; }
+
+
+/* Reading */
+
+TraceReader::TraceReader(istream &in) : in(in)
+{
+    if (fill(6))
+        valid = equal(trace_magic, trace_magic + 4, buffer.begin())
+             && get_uint(buffer.data() + 4, 2) == trace_version;
+    position = 6;
+}
+
+bool TraceReader::is_valid() { return valid; }
+
+// Have at least needed unread bytes buffered, if the stream has them
+bool TraceReader::fill(size_t needed)
+{
+    if (buffer.size() - position >= needed)
+        return true;
+    buffer.erase(buffer.begin(), buffer.begin() + position);
+    position = 0;
+    size_t have = buffer.size();
+    size_t want = max(needed, (size_t) 1 << 16);
+    buffer.resize(have + want);
+    in.read((char *) buffer.data() + have, want);
+    buffer.resize(have + in.gcount());
+    return buffer.size() >= needed;
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    if (!valid)
+        return false;
+    fill(max_record_size);
+    if (position >= buffer.size())
+        return false;
+
+    const uint8_t *data = buffer.data();
+    size_t size = buffer.size();
+    size_t pos = position;
+    uint64_t value;
+    uint8_t flags = data[pos++];
+    TraceRecord next = state;
+    next.changed = 0;
+    next.memory.clear();
+
+    next.cycle = state.cycle + 1;
+    if (flags & has_gap)
+    {
+        if (!get_varint(data, size, pos, value))
+            return valid = false;
+        next.cycle += value;
+    }
+    next.pc = state.pc + 2;
+    if (flags & has_jump)
+    {
+        if (!get_varint(data, size, pos, value))
+            return valid = false;
+        next.pc += unzigzag(value);
+    }
+    if (pos + 2 > size)
+        return valid = false;
+    next.instruction = data[pos] << 8 | data[pos + 1];
+    pos += 2;
+
+    if (flags & has_registers)
+    {
+        if (pos + 2 > size)
+            return valid = false;
+        int mask = get_uint(data + pos, 2);
+        pos += 2;
+        for (int i = 0; i < 16; i++)
+            if (mask >> i & 1)
+            {
+                if (!get_varint(data, size, pos, value))
+                    return valid = false;
+                next.registers[i] = unzigzag(value);
+            }
+        next.changed |= mask;
+    }
+    if (flags & has_i)
+    {
+        if (!get_varint(data, size, pos, value))
+            return valid = false;
+        next.address_pointer = (int) value;
+        next.changed |= TraceRecord::changed_i;
+    }
+    if (flags & has_memory)
+    {
+        uint64_t address, length;
+        if (!get_varint(data, size, pos, address) || !get_varint(data, size, pos, length)
+            || length > size - pos)
+            return valid = false;
+        next.memory_address = address;
+        next.memory.assign(data + pos, data + pos + length);
+        pos += length;
+        next.changed |= TraceRecord::changed_memory;
+    }
+    if (flags & has_sp)
+    {
+        if (!get_varint(data, size, pos, value))
+            return valid = false;
+        next.stack_pointer = value;
+        next.changed |= TraceRecord::changed_sp;
+    }
+    if (flags & has_timers)
+    {
+        uint64_t sound;
+        if (!get_varint(data, size, pos, value) || !get_varint(data, size, pos, sound))
+            return valid = false;
+        next.delay_timer = unzigzag(value);
+        next.sound_timer = unzigzag(sound);
+        next.changed |= TraceRecord::changed_timers;
+    }
+
+    position = pos;
+    state = next;
+    record = next;
+    return true;
+}
+
+
+/* Formatting */
+
+string format_trace_record(const TraceRecord &record)
+{
+    char text[64];
+    snprintf(text, sizeof text, "%10llu  %04X  %04X  %-20s",
+             (unsigned long long) record.cycle, record.pc, record.instruction,
+             disassemble(record.instruction).c_str());
+    string line = text;
+
+    for (int i = 0; i < 16; i++)
+        if (record.changed >> i & 1)
+        {
+            snprintf(text, sizeof text, " V%X=%02X", i, record.registers[i] & 0xFF);
+            line += text;
+        }
+    if (record.changed & TraceRecord::changed_i)
+    {
+        snprintf(text, sizeof text, " I=%03X", record.address_pointer);
+        line += text;
+    }
+    if (record.changed & TraceRecord::changed_memory)
+    {
+        snprintf(text, sizeof text, " [%03X]=", record.memory_address);
+        line += text;
+        for (uint8_t byte : record.memory)
+        {
+            snprintf(text, sizeof text, "%02X", byte);
+            line += text;
+        }
+    }
+    if (record.changed & TraceRecord::changed_sp)
+    {
+        snprintf(text, sizeof text, " SP=%d", record.stack_pointer);
+        line += text;
+    }
+    if (record.changed & TraceRecord::changed_timers)
+    {
+        snprintf(text, sizeof text, " DT=%d ST=%d", record.delay_timer, record.sound_timer);
+        line += text;
+    }
+    return line;
+}
@@ -0,0 +1,122 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include "Memory.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Instruction trace format (integers little endian or varints)
+//
+//   header   "C8TR" u16 version
+//   records  one per instruction, back to back
+//
+// A record holds what changed since the previous one (the first against
+// an all-zero machine), so timer ticks and other changes between
+// instructions show up on the next record:
+//
+//   u8 flags     1 cycle gap, 2 PC jump, 4 registers, 8 I, 16 memory,
+//                32 stack pointer, 64 timers
+//   gap          varint cycles skipped, when the cycle isn't the last + 1
+//   jump         zigzag varint PC - (last PC + 2), when the PC isn't that
+//   instruction  two bytes, as they were in memory
+//   registers    u16 mask of changed V registers, zigzag varint each value
+//   I            varint
+//   memory       varint address, varint length, bytes stored
+//   SP           varint
+//   timers       zigzag varint delay, zigzag varint sound
+
+// A machine's state right after an instruction, and what it changed
+struct TraceRecord
+{
+    // Bits of changed
+    static constexpr uint32_t changed_i = 1 << 16;
+    static constexpr uint32_t changed_sp = 1 << 17;
+    static constexpr uint32_t changed_timers = 1 << 18;
+    static constexpr uint32_t changed_memory = 1 << 19;
+
+    uint64_t cycle = 0;     // Cycle count after the instruction
+    int pc = 0;             // Where the instruction was
+    int instruction = 0;
+    int registers[16] {};
+    int address_pointer = 0;
+    int stack_pointer = 0;
+    int delay_timer = 0;
+    int sound_timer = 0;
+    uint32_t changed = 0;   // Bit n for Vn, then the bits above
+    int memory_address = 0;
+    std::vector<uint8_t> memory;  // Bytes stored at memory_address
+};
+
+// Records every instruction a machine runs. Records are encoded into
+// blocks on the machine's thread and a writer thread of its own drains
+// full blocks to the stream, so the interpreter never waits on I/O unless
+// all the blocks are full.
+class TraceRecorder
+{
+public:
+    explicit TraceRecorder(std::ostream &out, size_t block_size = 1 << 16, int max_blocks = 16);
+    ~TraceRecorder();
+
+    // Like run() and run_frames(), recording each instruction, the one
+    // that halts the machine included
+    long run(Memory &mem, long cycles);
+    long run_frames(Memory &mem, long frames, int instructions_per_frame);
+
+    // Write out everything recorded so far
+    void flush();
+    uint64_t get_record_count();
+
+private:
+    template <class Quirks> long run_traced(Memory &mem, long cycles);
+    void record(Memory &mem, int pc, int instruction, int stored_address, int stored_length);
+    void hand_over();
+    void write_blocks();
+
+    std::ostream &out;
+    size_t block_size;
+    int max_blocks;
+    uint64_t records = 0;
+    TraceRecord last;
+
+    // Block being filled, and full ones waiting for the writer
+    std::vector<uint8_t> block;
+    size_t used = 0;
+    std::deque<std::vector<uint8_t>> full;
+    std::vector<std::vector<uint8_t>> spare;
+    bool writing = false;
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread writer;
+};
+
+// Reads a trace back, record by record
+class TraceReader
+{
+public:
+    explicit TraceReader(std::istream &in);
+    bool is_valid();
+
+    // Next record, false at the end or on a damaged record
+    bool next(TraceRecord &record);
+
+private:
+    bool fill(size_t needed);
+
+    std::istream &in;
+    bool valid = false;
+    std::vector<uint8_t> buffer;
+    size_t position = 0;
+    TraceRecord state;
+};
+
+// Text form of a record: cycle, PC, instruction, mnemonic and changes
+std::string format_trace_record(const TraceRecord &record);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <atomic>
+
+// Hands values from one producer thread to one consumer thread without
+// locks. The producer fills back() and publishes it; the consumer picks
+// up the newest published value with update() and reads front(). Each
+// side owns one of the three buffers and they swap the third through a
+// single atomic, so neither ever waits on or tears the other's buffer.
+// Values published between two updates are dropped, only the newest is seen.
+template <class T>
+class TripleBuffer
+{
+public:
+    // Producer side
+    T &back() { return buffers[back_index]; }
+    void publish()
+    {
+        int previous = middle.exchange(back_index | fresh, std::memory_order_acq_rel);
+        back_index = previous & index_mask;
+    }
+
+    // Consumer side, true if a newer value was published since the last update
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        int previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & index_mask;
+        return true;
+    }
+    const T &front() const { return buffers[front_index]; }
+
+private:
+    static const int index_mask = 3;
+    static const int fresh = 4;
+
+    T buffers[3] {};
+    int back_index = 0;
+    int front_index = 1;
+    std::atomic<int> middle {2};
+};
+
+#endif
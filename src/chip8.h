@@ -0,0 +1,122 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface to the emulator core, for embedding from other languages.
+ *
+ * Machines and snapshots are opaque handles. Only the create functions
+ * allocate once warmed up; everything else works in place, and the run
+ * and key calls take batches so one call can drive a whole fleet of
+ * machines. (Machines share RAM with their snapshots a 256-byte page at
+ * a time and copy a page on its first write. Saving and restoring copy
+ * into pages already copied, so that only happens in the first rounds.)
+ * Functions returning int return CHIP8_OK or a negative chip8_status.
+ * A handle may only be used by one thread at a time.
+ */
+
+#if defined(_WIN32) && defined(CHIP8_SHARED)
+#  ifdef CHIP8_BUILDING
+#    define CHIP8_API __declspec(dllexport)
+#  else
+#    define CHIP8_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define CHIP8_API __attribute__((visibility("default")))
+#else
+#  define CHIP8_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped on any incompatible change to this header */
+#define CHIP8_ABI_VERSION 1
+
+typedef struct chip8_machine chip8_machine;
+typedef struct chip8_snapshot chip8_snapshot;
+
+enum chip8_quirks
+{
+    CHIP8_QUIRKS_COWGOD = 0,
+    CHIP8_QUIRKS_VIP = 1,
+    CHIP8_QUIRKS_SCHIP = 2,
+    CHIP8_QUIRKS_XOCHIP = 3
+};
+
+/* Why a machine halted; halted machines don't run until resumed */
+enum chip8_fault
+{
+    CHIP8_FAULT_NONE = 0,
+    CHIP8_FAULT_EXIT = 1,              /* 00FD */
+    CHIP8_FAULT_STACK_OVERFLOW = 2,
+    CHIP8_FAULT_STACK_UNDERFLOW = 3,
+    CHIP8_FAULT_INVALID_OPCODE = 4
+};
+
+enum chip8_status
+{
+    CHIP8_OK = 0,
+    CHIP8_ERROR_ARGUMENT = -1,   /* Null handle, bad size or mismatched snapshot */
+    CHIP8_ERROR_ROM_SIZE = -2,   /* ROM doesn't fit above 0x200 */
+    CHIP8_ERROR_MEMORY = -3      /* Out of memory copying a RAM page; the
+                                    machine or snapshot stops part way */
+};
+
+CHIP8_API uint32_t chip8_abi_version(void);
+
+/* Machines, NULL for an unknown profile or out of memory */
+CHIP8_API chip8_machine *chip8_create(int quirks);
+CHIP8_API void chip8_destroy(chip8_machine *machine);
+CHIP8_API int chip8_load_rom(chip8_machine *machine, const uint8_t *rom, size_t length);
+
+/* Run each machine for a number of instructions, or of frames of
+   instructions_per_frame instructions with the timers ticked after each.
+   A machine that halts stops where it is; the others carry on. */
+CHIP8_API int chip8_run_cycles(chip8_machine *const *machines, size_t count, int64_t cycles);
+CHIP8_API int chip8_run_frames(chip8_machine *const *machines, size_t count,
+                               int64_t frames, int instructions_per_frame);
+
+/* Keypad masks, bit n is key n held down, one per machine */
+CHIP8_API int chip8_set_keys(chip8_machine *const *machines, size_t count, const uint16_t *keys);
+
+/* Screen as 2 planes x 128 words, row n at words 2n and 2n + 1, bit 63
+   of a word is its leftmost pixel. Points into the machine, valid until
+   it's destroyed. Width is 64 or 128, height 32 or 64. */
+CHIP8_API const uint64_t *chip8_framebuffer(const chip8_machine *machine);
+CHIP8_API int chip8_screen_width(const chip8_machine *machine);
+CHIP8_API int chip8_screen_height(const chip8_machine *machine);
+
+/* RAM (4 KB, 64 KB for XO-CHIP), writable in place, NULL when out of
+   memory to give the machine its own contiguous copy */
+CHIP8_API uint8_t *chip8_ram(chip8_machine *machine);
+CHIP8_API size_t chip8_ram_size(const chip8_machine *machine);
+CHIP8_API uint64_t chip8_cycle_count(const chip8_machine *machine);
+
+/* 64-bit fingerprint of the whole machine state (not keys or cycle
+   count), kept up to date as it runs. Writes through chip8_ram() or
+   chip8_framebuffer() aren't seen by it. */
+CHIP8_API uint64_t chip8_state_hash(const chip8_machine *machine);
+
+/* A chip8_fault, with where the halting instruction was and what it was
+   (either pointer may be NULL). Resuming runs that instruction again, so
+   fix the cause or move the program counter first. */
+CHIP8_API int chip8_halt_reason(const chip8_machine *machine, uint16_t *pc, uint16_t *instruction);
+CHIP8_API int chip8_resume(chip8_machine *machine);
+
+/* Snapshots hold a whole machine. Saving into and restoring from an
+   existing snapshot of the same machine type doesn't allocate, and nor
+   does running afterwards once the machine has its own copy of each
+   page it writes. */
+CHIP8_API chip8_snapshot *chip8_snapshot_create(const chip8_machine *machine);
+CHIP8_API void chip8_snapshot_destroy(chip8_snapshot *snapshot);
+CHIP8_API int chip8_snapshot_save(const chip8_machine *machine, chip8_snapshot *snapshot);
+CHIP8_API int chip8_snapshot_restore(chip8_machine *machine, const chip8_snapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
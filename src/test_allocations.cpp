@@ -0,0 +1,72 @@
+// Global allocation replaced for the tests, counting every allocation so
+// they can check paths that mustn't allocate, and failing them all while
+// failing_allocations is set. It lives apart from the tests so the
+// compiler never sees these bodies at a call site.
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+atomic<long> allocations {0};
+atomic<bool> failing_allocations {false};
+
+static void *allocate(size_t size)
+{
+    allocations++;
+    if (failing_allocations)
+        throw bad_alloc();
+    if (void *memory = malloc(size ? size : 1))
+        return memory;
+    throw bad_alloc();
+}
+
+static void *allocate(size_t size, align_val_t alignment)
+{
+    allocations++;
+    if (failing_allocations)
+        throw bad_alloc();
+    size_t align = static_cast<size_t>(alignment);
+    if (align < sizeof(void*))
+        align = sizeof(void*);
+    // aligned_alloc wants a multiple of the alignment
+    size = (size + align - 1) / align * align;
+    if (void *memory = aligned_alloc(align, size ? size : align))
+        return memory;
+    throw bad_alloc();
+}
+
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, align_val_t alignment) { return allocate(size, alignment); }
+void *operator new[](size_t size, align_val_t alignment) { return allocate(size, alignment); }
+
+void *operator new(size_t size, const nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (const bad_alloc&) { return nullptr; }
+}
+void *operator new[](size_t size, const nothrow_t&) noexcept
+{
+    try { return allocate(size); } catch (const bad_alloc&) { return nullptr; }
+}
+void *operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    try { return allocate(size, alignment); } catch (const bad_alloc&) { return nullptr; }
+}
+void *operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    try { return allocate(size, alignment); } catch (const bad_alloc&) { return nullptr; }
+}
+
+// malloc and aligned_alloc both hand back memory free() takes
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+void operator delete(void *memory, align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, align_val_t) noexcept { free(memory); }
+void operator delete(void *memory, size_t, align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t, align_val_t) noexcept { free(memory); }
+void operator delete(void *memory, const nothrow_t&) noexcept { free(memory); }
+void operator delete[](void *memory, const nothrow_t&) noexcept { free(memory); }
+void operator delete(void *memory, align_val_t, const nothrow_t&) noexcept { free(memory); }
+void operator delete[](void *memory, align_val_t, const nothrow_t&) noexcept { free(memory); }
@@ -1,11 +1,39 @@
 #define CATCH_CONFIG_MAIN
-#include <catch2/catch.hpp>
+#include "catch.hpp"
 #include "Memory.h"
 #include "Cpu.h"
+#include "chip8.h"
+#include "Debugger.h"
+#include "Disassembler.h"
+#include "Environment.h"
+#include "Explorer.h"
+#include "FrameExchange.h"
+#include "Frontend.h"
+#include "GdbServer.h"
+#include "Golden.h"
+#include "Image.h"
+#include "Opcodes.h"
+#include "Recompiler.h"
+#include "Recorder.h"
+#include "SharedFramebuffer.h"
+#include "Timing.h"
+#include "Trace.h"
+#include <array>
+#include <atomic>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 using namespace std;
 
+// Every allocation the tests make, and a switch making them all fail
+// (test_allocations.cpp)
+extern atomic<long> allocations;
+extern atomic<bool> failing_allocations;
+
 
 TEST_CASE( "CHIP-8 Memory" )
 {
@@ -38,8 +66,2050 @@ TEST_CASE( "CHIP-8 Memory" )
         memo.set_key(0xC, 0);
         REQUIRE( memo.get_key(0xC) == 0);
     }
+    SECTION( "raw storage" )
+    {
+        uint8_t *ram = memo.ram_data();
+        int *registers = memo.register_data();
+        uint64_t *screen = memo.screen_data();
+        REQUIRE( ram[79] == 0x80 );
+
+        ram[0x600] = 7;
+        registers[0xA] = 3;
+        memo.screen_write(64 * 2 + 1, 1);
+        REQUIRE( memo.mem_read(0x600) == 7 );
+        REQUIRE( memo.reg_read(0xA) == 3 );
+        REQUIRE( screen[2 * 2] == 1ull << 62 );
+
+        // Restoring a copy keeps the same storage
+        Memory saved = memo;
+        memo.mem_write(0x600, 8);
+        memo = saved;
+        REQUIRE( memo.ram_data() == ram );
+        REQUIRE( ram[0x600] == 7 );
+    }
+}
+
+
+TEST_CASE( "CHIP-8 Keypad" )
+{
+    Memory mem = Memory();
+
+    // Host keys map onto the hex keypad, unmapped chars are -1
+    REQUIRE( key_for_char('1') == 0x1 );
+    REQUIRE( key_for_char('4') == 0xC );
+    REQUIRE( key_for_char('W') == 0x5 );
+    REQUIRE( key_for_char('w') == 0x5 );
+    REQUIRE( key_for_char('X') == 0x0 );
+    REQUIRE( key_for_char('V') == 0xF );
+    REQUIRE( key_for_char('P') == -1 );
+
+    // Whole pad published with one store
+    mem.set_keys(0x8001);
+    REQUIRE( mem.get_key(0x0) == 1 );
+    REQUIRE( mem.get_key(0xF) == 1 );
+    REQUIRE( mem.get_key(0x7) == 0 );
+    mem.set_key(0x7, 1);
+    REQUIRE( mem.get_keys() == 0x8081 );
+
+    // Input thread feeding a machine
+    thread input([&mem]() {
+        for (int i = 0; i < 1000; i++)
+            mem.flip_key(0x3);
+        mem.set_key(0x3, 1);
+    });
+    input.join();
+    REQUIRE( mem.get_key(0x3) == 1 );
+    REQUIRE( mem.get_keys() == 0x8089 );
+
+    // Copies take a snapshot of the pad
+    Memory copy = mem;
+    mem.set_keys(0);
+    REQUIRE( copy.get_keys() == 0x8089 );
+}
+
+
+TEST_CASE( "RAM pages" )
+{
+    // Only the fonts are written, the rest is the shared zero page
+    Memory mem;
+    REQUIRE( mem.private_ram_pages() == 2 );
+    Memory xo(0x10000);
+    REQUIRE( xo.private_ram_pages() == 2 );
+
+    // Copies share every page until one of them writes
+    vector<uint8_t> rom(0x400, 0x12);
+    mem.load_rom(rom);
+    REQUIRE( mem.private_ram_pages() == 6 );
+    vector<Memory> fleet(100, mem);
+    REQUIRE( mem.private_ram_pages() == 0 );
+    REQUIRE( fleet[0].private_ram_pages() == 0 );
+
+    fleet[0].mem_write(0x300, 0x34);
+    fleet[0].mem_write(0x3FF, 0x56);
+    REQUIRE( fleet[0].private_ram_pages() == 1 );
+    REQUIRE( fleet[0].mem_read(0x300) == 0x34 );
+    REQUIRE( fleet[0].mem_read(0x301) == 0x12 );
+    REQUIRE( fleet[1].mem_read(0x300) == 0x12 );
+    REQUIRE( mem.mem_read(0x3FF) == 0x12 );
+
+    // Once all copies are gone the page is private again
+    fleet.clear();
+    REQUIRE( mem.private_ram_pages() == 6 );
+
+    // Assigning over a machine copies into the pages it has to itself
+    {
+        Memory restored = mem;
+        restored.mem_write(0x300, 0x34);
+        restored = mem;
+        REQUIRE( restored.private_ram_pages() == 1 );
+        REQUIRE( restored.mem_read(0x300) == 0x12 );
+        REQUIRE( mem.private_ram_pages() == 1 );
+    }
+
+    // Copies written from several threads stay separate
+    vector<Memory> machines(4, mem);
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&machines, t]() {
+            for (int address = 0x200; address < 0x600; address++)
+                machines[t].mem_write(address, t);
+        });
+    for (auto &writer : threads)
+        writer.join();
+    for (int t = 0; t < 4; t++)
+        REQUIRE( machines[t].mem_read(0x5FF) == t );
+    REQUIRE( mem.mem_read(0x5FF) == 0x12 );
+
+    // Blocks that wrap past the end of memory
+    uint8_t block[] = {1, 2, 3, 4};
+    Memory wrapped = mem;
+    wrapped.mem_write_block(0xFFE, block, 4);
+    uint8_t back[4];
+    wrapped.mem_read_block(0xFFE, back, 4);
+    REQUIRE( back[3] == 4 );
+    REQUIRE( wrapped.mem_read(1) == 4 );
+    REQUIRE( mem.mem_read(1) == 0x90 );
+    REQUIRE( wrapped.get_state_hash() == wrapped.compute_state_hash() );
+
+    // Block writes unshare only the pages they touch
+    vector<uint8_t> patch(300, 0x77);
+    Memory patched = mem;
+    patched.mem_write_block(0x3F0, patch.data(), patch.size());
+    REQUIRE( patched.private_ram_pages() == 3 );
+    REQUIRE( patched.mem_read(0x3EF) == 0x12 );
+    REQUIRE( patched.mem_read(0x3F0) == 0x77 );
+    REQUIRE( patched.mem_read(0x51B) == 0x77 );
+    REQUIRE( patched.mem_read(0x51C) == 0x12 );
+    REQUIRE( mem.mem_read(0x3F0) == 0x12 );
+    REQUIRE( patched.get_state_hash() == patched.compute_state_hash() );
+
+    // Flat storage copies out to pages and back in place
+    uint8_t *ram = wrapped.ram_data();
+    REQUIRE( wrapped.private_ram_pages() == 16 );
+    Memory copy = wrapped;
+    ram[0x200] = 9;
+    REQUIRE( copy.mem_read(0x200) == 0x12 );
+    wrapped = copy;
+    REQUIRE( wrapped.ram_data() == ram );
+    REQUIRE( ram[0x200] == 0x12 );
+
+    // Saving, running and restoring stops allocating once the pages given
+    // up have been recycled, whether or not the machine is flat:
+    // 200: A300  LD I, 0x300     206: FF55  LD [I], V0 - VF
+    // 202: FF55  LD [I], V0 - VF 208: A500  LD I, 0x500
+    // 204: A400  LD I, 0x400     20A: FF55  LD [I], V0 - VF
+    //                            20C: 1200  JP 0x200
+    const uint8_t stores[] = {0xA3, 0x00, 0xFF, 0x55, 0xA4, 0x00, 0xFF, 0x55, 0xA5, 0x00, 0xFF, 0x55, 0x12, 0x00};
+    for (bool flat : {false, true})
+    {
+        chip8_machine *machine = chip8_create(CHIP8_QUIRKS_COWGOD);
+        chip8_load_rom(machine, stores, sizeof stores);
+        if (flat)
+            chip8_ram(machine);
+        chip8_snapshot *snapshot = chip8_snapshot_create(machine);
+        long before = 0;
+        for (int round = 0; round < 10; round++)
+        {
+            if (round == 3)
+                before = allocations;
+            REQUIRE( chip8_snapshot_save(machine, snapshot) == CHIP8_OK );
+            REQUIRE( chip8_run_cycles(&machine, 1, 7) == CHIP8_OK );
+            REQUIRE( chip8_snapshot_restore(machine, snapshot) == CHIP8_OK );
+            REQUIRE( chip8_run_cycles(&machine, 1, 7) == CHIP8_OK );
+        }
+        REQUIRE( allocations == before );
+        chip8_snapshot_destroy(snapshot);
+        chip8_destroy(machine);
+    }
+}
+
+
+TEST_CASE( "CHIP-8 Screen" )
+{
+    Memory mem = Memory();
+    ostringstream out;
+
+    // Blank screen, nothing to send
+    REQUIRE( mem.get_dirty_rows() == 0 );
+    REQUIRE( draw_dirty_rows(mem, out) == 0 );
+    REQUIRE( out.str().empty() );
+
+    // Single pixels mark their row and column
+    mem.screen_write(64 * 3 + 5, 1);
+    REQUIRE( mem.screen_read(64 * 3 + 5) == 1 );
+    REQUIRE( mem.get_dirty_rows() == 1ull << 3 );
+    REQUIRE( mem.get_dirty_columns() == 1ull << (63 - 5) );
+    REQUIRE( draw_dirty_rows(mem, out) == 1 );
+    REQUIRE( out.str().substr(0, 8) == "3|XXXXX " );
+    REQUIRE( mem.get_dirty_rows() == 0 );
+
+    // Rewriting the same value is not a change
+    mem.screen_write(64 * 3 + 5, 1);
+    REQUIRE( mem.get_dirty_rows() == 0 );
+
+    SECTION( "sprites mark only the rows they touch" )
+    {
+        mem.mem_write(0x500, 0xFF);
+        mem.mem_write(0x501, 0x81);
+        mem.set_address_pointer(0x500);
+        mem.reg_write(0x0, 60);
+        mem.reg_write(0x1, 31);
+        REQUIRE( execute(0xD012, mem) == 0xD000 );
+
+        // Wraps to the left edge and the top row
+        REQUIRE( mem.get_dirty_rows() == ((1ull << 31) | 1ull) );
+        REQUIRE( mem.screen_row(31) == 0xF00000000000000Full );
+        REQUIRE( mem.screen_row(0) == 0x1000000000000008ull );
+
+        // Drawing the same sprite again erases it
+        mem.clear_dirty();
+        REQUIRE( execute(0xD012, mem) == 0xD000 );
+        REQUIRE( mem.screen_row(31) == 0 );
+        REQUIRE( mem.get_dirty_rows() == ((1ull << 31) | 1ull) );
+    }
+    SECTION( "clearing marks only rows that had pixels" )
+    {
+        REQUIRE( execute(0x00E0, mem) == 0x00E0 );
+        REQUIRE( mem.get_dirty_rows() == 1ull << 3 );
+        mem.clear_dirty();
+        REQUIRE( execute(0x00E0, mem) == 0x00E0 );
+        REQUIRE( mem.get_dirty_rows() == 0 );
+    }
+}
+
+
+TEST_CASE( "CHIP-8 Recorder" )
+{
+    Memory mem = Memory();
+    stringstream video;
+    vector<Frame> expected;
+
+    // Record 25 frames of a sprite moving across the screen, with
+    // keyframes every 10 frames
+    {
+        Recorder recorder(video, 10);
+        mem.mem_write(0x500, 0xF0);
+        mem.mem_write(0x501, 0x90);
+        mem.set_address_pointer(0x500);
+        for (int i = 0; i < 25; i++)
+        {
+            if (i % 3 == 0)
+            {
+                mem.reg_write(0x0, i * 2);
+                mem.reg_write(0x1, i);
+                execute(0xD012, mem);
+            }
+            recorder.capture(mem);
+
+            Frame frame;
+            for (int row = 0; row < 32; row++)
+                for (int shift = 56; shift >= 0; shift -= 8)
+                    frame.push_back(mem.screen_row(row) >> shift);
+            expected.push_back(frame);
+        }
+        REQUIRE( recorder.get_frame_count() == 25 );
+    }
+
+    // Unchanged frames cost a byte
+    REQUIRE( video.str().size() < 25 * 30 );
+
+    Playback playback(video);
+    REQUIRE( playback.is_valid() );
+    REQUIRE( playback.get_frame_count() == 25 );
+    REQUIRE( playback.get_width() == 64 );
+    REQUIRE( playback.get_height() == 32 );
+
+    // Sequential and random access decode the same frames
+    Frame frame;
+    for (int i = 0; i < 25; i++)
+    {
+        REQUIRE( playback.read_frame(i, frame) );
+        REQUIRE( frame == expected[i] );
+    }
+    for (int i : {17, 3, 24, 10, 9, 0})
+    {
+        REQUIRE( playback.read_frame(i, frame) );
+        REQUIRE( frame == expected[i] );
+    }
+    REQUIRE( !playback.read_frame(25, frame) );
+
+    // Exported images
+    stringstream png, gif;
+    REQUIRE( export_png(playback, png, 12) );
+    REQUIRE( png.str().substr(1, 3) == "PNG" );
+    export_gif(playback, gif, 0, 24);
+    REQUIRE( gif.str().substr(0, 6) == "GIF89a" );
+    REQUIRE( gif.str().back() == 0x3B );
+
+    // High resolution recordings double low resolution pixels
+    stringstream hires_video;
+    {
+        Recorder recorder(hires_video, 10, true);
+        Memory lores = Memory();
+        lores.screen_write(64 * 1 + 3, 1);
+        recorder.capture(lores);
+    }
+    Playback hires_playback(hires_video);
+    REQUIRE( hires_playback.get_width() == 128 );
+    REQUIRE( hires_playback.read_frame(0, frame) );
+    REQUIRE( frame.size() == 1024 );
+    REQUIRE( frame[2 * 16] == 0x03 );
+    REQUIRE( frame[3 * 16] == 0x03 );
+    REQUIRE( frame[2 * 16 + 1] == 0x00 );
+}
+
+
+TEST_CASE( "CHIP-8 Screen hash" )
+{
+    Memory mem = Memory();
+
+    // Blank screen hashes to zero
+    REQUIRE( mem.get_screen_hash() == 0 );
+
+    // Incremental hash matches a full rehash after every draw
+    for (int i = 0; i < 16; i++)
+        mem.mem_write(0x500 + i, i * 37 + 11);
+    mem.set_address_pointer(0x500);
+    uint64_t first_hash = 0;
+    for (int i = 0; i < 40; i++)
+    {
+        mem.reg_write(0x0, i * 7);
+        mem.reg_write(0x1, i * 3);
+        execute(0xD01F, mem);
+        REQUIRE( mem.get_screen_hash() == mem.compute_screen_hash() );
+        if (i == 0)
+            first_hash = mem.get_screen_hash();
+    }
+    REQUIRE( mem.get_screen_hash() != first_hash );
+
+    // Same pixels, same hash
+    Memory other = Memory();
+    other.screen_write(100, 1);
+    mem.screen_clear();
+    mem.screen_write(100, 1);
+    REQUIRE( mem.get_screen_hash() == other.get_screen_hash() );
+    REQUIRE( mem.get_screen_hash() != 0 );
+
+    // Clearing returns to the blank hash
+    execute(0x00E0, mem);
+    REQUIRE( mem.get_screen_hash() == 0 );
+}
+
+
+TEST_CASE( "CHIP-8 State hash" )
+{
+    Memory mem = Memory();
+    Memory fresh = Memory();
+    REQUIRE( mem.get_state_hash() == mem.compute_state_hash() );
+
+    // Every setter keeps it up to date, and undoing a change undoes the hash
+    uint64_t start = mem.get_state_hash();
+    vector<function<void(Memory &)>> changes = {
+        [](Memory &m) { m.set_address_pointer(0x123); },
+        [](Memory &m) { m.stack_push(0x456); },
+        [](Memory &m) { m.set_stack_pointer(3); },
+        [](Memory &m) { m.set_delay_timer(60); },
+        [](Memory &m) { m.set_sound_timer(2); },
+        [](Memory &m) { m.set_random_seed(99); },
+        [](Memory &m) { m.random_byte(); },
+        [](Memory &m) { m.set_hires(true); },
+        [](Memory &m) { m.set_planes(2); },
+        [](Memory &m) { m.set_pitch(100); },
+        [](Memory &m) { m.rpl_write(4, 9); },
+        [](Memory &m) { m.audio_pattern_write(15, 0xAA); },
+        [](Memory &m) { m.set_program_counter(0x400); },
+    };
+    for (auto &change : changes)
+    {
+        Memory changed = fresh;
+        change(changed);
+        REQUIRE( changed.get_state_hash() != start );
+        REQUIRE( changed.get_state_hash() == changed.compute_state_hash() );
+    }
+    mem.stack_push(0x300);
+    mem.stack_pop();
+    mem.set_delay_timer(1);
+    mem.tick_timers();
+    mem.set_delay_timer(-1);
+    REQUIRE( mem.get_state_hash() == start );
+
+    // Running programs, checked against a full rehash every frame
+    for (QuirksProfile quirks : {QuirksProfile::Cowgod, QuirksProfile::Xochip})
+        for (string rom : {"roms/PONG", "roms/test_opcode.ch8"})
+        {
+            Memory machine(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+            machine.set_quirks(quirks);
+            REQUIRE( machine.load_rom(rom) );
+            for (int frame = 0; frame < 300; frame++)
+            {
+                machine.set_keys(frame % 20 < 10 ? 1 << (frame / 20 % 16) : 0);
+                run_frames(machine, 1, 20);
+                REQUIRE( machine.get_state_hash() == machine.compute_state_hash() );
+            }
+        }
+
+    // A program stuck in a loop comes back to the same state:
+    // 200: 6000  LD V0, 0
+    // 202: 7001  ADD V0, 1
+    // 204: 3004  SE V0, 4
+    // 206: 1202  JP 0x202
+    // 208: 1200  JP 0x200
+    Memory loop;
+    loop.load_rom(vector<uint8_t>{0x60, 0x00, 0x70, 0x01, 0x30, 0x04, 0x12, 0x02, 0x12, 0x00});
+    run(loop, 1);
+    uint64_t seen = loop.get_state_hash();
+    long period = 0;
+    do
+    {
+        step(loop);
+        period++;
+    } while (loop.get_state_hash() != seen && period < 100);
+    REQUIRE( period == 13 );
+
+    // Through the C API
+    chip8_machine *machine = chip8_create(CHIP8_QUIRKS_COWGOD);
+    REQUIRE( chip8_state_hash(machine) == fresh.get_state_hash() );
+    chip8_destroy(machine);
+    REQUIRE( chip8_state_hash(nullptr) == 0 );
+}
+
+TEST_CASE( "CHIP-8 Golden trace" )
+{
+    // Draws random sprites in an endless loop:
+    //   200: A000  I = 0 (font)
+    //   202: C03F  V0 = rand & 0x3F
+    //   204: C11F  V1 = rand & 0x1F
+    //   206: D015  draw 5 rows at (V0, V1)
+    //   208: 1202  loop
+    vector<uint8_t> rom = {0xA0, 0x00, 0xC0, 0x3F, 0xC1, 0x1F, 0xD0, 0x15, 0x12, 0x02};
+
+    GoldenTrace trace;
+    trace.seed = 42;
+    for (uint64_t cycle : {1, 4, 50, 51, 1000})
+        trace.checks.push_back({cycle, 0});
+
+    Memory recorded = Memory();
+    REQUIRE( recorded.load_rom(rom) );
+    record_golden_trace(recorded, trace);
+    REQUIRE( trace.checks[0].hash == 0 );
+    REQUIRE( trace.checks[1].hash != 0 );
+    REQUIRE( recorded.get_cycle_count() == 1000 );
+
+    // Round trip through the text format
+    stringstream file;
+    write_golden_trace(file, trace);
+    GoldenTrace loaded;
+    REQUIRE( read_golden_trace(file, loaded) );
+    REQUIRE( loaded.seed == 42 );
+    REQUIRE( loaded.checks.size() == 5 );
+    REQUIRE( loaded.checks[4].hash == trace.checks[4].hash );
+
+    // A fresh machine reproduces the trace
+    Memory replay = Memory();
+    replay.load_rom(rom);
+    REQUIRE( verify_golden_trace(replay, loaded) == -1 );
+
+    // A wrong hash is reported with the actual value
+    loaded.checks[3].hash ^= 1;
+    Memory broken = Memory();
+    broken.load_rom(rom);
+    uint64_t actual = 0;
+    REQUIRE( verify_golden_trace(broken, loaded, &actual) == 3 );
+    REQUIRE( actual == trace.checks[3].hash );
+
+    // Halting before a check fails it even when the screen still matches,
+    // and a recording stops at the halt
+    //   200: A000  I = 0 (font)
+    //   202: D015  draw 5 rows at (V0, V1)
+    //   204: 00FD  exit
+    vector<uint8_t> exits = {0xA0, 0x00, 0xD0, 0x15, 0x00, 0xFD};
+    GoldenTrace early;
+    early.checks = {{2, 0}, {3, 0}, {100, 0}};
+    Memory exiting = Memory();
+    exiting.load_rom(exits);
+    record_golden_trace(exiting, early);
+    REQUIRE( early.checks.size() == 2 );
+    early.checks.push_back({100, early.checks[1].hash});
+    Memory halting = Memory();
+    halting.load_rom(exits);
+    REQUIRE( verify_golden_trace(halting, early) == 2 );
+    REQUIRE( halting.is_halted() );
+
+    // Malformed files are rejected
+    stringstream bad("ipf 10\n100 zz\n");
+    REQUIRE( !read_golden_trace(bad, loaded) );
+}
+
+
+TEST_CASE( "CHIP-8 Disassembler" )
+{
+    REQUIRE( disassemble(0x00E0) == "CLS" );
+    REQUIRE( disassemble(0x00EE) == "RET" );
+    REQUIRE( disassemble(0x1234) == "JP 0x234" );
+    REQUIRE( disassemble(0x3A1F) == "SE VA, 0x1F" );
+    REQUIRE( disassemble(0x8AB6) == "SHR VA, VB" );
+    REQUIRE( disassemble(0xB300) == "JP V0, 0x300" );
+    REQUIRE( disassemble(0xD125) == "DRW V1, V2, 5" );
+    REQUIRE( disassemble(0xF165) == "LD V1, [I]" );
+    REQUIRE( disassemble(0x8AB9) == "DW 0x8AB9" );
+    REQUIRE( disassemble(0xE1FF) == "DW 0xE1FF" );
+
+    //   200: 2208  CALL 0x208
+    //   202: 3000  SE V0, 0x00
+    //   204: 1200  JP 0x200
+    //   206: 1206  JP 0x206
+    //   208: A20E  LD I, 0x20E
+    //   20A: D011  DRW V0, V0, 1
+    //   20C: 00EE  RET
+    //   20E: 81    sprite
+    vector<uint8_t> rom = {
+        0x22, 0x08, 0x30, 0x00, 0x12, 0x00, 0x12, 0x06,
+        0xA2, 0x0E, 0xD0, 0x11, 0x00, 0xEE, 0x81,
+    };
+    ControlFlowGraph cfg(rom);
+
+    REQUIRE( cfg.blocks.size() == 5 );
+    REQUIRE( cfg.subroutines == set<int>{0x208} );
+    REQUIRE( cfg.data_references == set<int>{0x20E} );
+
+    // Call falls through to the return site
+    REQUIRE( cfg.blocks[0x200].successors == vector<int>{0x208, 0x202} );
+    // Skip has both outcomes
+    REQUIRE( cfg.blocks[0x202].successors == vector<int>{0x204, 0x206} );
+    REQUIRE( cfg.blocks[0x204].successors == vector<int>{0x200} );
+    REQUIRE( cfg.blocks[0x206].successors == vector<int>{0x206} );
+    REQUIRE( cfg.blocks[0x208].end == 0x20E );
+    REQUIRE( cfg.blocks[0x208].returns );
+
+    // Sprite byte is data
+    REQUIRE( cfg.is_code(0x20D) );
+    REQUIRE( !cfg.is_code(0x20E) );
+    REQUIRE( cfg.block_at(0x20A)->start == 0x208 );
+    REQUIRE( cfg.block_at(0x20E) == nullptr );
+
+    ostringstream listing;
+    write_listing(cfg, listing);
+    REQUIRE( listing.str().find("sub_208:") != string::npos );
+    REQUIRE( listing.str().find("data_20E:") != string::npos );
+    REQUIRE( listing.str().find("#......#") != string::npos );
+
+    // BNNN jump tables are followed
+    vector<uint8_t> table = {0xB2, 0x02, 0x12, 0x08, 0x12, 0x0A, 0x00, 0xE0, 0x00, 0xE0, 0x00, 0xE0};
+    ControlFlowGraph jumps(table);
+    REQUIRE( jumps.blocks[0x200].indirect );
+    REQUIRE( jumps.blocks[0x200].successors == vector<int>{0x202, 0x204} );
+    REQUIRE( jumps.is_instruction(0x208) );
+    REQUIRE( jumps.is_instruction(0x20A) );
+    REQUIRE( !jumps.is_instruction(0x206) );
+
+    // Zero padding halts the interpreter, so the walk stops at it
+    vector<uint8_t> padded = {0x60, 0x01, 0x00, 0x00, 0x00, 0x00, 0x61, 0x02};
+    ControlFlowGraph stops(padded);
+    REQUIRE( stops.blocks.size() == 1 );
+    REQUIRE( stops.blocks[0x200].halts );
+    REQUIRE( stops.blocks[0x200].end == 0x204 );
+    REQUIRE( !stops.is_instruction(0x204) );
+    REQUIRE( !stops.is_code(0x206) );
+}
+
+
+#ifdef CHIP8_AOT_TESTS
+long run_pong_aot(Memory &mem, long cycles);
+long run_test_opcode_aot(Memory &mem, long cycles);
+long run_self_modifying_aot(Memory &mem, long cycles);
+#endif
+
+TEST_CASE( "CHIP-8 Recompiler" )
+{
+    //   200: 6005  LD V0, 0x05
+    //   202: 3005  SE V0, 0x05
+    //   204: B300  JP V0, 0x300
+    //   206: 1200  JP 0x200
+    vector<uint8_t> rom = {0x60, 0x05, 0x30, 0x05, 0xB3, 0x00, 0x12, 0x00};
+    ostringstream out;
+    recompile(rom, "run_test_rom", out);
+    string code = out.str();
+
+    REQUIRE( code.find("long run_test_rom(Memory &mem, long cycles)") != string::npos );
+    // One label per block, jumps between blocks are direct
+    REQUIRE( code.find("block_200:") != string::npos );
+    REQUIRE( code.find("block_204:") != string::npos );
+    REQUIRE( code.find("block_206:") != string::npos );
+    REQUIRE( code.find("goto block_200;") != string::npos );
+    // Inline loads and skips, computed jumps through the handler
+    REQUIRE( code.find("mem.reg_write(0x0, 0x05);") != string::npos );
+    REQUIRE( code.find("if (mem.reg_read(0x0) == 0x05)") != string::npos );
+    REQUIRE( code.find("opBNNN<CowgodQuirks>(0xB300, mem);") != string::npos );
+    // Interpreter fallback
+    REQUIRE( code.find("step<CowgodQuirks>(mem);") != string::npos );
+
+    // Quirky opcodes use the profile's instantiation
+    ostringstream vip;
+    recompile(rom, "run_rom", vip, 0x200, QuirksProfile::Vip);
+    REQUIRE( vip.str().find("opBNNN<VipQuirks>(0xB300, mem);") != string::npos );
+
+#ifdef CHIP8_AOT_TESTS
+    // ROMs recompiled at build time (see CMakeLists.txt) run just like the
+    // interpreter, in budgets that end mid-block, with the keys changing
+    // and the timers ticking in between
+    struct { const char *rom; long (*compiled)(Memory &, long); } cases[] = {
+        {"roms/PONG", run_pong_aot},
+        {"roms/test_opcode.ch8", run_test_opcode_aot},
+        {"roms/self_modifying.ch8", run_self_modifying_aot},
+    };
+    for (auto &test : cases)
+    {
+        Memory interpreted, recompiled;
+        REQUIRE( interpreted.load_rom(test.rom) );
+        REQUIRE( recompiled.load_rom(test.rom) );
+        for (int frame = 0; frame < 600; frame++)
+        {
+            uint16_t keys = frame % 20 < 10 ? 1 << (frame / 20 % 16) : 0;
+            interpreted.set_keys(keys);
+            recompiled.set_keys(keys);
+            long cycles = 7 + frame % 13;
+            REQUIRE( test.compiled(recompiled, cycles) == run(interpreted, cycles) );
+            interpreted.tick_timers();
+            recompiled.tick_timers();
+        }
+        for (int i = 0; i < 16; i++)
+            REQUIRE( recompiled.reg_read(i) == interpreted.reg_read(i) );
+        REQUIRE( recompiled.get_address_pointer() == interpreted.get_address_pointer() );
+        REQUIRE( recompiled.get_program_counter() == interpreted.get_program_counter() );
+        REQUIRE( recompiled.get_cycle_count() == interpreted.get_cycle_count() );
+        REQUIRE( recompiled.get_screen_hash() == interpreted.get_screen_hash() );
+        for (int address = 0; address < 4096; address++)
+            REQUIRE( recompiled.mem_read(address) == interpreted.mem_read(address) );
+    }
+
+    // Code rewritten by a store the interpreter ran is noticed in the same
+    // call: 20C-214 are only reached through BNNN, so aren't compiled, and
+    // patch the compiled block at 218 from LD VA, 1 to LD VA, 7
+    Memory patched;
+    REQUIRE( patched.load_rom("roms/self_modifying.ch8") );
+    REQUIRE( run_self_modifying_aot(patched, 100) == 100 );
+    REQUIRE( patched.reg_read(0xA) == 7 );
+#endif
+}
+
+
+TEST_CASE( "SUPER-CHIP" )
+{
+    Memory mem = Memory();
+
+    // Large font sits clear of the small font
+    REQUIRE( mem.mem_read(Memory::large_font_start) == 0xFF );
+    REQUIRE( mem.mem_read(Memory::large_font_start + 159) == 0xC0 );
+
+    SECTION( "Execute 00FF and 00FE" )
+    {
+        mem.screen_write(5, 1);
+        REQUIRE( execute(0x00FF, mem) == 0x00FF );
+        REQUIRE( mem.is_hires() );
+        REQUIRE( mem.screen_width == 128 );
+        REQUIRE( mem.screen_height == 64 );
+        REQUIRE( mem.screen_size == 8192 );
+        // Switching clears the screen
+        REQUIRE( mem.get_screen_hash() == 0 );
+
+        mem.screen_write(127 + 128 * 63, 1);
+        REQUIRE( mem.screen_row(63, 1) == 1 );
+        REQUIRE( execute(0x00FE, mem) == 0x00FE );
+        REQUIRE( !mem.is_hires() );
+        REQUIRE( mem.screen_row(63, 1) == 0 );
+    }
+    SECTION( "Execute DXY0" )
+    {
+        // 16x16 sprite straddling the two words of a high resolution row
+        execute(0x00FF, mem);
+        for (int i = 0; i < 32; i++)
+            mem.mem_write(0x500 + i, i % 2 ? 0x0F : 0xF0);
+        mem.set_address_pointer(0x500);
+        mem.reg_write(0x0, 60);
+        mem.reg_write(0x1, 62);
+        REQUIRE( execute(0xD010, mem) == 0xD000 );
+        REQUIRE( mem.reg_read(0xF) == 1 );
+
+        // 0xF00F at x = 60 covers columns 60-63 and 72-75
+        REQUIRE( mem.screen_row(62, 0) == 0xF );
+        REQUIRE( mem.screen_row(62, 1) == 0x00F0000000000000ull );
+        // Rows wrap to the top
+        REQUIRE( mem.screen_row(13, 1) == 0x00F0000000000000ull );
+        REQUIRE( mem.screen_row(14, 1) == 0 );
+        REQUIRE( mem.get_screen_hash() == mem.compute_screen_hash() );
+
+        // Columns wrap from the right edge to the left
+        execute(0x00E0, mem);
+        mem.reg_write(0x0, 124);
+        mem.reg_write(0x1, 0);
+        execute(0xD010, mem);
+        REQUIRE( mem.screen_row(0, 1) == 0xF );
+        REQUIRE( mem.screen_row(0, 0) == 0x00F0000000000000ull );
+    }
+    SECTION( "Execute 00CN, 00FB and 00FC" )
+    {
+        execute(0x00FF, mem);
+        mem.screen_write(128 * 2 + 62, 1);
+        REQUIRE( execute(0x00C3, mem) == 0x00C0 );
+        REQUIRE( mem.screen_read(128 * 5 + 62) == 1 );
+        REQUIRE( mem.screen_read(128 * 2 + 62) == 0 );
+
+        // Right across the word boundary and back
+        REQUIRE( execute(0x00FB, mem) == 0x00FB );
+        REQUIRE( mem.screen_read(128 * 5 + 66) == 1 );
+        REQUIRE( mem.screen_row(5, 0) == 0 );
+        REQUIRE( execute(0x00FC, mem) == 0x00FC );
+        REQUIRE( mem.screen_read(128 * 5 + 62) == 1 );
+        REQUIRE( mem.screen_row(5, 1) == 0 );
+
+        // Pixels scrolled off the edge are gone
+        execute(0x00FC, mem);
+        execute(0x00FC, mem);
+        for (int i = 0; i < 16; i++)
+            execute(0x00FC, mem);
+        REQUIRE( mem.get_screen_hash() == 0 );
+
+        // Low resolution scrolls a single word
+        execute(0x00FE, mem);
+        mem.screen_write(0, 1);
+        execute(0x00FB, mem);
+        REQUIRE( mem.screen_read(4) == 1 );
+        execute(0x00C1, mem);
+        REQUIRE( mem.screen_read(64 + 4) == 1 );
+    }
+    SECTION( "Execute FX30" )
+    {
+        mem.reg_write(0x2, 0x7);
+        REQUIRE( execute(0xF230, mem) == 0xF030 );
+        REQUIRE( mem.get_address_pointer() == Memory::large_font_start + 70 );
+    }
+    SECTION( "Execute FX75 and FX85" )
+    {
+        for (int i = 0; i < 8; i++)
+            mem.reg_write(i, i + 1);
+        REQUIRE( execute(0xF775, mem) == 0xF075 );
+        for (int i = 0; i < 8; i++)
+            mem.reg_write(i, 0);
+        REQUIRE( execute(0xF385, mem) == 0xF085 );
+        REQUIRE( mem.reg_read(0x3) == 4 );
+        REQUIRE( mem.reg_read(0x4) == 0 );
+    }
+    SECTION( "Execute 00FD" )
+    {
+        mem.set_program_counter(0x302);
+        REQUIRE( execute(0x00FD, mem) == 0x00FD );
+        REQUIRE( mem.get_program_counter() == 0x300 );
+    }
+}
+
+
+TEST_CASE( "XO-CHIP" )
+{
+    Memory mem = Memory(0x10000);
+    mem.set_program_counter(0x200);
+
+    SECTION( "Execute F000" )
+    {
+        mem.mem_write(0x200, 0xF0);
+        mem.mem_write(0x201, 0x00);
+        mem.mem_write(0x202, 0xC0);
+        mem.mem_write(0x203, 0x12);
+        step(mem);
+        REQUIRE( mem.get_address_pointer() == 0xC012 );
+        REQUIRE( mem.get_program_counter() == 0x204 );
+
+        // Extended memory is addressable
+        mem.mem_write(0xC012, 0xAB);
+        REQUIRE( mem.mem_read(0xC012) == 0xAB );
+
+        // Skips step over the whole long load
+        mem.mem_write(0x204, 0x30);
+        mem.mem_write(0x205, 0x00);
+        mem.mem_write(0x206, 0xF0);
+        mem.mem_write(0x207, 0x00);
+        step(mem);
+        REQUIRE( mem.get_program_counter() == 0x20A );
+    }
+    SECTION( "Execute 5XY2 and 5XY3" )
+    {
+        for (int i = 0; i < 4; i++)
+            mem.reg_write(i, i + 1);
+        mem.set_address_pointer(0x500);
+        REQUIRE( execute(0x5132, mem) == 0x5002 );
+        REQUIRE( mem.mem_read(0x500) == 2 );
+        REQUIRE( mem.mem_read(0x502) == 4 );
+        REQUIRE( mem.mem_read(0x503) == 0 );
+        // I is left alone
+        REQUIRE( mem.get_address_pointer() == 0x500 );
+
+        // Reverse order when X > Y
+        REQUIRE( execute(0x5A83, mem) == 0x5003 );
+        REQUIRE( mem.reg_read(0xA) == 2 );
+        REQUIRE( mem.reg_read(0x9) == 3 );
+        REQUIRE( mem.reg_read(0x8) == 4 );
+    }
+    SECTION( "Execute FN01 and DXYN on two planes" )
+    {
+        mem.mem_write(0x500, 0x80);
+        mem.mem_write(0x501, 0xC0);
+        mem.set_address_pointer(0x500);
+        REQUIRE( execute(0xF301, mem) == 0xF001 );
+        REQUIRE( mem.get_planes() == 3 );
+
+        // Each plane takes the next N sprite bytes
+        execute(0xD001, mem);
+        REQUIRE( mem.screen_read(0) == 3 );
+        REQUIRE( mem.screen_read(1) == 2 );
+        REQUIRE( mem.get_screen_hash() == mem.compute_screen_hash() );
+
+        // Clearing and scrolling only touch the selected planes
+        execute(0xF201, mem);
+        REQUIRE( execute(0x00D0, mem) == 0x00D0 );
+        execute(0x00E0, mem);
+        REQUIRE( mem.screen_read(0) == 1 );
+        REQUIRE( mem.screen_read(1) == 0 );
+        execute(0xF101, mem);
+        mem.screen_write(64 * 3, 1);
+        REQUIRE( execute(0x00D2, mem) == 0x00D0 );
+        REQUIRE( mem.screen_read(64) == 1 );
+        REQUIRE( mem.get_screen_hash() == mem.compute_screen_hash() );
+    }
+    SECTION( "Execute F002 and FX3A" )
+    {
+        for (int i = 0; i < 16; i++)
+            mem.mem_write(0x600 + i, i * 3);
+        mem.set_address_pointer(0x600);
+        REQUIRE( execute(0xF002, mem) == 0xF002 );
+        REQUIRE( mem.audio_pattern_read(15) == 45 );
+
+        REQUIRE( mem.get_pitch() == 64 );
+        mem.reg_write(0x4, 112);
+        REQUIRE( execute(0xF43A, mem) == 0xF03A );
+        REQUIRE( mem.get_pitch() == 112 );
+    }
+    SECTION( "Disassemble" )
+    {
+        vector<uint8_t> rom = {0xF0, 0x00, 0x12, 0x34, 0x30, 0x00, 0xF0, 0x00, 0x00, 0x00, 0x12, 0x00};
+        ControlFlowGraph cfg(rom);
+        REQUIRE( cfg.instruction_length(0x200) == 4 );
+        REQUIRE( cfg.is_instruction(0x200) );
+        REQUIRE( !cfg.is_instruction(0x202) );
+        REQUIRE( cfg.is_code(0x203) );
+        REQUIRE( cfg.data_references.count(0x1234) );
+        // The skip lands after the four byte instruction
+        REQUIRE( cfg.block_at(0x204)->successors == vector<int>{0x206, 0x20A} );
+        REQUIRE( disassemble(0x5122) == "SAVE V1 - V2" );
+        REQUIRE( disassemble(0xF201) == "PLANE 2" );
+    }
+}
+
+TEST_CASE( "Quirks profiles" )
+{
+    Memory mem = Memory();
+    REQUIRE( mem.get_quirks() == QuirksProfile::Cowgod );
+
+    SECTION( "Shifts" )
+    {
+        mem.reg_write(0x1, 0x10);
+        mem.reg_write(0x2, 0x81);
+        REQUIRE( execute<CowgodQuirks>(0x8126, mem) == 0x8006 );
+        REQUIRE( mem.reg_read(0x1) == 0x08 );
+        REQUIRE( mem.reg_read(0xF) == 0 );
+
+        REQUIRE( execute<VipQuirks>(0x8126, mem) == 0x8006 );
+        REQUIRE( mem.reg_read(0x1) == 0x40 );
+        REQUIRE( mem.reg_read(0xF) == 1 );
+        REQUIRE( execute<XochipQuirks>(0x812E, mem) == 0x800E );
+        REQUIRE( mem.reg_read(0x1) == 0x02 );
+        REQUIRE( mem.reg_read(0xF) == 1 );
+    }
+    SECTION( "Logic ops reset VF" )
+    {
+        mem.reg_write(0xF, 1);
+        execute<SchipQuirks>(0x8011, mem);
+        REQUIRE( mem.reg_read(0xF) == 1 );
+        execute<VipQuirks>(0x8013, mem);
+        REQUIRE( mem.reg_read(0xF) == 0 );
+    }
+    SECTION( "Load and store move I" )
+    {
+        mem.set_address_pointer(0x400);
+        execute<CowgodQuirks>(0xF355, mem);
+        REQUIRE( mem.get_address_pointer() == 0x400 );
+        execute<VipQuirks>(0xF355, mem);
+        REQUIRE( mem.get_address_pointer() == 0x404 );
+        execute<XochipQuirks>(0xF165, mem);
+        REQUIRE( mem.get_address_pointer() == 0x406 );
+    }
+    SECTION( "BNNN and BXNN" )
+    {
+        mem.reg_write(0x0, 0x10);
+        mem.reg_write(0x3, 0x20);
+        execute<VipQuirks>(0xB300, mem);
+        REQUIRE( mem.get_program_counter() == 0x310 );
+        execute<SchipQuirks>(0xB300, mem);
+        REQUIRE( mem.get_program_counter() == 0x320 );
+    }
+    SECTION( "Sprite clipping" )
+    {
+        mem.mem_write(0x500, 0xFF);
+        mem.mem_write(0x501, 0xFF);
+        mem.set_address_pointer(0x500);
+        mem.reg_write(0x0, 60);
+        mem.reg_write(0x1, 31);
+
+        // Wrapping draws the cut off parts on the far edges
+        execute<CowgodQuirks>(0xD012, mem);
+        REQUIRE( mem.screen_read(64 * 31 + 60) == 1 );
+        REQUIRE( mem.screen_read(64 * 31 + 3) == 1 );
+        REQUIRE( mem.screen_read(3) == 1 );
+
+        execute(0x00E0, mem);
+        execute<VipQuirks>(0xD012, mem);
+        REQUIRE( mem.screen_read(64 * 31 + 63) == 1 );
+        REQUIRE( mem.screen_read(64 * 31 + 3) == 0 );
+        REQUIRE( mem.get_screen_hash() == mem.compute_screen_hash() );
+        REQUIRE( mem.screen_row(0) == 0 );
+
+        // Clipped at the right edge of a high resolution screen too
+        execute(0x00FF, mem);
+        mem.reg_write(0x0, 124);
+        execute<SchipQuirks>(0xD011, mem);
+        REQUIRE( mem.screen_row(31, 1) == 0xF );
+        REQUIRE( mem.screen_row(31, 0) == 0 );
+    }
+    SECTION( "Profile chosen per machine" )
+    {
+        // Same program, different results
+        vector<uint8_t> rom = {0x61, 0x03, 0x62, 0x08, 0x81, 0x26};
+        Memory vip;
+        vip.set_quirks(QuirksProfile::Vip);
+        vip.load_rom(rom);
+        mem.load_rom(rom);
+        REQUIRE( run(mem, 3) == 3 );
+        REQUIRE( run(vip, 3) == 3 );
+        REQUIRE( mem.reg_read(0x1) == 1 );
+        REQUIRE( vip.reg_read(0x1) == 4 );
+        REQUIRE( mem.get_cycle_count() == 3 );
+
+        QuirksProfile profile;
+        REQUIRE( parse_quirks("schip", profile) );
+        REQUIRE( profile == QuirksProfile::Schip );
+        REQUIRE( !parse_quirks("chip48", profile) );
+    }
+}
+
+TEST_CASE( "VIP timing" )
+{
+    Memory mem = Memory();
+
+    SECTION( "Instruction costs" )
+    {
+        mem.reg_write(0x1, 5);
+        REQUIRE( vip_instruction_cycles(0x6105, mem) == 46 );
+        // Skips taken cost more
+        REQUIRE( vip_instruction_cycles(0x3105, mem) == 54 );
+        REQUIRE( vip_instruction_cycles(0x3106, mem) == 50 );
+        // Unaligned sprites cost more per row
+        REQUIRE( vip_instruction_cycles(0xD115, mem) == 40 + 26 + 5 * 46 );
+        mem.reg_write(0x1, 8);
+        REQUIRE( vip_instruction_cycles(0xD115, mem) == 40 + 26 + 5 * 34 );
+        mem.reg_write(0x1, 123);
+        REQUIRE( vip_instruction_cycles(0xF133, mem) == 40 + 80 + 16 * 6 );
+        REQUIRE( vip_instruction_cycles(0xF355, mem) == 40 + 14 + 14 * 4 );
+    }
+    SECTION( "Frames" )
+    {
+        // 1200 loops forever at 52 cycles an instruction
+        mem.load_rom(vector<uint8_t>{0x12, 0x00});
+        mem.set_delay_timer(10);
+        VipTiming timing;
+        long executed = timing.run_frames(mem, 60);
+        REQUIRE( mem.get_delay_timer() == 0 );
+        REQUIRE( executed == (long) mem.get_cycle_count() );
+        // Never more than an instruction ahead of real time
+        REQUIRE( timing.get_machine_cycles() >= 60 * vip_cycles_per_frame );
+        REQUIRE( timing.get_machine_cycles() < 60 * vip_cycles_per_frame + 52 );
+        REQUIRE( executed == (60 * vip_cycles_per_frame + 51) / 52 );
+    }
+    SECTION( "Display wait" )
+    {
+        //   200: D011  DRW V0, V1, 1
+        //   202: 7201  ADD V2, 0x01
+        //   204: 1200  JP 0x200
+        mem.load_rom(vector<uint8_t>{0xD0, 0x11, 0x72, 0x01, 0x12, 0x00});
+        VipTiming timing;
+        REQUIRE( timing.run_frame(mem) == 1 );
+        REQUIRE( timing.run_frames(mem, 9) == 27 );
+        REQUIRE( mem.reg_read(0x2) == 9 );
+        REQUIRE( timing.get_machine_cycles() == 10 * vip_cycles_per_frame );
+
+        // Without it, sprites draw as fast as the CPU allows
+        VipTiming fast(false);
+        REQUIRE( fast.run_frame(mem) > 3 );
+    }
+    SECTION( "Interpreter share of a frame" )
+    {
+        // 6XNN takes 46 cycles, and 57 of them fill the 2598 left after
+        // the display and interrupt (the last one overruns into the next)
+        REQUIRE( vip_cycles_per_frame == 2598 );
+        vector<uint8_t> loads;
+        for (int i = 0; i < 200; i++)
+            loads.insert(loads.end(), {0x60, 0x00});
+        mem.load_rom(loads);
+        VipTiming timing;
+        REQUIRE( timing.run_frame(mem) == 57 );
+        REQUIRE( timing.run_frame(mem) == 56 );
+    }
+}
+
+// Remembers what it was shown
+class RecordingVideo : public VideoSink
+{
+public:
+    void present(const VideoFrame &frame) override
+    {
+        in_order &= frame.number > last.number;
+        last = frame;
+        presented++;
+    }
+    VideoFrame last;
+    int presented = 0;
+    bool in_order = true;
+};
+
+// Quits after a number of polls
+class QuittingInput : public InputSource
+{
+public:
+    explicit QuittingInput(int polls) : polls(polls) {}
+    bool poll(Memory &mem) override { return --polls > 0; }
+    int polls;
+};
+
+TEST_CASE( "Frontend" )
+{
+    SECTION( "Triple buffer" )
+    {
+        // Every published value is whole when it's read
+        TripleBuffer<array<uint64_t, 32>> buffer;
+        thread producer([&]() {
+            for (uint64_t n = 1; n <= 100000; n++)
+            {
+                buffer.back().fill(n);
+                buffer.publish();
+            }
+        });
+        uint64_t seen = 0;
+        bool consistent = true;
+        while (seen < 100000)
+        {
+            if (!buffer.update())
+                continue;
+            auto &value = buffer.front();
+            for (uint64_t word : value)
+                consistent &= word == value[0];
+            consistent &= value[0] > seen;
+            seen = value[0];
+        }
+        producer.join();
+        REQUIRE( consistent );
+        REQUIRE( !buffer.update() );
+    }
+    SECTION( "Frame exchange" )
+    {
+        // Frames published at vblank are never seen half drawn
+        Memory mem = Memory();
+        FrameExchange exchange;
+        mem.set_frame_publisher(&exchange);
+        thread cpu([&]() {
+            for (uint64_t n = 1; n <= 20000; n++)
+            {
+                for (int row = 0; row < 32; row++)
+                    mem.screen_xor_row(row, 0, (n - 1) ^ n);
+                mem.tick_timers();
+            }
+        });
+        uint64_t seen = 0;
+        bool consistent = true;
+        while (seen < 20000)
+        {
+            if (!exchange.update())
+                continue;
+            const VideoFrame &frame = exchange.front();
+            for (int row = 0; row < 32; row++)
+                consistent &= frame.rows[0][2 * row] == frame.number;
+            consistent &= frame.number > seen;
+            seen = frame.number;
+        }
+        cpu.join();
+        REQUIRE( consistent );
+        mem.set_frame_publisher(nullptr);
+    }
+    SECTION( "Copies don't publish" )
+    {
+        // Only the machine the publisher was given to publishes, whatever
+        // state is copied in or out of it
+        Memory mem = Memory();
+        FrameExchange exchange, other_exchange;
+        mem.set_frame_publisher(&exchange);
+        Memory copy = mem;
+        copy.tick_timers();
+        REQUIRE( !exchange.update() );
+        vector<Memory> fleet(4, mem);
+        for (Memory &machine : fleet)
+            machine.tick_timers();
+        REQUIRE( !exchange.update() );
+
+        Memory other = Memory();
+        other.set_frame_publisher(&other_exchange);
+        other = mem;
+        other.tick_timers();
+        REQUIRE( !exchange.update() );
+        REQUIRE( other_exchange.update() );
+        mem = copy;
+        mem.tick_timers();
+        REQUIRE( exchange.update() );
+    }
+    SECTION( "Shared memory" )
+    {
+        string name = "chip8-test-" + to_string(getpid());
+        Memory mem = Memory();
+        SharedFramebuffer shared(name);
+        REQUIRE( shared.is_open() );
+        SharedFramebufferReader reader(name);
+        REQUIRE( reader.is_open() );
+        VideoFrame frame;
+        REQUIRE( !reader.read(frame) );
+
+        // Readers see whole frames while the machine keeps drawing
+        mem.set_frame_publisher(&shared);
+        thread cpu([&]() {
+            for (uint64_t n = 1; n <= 20000; n++)
+            {
+                for (int row = 0; row < 32; row++)
+                    mem.screen_xor_row(row, 0, (n - 1) ^ n);
+                mem.tick_timers();
+            }
+        });
+        bool consistent = true;
+        uint64_t seen = 0;
+        while (seen < 20000)
+        {
+            if (!reader.read(frame))
+                continue;
+            for (int row = 0; row < 32; row++)
+                consistent &= frame.rows[0][2 * row] == frame.number;
+            consistent &= frame.number >= seen;
+            seen = frame.number;
+        }
+        cpu.join();
+        mem.set_frame_publisher(nullptr);
+        REQUIRE( consistent );
+        REQUIRE( frame.width == 64 );
+        REQUIRE( frame.planes == 1 );
+    }
+    SECTION( "Capture" )
+    {
+        Memory mem = Memory();
+        mem.screen_write(64 * 3 + 5, 1);
+        mem.set_sound_timer(4);
+        VideoFrame frame;
+        capture_frame(mem, frame);
+        REQUIRE( frame.width == 64 );
+        REQUIRE( frame.pixel(5, 3) == 1 );
+        REQUIRE( frame.pixel(6, 3) == 0 );
+        REQUIRE( frame.sound );
+    }
+    SECTION( "Event loop" )
+    {
+        //   200: 7001  ADD V0, 0x01
+        //   202: 1200  JP 0x200
+        Memory mem = Memory();
+        mem.load_rom(vector<uint8_t>{0x70, 0x01, 0x12, 0x00});
+        RecordingVideo video;
+        NullAudio audio;
+        NullInput input;
+        Frontend frontend(mem, video, audio, input);
+        frontend.set_throttle(false);
+        frontend.set_instructions_per_frame(4);
+
+        // The last frame always makes it out
+        REQUIRE( frontend.run(120) == 120 );
+        REQUIRE( video.in_order );
+        REQUIRE( video.presented >= 1 );
+        REQUIRE( video.last.number == 120 );
+        REQUIRE( mem.get_cycle_count() == 480 );
+
+        // Input can end the run
+        QuittingInput quitting(3);
+        Frontend stopped(mem, video, audio, quitting);
+        stopped.run();
+        REQUIRE( quitting.polls == 0 );
+    }
+    SECTION( "PPM" )
+    {
+        ostringstream out;
+        write_ppm(vector<uint8_t>{0x80, 0x00}, 16, 1, out, 1);
+        string image = out.str();
+        REQUIRE( image.compare(0, 12, "P6\n16 1\n255\n") == 0 );
+        REQUIRE( image.size() == 12 + 48 );
+        REQUIRE( (uint8_t) image[12] == 0xFF );
+        REQUIRE( (uint8_t) image[15] == 0 );
+    }
 }
 
+TEST_CASE( "Environment" )
+{
+    //   200: 6105  LD V1, 0x05
+    //   202: A300  LD I, 0x300
+    //   204: F065  LD V0, [I]
+    //   206: E1A1  SKNP V1
+    //   208: 7001  ADD V0, 0x01     score goes up once a loop while key 5 is held
+    //   20A: F055  LD [I], V0
+    //   20C: 6000  LD V0, 0x00
+    //   20E: F029  LD F, V0
+    //   210: D015  DRW V0, V1, 5    draw and erase a 0 at (0, 5)
+    //   212: D015  DRW V0, V1, 5
+    //   214: 1202  JP 0x202
+    vector<uint8_t> rom = {
+        0x61, 0x05, 0xA3, 0x00, 0xF0, 0x65, 0xE1, 0xA1, 0x70, 0x01, 0xF0, 0x55,
+        0x60, 0x00, 0xF0, 0x29, 0xD0, 0x15, 0xD0, 0x15, 0x12, 0x02,
+    };
+    EnvConfig config;
+    config.reward.score_addresses = {0x300};
+    config.reward.max_frames = 8;
+    config.frame_skip = 4;
+
+    SECTION( "Rewards and episodes" )
+    {
+        VectorEnv env(rom, 2, config);
+        REQUIRE( env.size() == 2 );
+        REQUIRE( env.action_count() == 17 );
+        REQUIRE( env.observation_size() == 256 );
+
+        vector<uint8_t> observations(2 * env.observation_size());
+        env.reset(observations.data());
+
+        // Machine 0 holds key 5, machine 1 does nothing
+        int actions[2] = {1 + 0x5, 0};
+        float rewards[2];
+        uint8_t dones[2];
+        env.step(actions, observations.data(), rewards, dones);
+        REQUIRE( rewards[0] == 4 );
+        REQUIRE( rewards[1] == 0 );
+        REQUIRE( !dones[0] );
+        REQUIRE( env.machine(0).mem_read(0x300) == 4 );
+
+        // Out of frames, back to the snapshot
+        env.step(actions, observations.data(), rewards, dones);
+        REQUIRE( rewards[0] == 4 );
+        REQUIRE( dones[0] );
+        REQUIRE( dones[1] );
+        REQUIRE( env.machine(0).mem_read(0x300) == 0 );
+        REQUIRE( env.machine(0).get_cycle_count() == 0 );
+    }
+    SECTION( "Observations" )
+    {
+        VectorEnv env(rom, 1, config);
+        vector<uint8_t> observation(env.observation_size());
+        env.reset(observation.data());
+        REQUIRE( observation[5 * 8] == 0 );
+
+        // Stop right after the first draw, the 8th instruction
+        config.instructions_per_frame = 8;
+        config.frame_skip = 1;
+        VectorEnv drawn(rom, 1, config);
+        int action = 0;
+        drawn.step(&action, observation.data(), nullptr, nullptr);
+        REQUIRE( observation[5 * 8] == 0xF0 );
+        REQUIRE( observation[9 * 8] == 0xF0 );
+        REQUIRE( observation[10 * 8] == 0 );
+
+        config.hires_observations = true;
+        VectorEnv hires(rom, 1, config);
+        vector<uint8_t> large(hires.observation_size());
+        hires.step(&action, large.data(), nullptr, nullptr);
+        REQUIRE( hires.observation_size() == 1024 );
+        REQUIRE( large[10 * 16] == 0xFF );
+        REQUIRE( large[11 * 16] == 0xFF );
+    }
+    SECTION( "Threads" )
+    {
+        // Same results however the machines are split up
+        config.reward.max_frames = 0;
+        config.threads = 4;
+        VectorEnv threaded(rom, 37, config);
+        config.threads = 1;
+        VectorEnv single(rom, 37, config);
+
+        vector<int> actions(37);
+        vector<float> rewards(37), expected(37);
+        for (int i = 0; i < 37; i++)
+            actions[i] = i % 3 ? 0 : 6;
+        for (int n = 0; n < 5; n++)
+        {
+            threaded.step(actions.data(), nullptr, rewards.data(), nullptr);
+            single.step(actions.data(), nullptr, expected.data(), nullptr);
+            REQUIRE( rewards == expected );
+        }
+        REQUIRE( rewards[0] == 4 );
+        REQUIRE( rewards[1] == 0 );
+    }
+}
+
+TEST_CASE( "C API" )
+{
+    REQUIRE( chip8_abi_version() == CHIP8_ABI_VERSION );
+    REQUIRE( chip8_create(7) == nullptr );
+
+    //   200: 6005  LD V0, 0x05
+    //   202: F029  LD F, V0
+    //   204: D005  DRW V0, V0, 5
+    //   206: 7001  ADD V0, 0x01
+    //   208: 1206  JP 0x206
+    const uint8_t rom[] = {0x60, 0x05, 0xF0, 0x29, 0xD0, 0x05, 0x70, 0x01, 0x12, 0x06};
+    chip8_machine *machines[2] = {chip8_create(CHIP8_QUIRKS_COWGOD), chip8_create(CHIP8_QUIRKS_XOCHIP)};
+    REQUIRE( chip8_ram_size(machines[0]) == 4096 );
+    REQUIRE( chip8_ram_size(machines[1]) == 0x10000 );
+    REQUIRE( chip8_load_rom(machines[0], rom, sizeof rom) == CHIP8_OK );
+    REQUIRE( chip8_load_rom(machines[1], rom, sizeof rom) == CHIP8_OK );
+    vector<uint8_t> large(4096);
+    REQUIRE( chip8_load_rom(machines[0], large.data(), large.size()) == CHIP8_ERROR_ROM_SIZE );
+
+    // A batch of two, three frames of two instructions
+    REQUIRE( chip8_run_frames(machines, 2, 3, 2) == CHIP8_OK );
+    REQUIRE( chip8_cycle_count(machines[0]) == 6 );
+    REQUIRE( chip8_cycle_count(machines[1]) == 6 );
+    REQUIRE( chip8_screen_width(machines[0]) == 64 );
+    REQUIRE( chip8_screen_height(machines[0]) == 32 );
+
+    // The 5 glyph at (5, 5)
+    const uint64_t *screen = chip8_framebuffer(machines[0]);
+    REQUIRE( screen[2 * 5] == 0xF0ull << 51 );
+    REQUIRE( screen[2 * 6] == 0x80ull << 51 );
+
+    const uint16_t keys[2] = {0x0001, 0x8000};
+    REQUIRE( chip8_set_keys(machines, 2, keys) == CHIP8_OK );
+
+    SECTION( "Snapshots" )
+    {
+        chip8_snapshot *snapshot = chip8_snapshot_create(machines[0]);
+        REQUIRE( chip8_run_cycles(machines, 1, 10) == CHIP8_OK );
+        REQUIRE( chip8_cycle_count(machines[0]) == 16 );
+        uint8_t *ram = chip8_ram(machines[0]);
+        ram[0x300] = 0x55;
+
+        REQUIRE( chip8_snapshot_restore(machines[0], snapshot) == CHIP8_OK );
+        REQUIRE( chip8_cycle_count(machines[0]) == 6 );
+        REQUIRE( chip8_ram(machines[0]) == ram );
+        REQUIRE( ram[0x300] == 0 );
+
+        REQUIRE( chip8_snapshot_save(machines[0], snapshot) == CHIP8_OK );
+        REQUIRE( chip8_snapshot_restore(machines[1], snapshot) == CHIP8_ERROR_ARGUMENT );
+        chip8_snapshot_destroy(snapshot);
+    }
+    SECTION( "Out of memory" )
+    {
+        // The ROM's page is shared with the snapshot until written
+        chip8_snapshot *snapshot = chip8_snapshot_create(machines[0]);
+        failing_allocations = true;
+        int loaded = chip8_load_rom(machines[0], rom, sizeof rom);
+        uint8_t *ram = chip8_ram(machines[0]);
+        chip8_snapshot *another = chip8_snapshot_create(machines[0]);
+        int restored = chip8_snapshot_restore(machines[0], snapshot);
+        failing_allocations = false;
+        REQUIRE( loaded == CHIP8_ERROR_MEMORY );
+        REQUIRE( ram == nullptr );
+        REQUIRE( another == nullptr );
+        REQUIRE( restored == CHIP8_OK );
+        REQUIRE( chip8_load_rom(machines[0], rom, sizeof rom) == CHIP8_OK );
+        REQUIRE( chip8_run_cycles(machines, 2, 10) == CHIP8_OK );
+        chip8_snapshot_destroy(snapshot);
+    }
+    SECTION( "Bad arguments" )
+    {
+        chip8_machine *missing[1] = {nullptr};
+        REQUIRE( chip8_run_cycles(missing, 1, 10) == CHIP8_ERROR_ARGUMENT );
+        REQUIRE( chip8_run_frames(machines, 2, -1, 10) == CHIP8_ERROR_ARGUMENT );
+        REQUIRE( chip8_framebuffer(nullptr) == nullptr );
+        REQUIRE( chip8_run_cycles(nullptr, 0, 10) == CHIP8_OK );
+    }
+
+    chip8_destroy(machines[0]);
+    chip8_destroy(machines[1]);
+}
+
+TEST_CASE( "Debugger" )
+{
+    //   200: 6000  LD V0, 0x00
+    //   202: A300  LD I, 0x300
+    //   204: 7001  ADD V0, 0x01
+    //   206: F055  LD [I], V0
+    //   208: 00E0  CLS
+    //   20A: 1204  JP 0x204
+    Memory mem;
+    mem.load_rom(vector<uint8_t>{0x60, 0x00, 0xA3, 0x00, 0x70, 0x01, 0xF0, 0x55, 0x00, 0xE0, 0x12, 0x04});
+    Debugger debugger(mem, 4);
+
+    SECTION( "Budgets" )
+    {
+        RunResult result = debugger.run(10);
+        REQUIRE( result.reason == StopReason::Cycles );
+        REQUIRE( result.cycles == 10 );
+        REQUIRE( mem.get_cycle_count() == 10 );
+
+        // Frames carry on from the 2 instructions already into this one
+        result = debugger.run(1000, 3);
+        REQUIRE( result.reason == StopReason::Frames );
+        REQUIRE( result.cycles == 10 );
+    }
+    SECTION( "Breakpoints" )
+    {
+        debugger.add_breakpoint(0x208);
+        RunResult result = debugger.run(1000);
+        REQUIRE( result.reason == StopReason::Breakpoint );
+        REQUIRE( result.address == 0x208 );
+        REQUIRE( result.cycles == 4 );
+        REQUIRE( mem.get_program_counter() == 0x208 );
+
+        // Resuming steps off the breakpoint and comes round to it again
+        result = debugger.run(1000);
+        REQUIRE( result.reason == StopReason::Breakpoint );
+        REQUIRE( result.cycles == 4 );
+        REQUIRE( mem.reg_read(0) == 2 );
+
+        debugger.remove_breakpoint(0x208);
+        REQUIRE( debugger.run(100).reason == StopReason::Cycles );
+    }
+    SECTION( "Watchpoints" )
+    {
+        debugger.add_watchpoint(0x2FF, 2);
+        RunResult result = debugger.run(1000);
+        REQUIRE( result.reason == StopReason::Watchpoint );
+        REQUIRE( result.address == 0x300 );
+        REQUIRE( mem.get_program_counter() == 0x208 );
+        REQUIRE( mem.mem_read(0x300) == 1 );
+
+        debugger.remove_watchpoint(0x2FF, 2);
+        REQUIRE( debugger.run(100).reason == StopReason::Cycles );
+    }
+    SECTION( "Registers and screen" )
+    {
+        debugger.watch_register(0, 5);
+        RunResult result = debugger.run(1000);
+        REQUIRE( result.reason == StopReason::Register );
+        REQUIRE( mem.reg_read(0) == 5 );
+        REQUIRE( mem.get_program_counter() == 0x206 );
+        debugger.unwatch_register(0);
+
+        // A blank screen hashes to 0, CLS gets there
+        mem.screen_write(0, 1);
+        debugger.watch_screen_hash(0);
+        result = debugger.run(1000);
+        REQUIRE( result.reason == StopReason::ScreenHash );
+        REQUIRE( mem.get_program_counter() == 0x20A );
+    }
+    SECTION( "Self-modifying code" )
+    {
+        // LD V0, 0x6F and LD I, 0x20A, so F055 stores 0x70 over the jump
+        // and 20A becomes 7004: ADD V0, 0x04
+        mem.mem_write_block(0x200, vector<uint8_t>{0x60, 0x6F, 0xA2, 0x0A}.data(), 4);
+        debugger.invalidate(0x200, 4);
+        debugger.run(6);
+        REQUIRE( mem.mem_read(0x20A) == 0x70 );
+        REQUIRE( mem.get_program_counter() == 0x20C );
+        REQUIRE( mem.reg_read(0) == 0x74 );
+    }
+    SECTION( "Same as the interpreter" )
+    {
+        Memory pong;
+        pong.load_rom(string("roms/PONG"));
+        Memory plain = pong;
+        Debugger traced(pong);
+        traced.add_breakpoint(0x100);
+        traced.add_watchpoint(0xF00);
+        // Both tick the timers every 10 instructions
+        REQUIRE( traced.run(50000).reason == StopReason::Cycles );
+        REQUIRE( run_frames(plain, 5000, 10) == 50000 );
+        REQUIRE( pong.get_program_counter() == plain.get_program_counter() );
+        REQUIRE( pong.get_screen_hash() == plain.get_screen_hash() );
+        for (int i = 0; i < 16; i++)
+            REQUIRE( pong.reg_read(i) == plain.reg_read(i) );
+    }
+}
+
+// One request and its reply over a GDB remote connection, with acks
+static string gdb_exchange(int fd, const string &packet)
+{
+    uint8_t sum = 0;
+    for (char c : packet)
+        sum += c;
+    char checksum[4];
+    snprintf(checksum, sizeof checksum, "#%02x", sum);
+    string data = "$" + packet + checksum;
+    if (write(fd, data.data(), data.size()) != (ssize_t) data.size())
+        return "write failed";
+
+    string reply;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '$')
+        ;
+    while (read(fd, &c, 1) == 1 && c != '#')
+        reply += c;
+    char ignored[2];
+    if (read(fd, ignored, 2) != 2 || write(fd, "+", 1) != 1)
+        return "read failed";
+    return reply;
+}
+
+TEST_CASE( "GDB server" )
+{
+    //   200: 6000  LD V0, 0x00
+    //   202: A300  LD I, 0x300
+    //   204: 7001  ADD V0, 0x01
+    //   206: F055  LD [I], V0
+    //   208: 00E0  CLS
+    //   20A: 1204  JP 0x204
+    Memory mem;
+    mem.load_rom(vector<uint8_t>{0x60, 0x00, 0xA3, 0x00, 0x70, 0x01, 0xF0, 0x55, 0x00, 0xE0, 0x12, 0x04});
+
+    string path = "/tmp/chip8-gdb-test-" + to_string(getpid());
+    GdbServer server(mem, "unix:" + path);
+    REQUIRE( server.is_open() );
+    REQUIRE( !server.has_client() );
+    REQUIRE( !server.serve() );
+
+    // The machine's thread, as the frontend would run it
+    thread machine([&]() {
+        while (!server.has_client())
+            this_thread::sleep_for(chrono::milliseconds(1));
+        server.serve(4);
+    });
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    REQUIRE( connect(fd, (sockaddr *) &address, sizeof address) == 0 );
+
+    REQUIRE( gdb_exchange(fd, "qSupported:multiprocess+").find("qXfer:features:read+") != string::npos );
+    REQUIRE( gdb_exchange(fd, "?") == "S05" );
+    REQUIRE( gdb_exchange(fd, "g") == string(32, '0') + "0000" + "0002" + "00" + "ff" + "ff" );
+    REQUIRE( gdb_exchange(fd, "qXfer:features:read:target.xml:0,fff").substr(0, 6) == "l<?xml" );
+
+    // Breakpoints stop before the instruction, stepping runs it
+    REQUIRE( gdb_exchange(fd, "Z0,208,2") == "OK" );
+    REQUIRE( gdb_exchange(fd, "c") == "S05" );
+    REQUIRE( gdb_exchange(fd, "p11") == "0802" );
+    REQUIRE( gdb_exchange(fd, "s") == "S05" );
+    REQUIRE( gdb_exchange(fd, "p11") == "0a02" );
+    REQUIRE( gdb_exchange(fd, "z0,208,2") == "OK" );
+
+    // Write watchpoints stop after the store
+    REQUIRE( gdb_exchange(fd, "Z2,300,1") == "OK" );
+    REQUIRE( gdb_exchange(fd, "c") == "T05watch:300;" );
+    REQUIRE( gdb_exchange(fd, "m300,1") == "02" );
+    REQUIRE( gdb_exchange(fd, "z2,300,1") == "OK" );
+
+    // Memory and registers
+    REQUIRE( gdb_exchange(fd, "M300,2:7f80") == "OK" );
+    REQUIRE( gdb_exchange(fd, "m2ff,3") == "007f80" );
+    // A write bigger than one receive
+    string block;
+    for (int i = 0; i < 0x800; i++)
+    {
+        char digits[3];
+        snprintf(digits, sizeof digits, "%02x", i & 0xFF);
+        block += digits;
+    }
+    REQUIRE( gdb_exchange(fd, "M800,800:" + block) == "OK" );
+    REQUIRE( gdb_exchange(fd, "m800,2") == "0001" );
+    REQUIRE( gdb_exchange(fd, "mfff,1") == "ff" );
+    REQUIRE( gdb_exchange(fd, "P0=05") == "OK" );
+    REQUIRE( gdb_exchange(fd, "p0") == "05" );
+    REQUIRE( gdb_exchange(fd, "P10=2003") == "OK" );
+    REQUIRE( gdb_exchange(fd, "m400,1") == "00" );
+    REQUIRE( gdb_exchange(fd, "x") == "" );
+
+    // Detaching hands the machine back
+    REQUIRE( gdb_exchange(fd, "D") == "OK" );
+    machine.join();
+    close(fd);
+    REQUIRE( mem.reg_read(0) == 5 );
+    REQUIRE( mem.get_address_pointer() == 0x320 );
+    REQUIRE( mem.get_program_counter() == 0x208 );
+    REQUIRE( !server.has_client() );
+}
+
+TEST_CASE( "Trace" )
+{
+    //   200: 6000  LD V0, 0x00
+    //   202: A300  LD I, 0x300
+    //   204: 7001  ADD V0, 0x01
+    //   206: F055  LD [I], V0
+    //   208: 00E0  CLS
+    //   20A: 1204  JP 0x204
+    vector<uint8_t> rom {0x60, 0x00, 0xA3, 0x00, 0x70, 0x01, 0xF0, 0x55, 0x00, 0xE0, 0x12, 0x04};
+    Memory mem;
+    mem.load_rom(rom);
+
+    // Tiny blocks so the writer thread takes many hand-overs
+    stringstream out;
+    {
+        TraceRecorder recorder(out, 64, 2);
+        REQUIRE( recorder.run_frames(mem, 50, 4) == 200 );
+        REQUIRE( recorder.get_record_count() == 200 );
+    }
+    REQUIRE( out.str().compare(0, 4, "C8TR") == 0 );
+    REQUIRE( out.str().size() < 200 * 8 );
+
+    SECTION( "records read back as full states and deltas" )
+    {
+        stringstream in(out.str());
+        TraceReader reader(in);
+        REQUIRE( reader.is_valid() );
+        TraceRecord record;
+
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.cycle == 1 );
+        REQUIRE( record.pc == 0x200 );
+        REQUIRE( record.instruction == 0x6000 );
+        REQUIRE( record.delay_timer == -1 );
+        REQUIRE( (record.changed & TraceRecord::changed_timers) );
+
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.address_pointer == 0x300 );
+        REQUIRE( record.changed == TraceRecord::changed_i );
+
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.registers[0] == 1 );
+        REQUIRE( record.changed == 1 );
+
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.pc == 0x206 );
+        REQUIRE( record.changed == TraceRecord::changed_memory );
+        REQUIRE( record.memory_address == 0x300 );
+        REQUIRE( record.memory == vector<uint8_t>{1} );
+        REQUIRE( format_trace_record(record).find("[300]=01") != string::npos );
+
+        REQUIRE( reader.next(record) );
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.instruction == 0x1204 );
+        REQUIRE( reader.next(record) );
+        REQUIRE( record.pc == 0x204 );
+        REQUIRE( record.registers[0] == 2 );
+
+        int count = 7;
+        while (reader.next(record))
+            count++;
+        REQUIRE( count == 200 );
+        REQUIRE( record.cycle == mem.get_cycle_count() );
+        REQUIRE( record.registers[0] == mem.reg_read(0) );
+        REQUIRE( record.pc == 0x206 );
+    }
+
+    SECTION( "a damaged trace stops cleanly" )
+    {
+        stringstream in(out.str().substr(0, out.str().size() / 2));
+        TraceReader reader(in);
+        TraceRecord record;
+        int count = 0;
+        while (reader.next(record))
+            count++;
+        REQUIRE( count > 0 );
+        REQUIRE( count < 200 );
+
+        stringstream garbage("not a trace");
+        REQUIRE( !TraceReader(garbage).is_valid() );
+    }
+
+    SECTION( "timing doesn't change the trace" )
+    {
+        Memory again;
+        again.load_rom(rom);
+        stringstream second;
+        {
+            TraceRecorder recorder(second);
+            recorder.run_frames(again, 50, 4);
+        }
+        REQUIRE( second.str() == out.str() );
+    }
+}
+
+TEST_CASE( "Faults" )
+{
+    Memory mem;
+
+    SECTION( "stack underflow" )
+    {
+        mem.load_rom(vector<uint8_t>{0x00, 0xEE});
+        REQUIRE( run(mem, 10) == 1 );
+        REQUIRE( mem.is_halted() );
+        Halt halt = mem.get_halt();
+        REQUIRE( halt.fault == Fault::StackUnderflow );
+        REQUIRE( halt.pc == 0x200 );
+        REQUIRE( halt.instruction == 0x00EE );
+        REQUIRE( mem.get_program_counter() == 0x200 );
+        REQUIRE( mem.get_stack_pointer() == 0 );
+        REQUIRE( mem.stack_pop() == -1 );
+        REQUIRE( mem.get_stack_pointer() == 0 );
+
+        // Halted machines don't run until resumed
+        REQUIRE( run(mem, 10) == 0 );
+        REQUIRE( run_frames(mem, 10, 10) == 0 );
+        REQUIRE( mem.get_cycle_count() == 1 );
+        mem.resume();
+        REQUIRE( !mem.is_halted() );
+        REQUIRE( run(mem, 10) == 1 );
+        REQUIRE( mem.get_cycle_count() == 2 );
+    }
+
+    SECTION( "stack overflow" )
+    {
+        // 200: 2200  CALL 0x200
+        mem.load_rom(vector<uint8_t>{0x22, 0x00});
+        REQUIRE( run(mem, 100) == 17 );
+        REQUIRE( mem.get_halt().fault == Fault::StackOverflow );
+        REQUIRE( mem.get_halt().pc == 0x200 );
+        REQUIRE( mem.get_stack_pointer() == 16 );
+        REQUIRE( mem.stack_peek() == 0x202 );
+    }
+
+    SECTION( "invalid opcodes" )
+    {
+        // Each used to fall through into another family
+        for (int instruction : {0x0123, 0x8AB8, 0xE1FF, 0xF125, 0xF1FF})
+        {
+            mem.resume();
+            mem.set_program_counter(0x302);
+            REQUIRE( execute(instruction, mem) == -1 );
+            REQUIRE( mem.get_halt().fault == Fault::InvalidOpcode );
+            REQUIRE( mem.get_halt().instruction == instruction );
+            REQUIRE( mem.get_program_counter() == 0x300 );
+        }
+        REQUIRE( string(fault_name(Fault::InvalidOpcode)) == "invalid opcode" );
+    }
+
+    SECTION( "00FD exits" )
+    {
+        mem.load_rom(vector<uint8_t>{0x60, 0x01, 0x00, 0xFD});
+        REQUIRE( run_frames(mem, 5, 10) == 2 );
+        REQUIRE( mem.get_halt().fault == Fault::Exit );
+        REQUIRE( mem.get_halt().pc == 0x202 );
+        REQUIRE( mem.get_delay_timer() == -1 );
+    }
+
+    SECTION( "the debugger stops on a halt" )
+    {
+        mem.load_rom(vector<uint8_t>{0x60, 0x01, 0x12, 0x06, 0x00, 0x00, 0x00, 0xEE});
+        Debugger debugger(mem);
+        RunResult result = debugger.run(100);
+        REQUIRE( result.reason == StopReason::Halted );
+        REQUIRE( result.cycles == 3 );
+        REQUIRE( result.address == 0x206 );
+        REQUIRE( debugger.run(100).cycles == 0 );
+    }
+
+    SECTION( "faulted machines drop out of a batch" )
+    {
+        chip8_machine *machines[2] = {chip8_create(CHIP8_QUIRKS_COWGOD), chip8_create(CHIP8_QUIRKS_COWGOD)};
+        const uint8_t loop[] = {0x12, 0x00};
+        const uint8_t garbage[] = {0xFF, 0xFF};
+        chip8_load_rom(machines[0], loop, sizeof loop);
+        chip8_load_rom(machines[1], garbage, sizeof garbage);
+        REQUIRE( chip8_run_cycles(machines, 2, 1000) == CHIP8_OK );
+        REQUIRE( chip8_cycle_count(machines[0]) == 1000 );
+        REQUIRE( chip8_cycle_count(machines[1]) == 1 );
+
+        uint16_t pc, instruction;
+        REQUIRE( chip8_halt_reason(machines[0], nullptr, nullptr) == CHIP8_FAULT_NONE );
+        REQUIRE( chip8_halt_reason(machines[1], &pc, &instruction) == CHIP8_FAULT_INVALID_OPCODE );
+        REQUIRE( pc == 0x200 );
+        REQUIRE( instruction == 0xFFFF );
+        REQUIRE( chip8_resume(machines[1]) == CHIP8_OK );
+        REQUIRE( chip8_halt_reason(machines[1], nullptr, nullptr) == CHIP8_FAULT_NONE );
+        chip8_destroy(machines[0]);
+        chip8_destroy(machines[1]);
+    }
+}
+
+// What every instruction should run, spelled out nibble by nibble apart
+// from the list the decoder is built from
+template <class Quirks>
+static OpcodeHandler expected_handler(int instruction)
+{
+    int n = instruction & 0xF;
+    int kk = instruction & 0xFF;
+    switch (instruction >> 12)
+    {
+        case 0x0:
+            if ((instruction & 0xFFF0) == 0x00C0)
+                return &op00CN;
+            if ((instruction & 0xFFF0) == 0x00D0)
+                return &op00DN;
+            switch (instruction)
+            {
+                case 0x00E0: return &op00E0;
+                case 0x00EE: return &op00EE;
+                case 0x00FB: return &op00FB;
+                case 0x00FC: return &op00FC;
+                case 0x00FD: return &op00FD;
+                case 0x00FE: return &op00FE;
+                case 0x00FF: return &op00FF;
+            }
+            return &invalidOpcode;
+        case 0x1: return &op1NNN;
+        case 0x2: return &op2NNN;
+        case 0x3: return &op3XKK;
+        case 0x4: return &op4XKK;
+        case 0x5:
+            if (n == 0x0)
+                return &op5XY0;
+            if (n == 0x2)
+                return &op5XY2;
+            if (n == 0x3)
+                return &op5XY3;
+            return &invalidOpcode;
+        case 0x6: return &op6XKK;
+        case 0x7: return &op7XKK;
+        case 0x8:
+            switch (n)
+            {
+                case 0x0: return &op8XY0;
+                case 0x1: return &op8XY1<Quirks>;
+                case 0x2: return &op8XY2<Quirks>;
+                case 0x3: return &op8XY3<Quirks>;
+                case 0x4: return &op8XY4;
+                case 0x5: return &op8XY5;
+                case 0x6: return &op8XY6<Quirks>;
+                case 0x7: return &op8XY7;
+                case 0xE: return &op8XYE<Quirks>;
+            }
+            return &invalidOpcode;
+        case 0x9: return n == 0 ? &op9XY0 : &invalidOpcode;
+        case 0xA: return &opANNN;
+        case 0xB: return &opBNNN<Quirks>;
+        case 0xC: return &opCXKK;
+        case 0xD: return &opDXYN<Quirks>;
+        case 0xE:
+            if (kk == 0x9E)
+                return &opEX9E;
+            if (kk == 0xA1)
+                return &opEXA1;
+            return &invalidOpcode;
+        case 0xF:
+            if (instruction == 0xF000)
+                return &opF000;
+            if (instruction == 0xF002)
+                return &opF002;
+            switch (kk)
+            {
+                case 0x01: return &opFN01;
+                case 0x07: return &opFX07;
+                case 0x0A: return &opFX0A;
+                case 0x15: return &opFX15;
+                case 0x18: return &opFX18;
+                case 0x1E: return &opFX1E;
+                case 0x29: return &opFX29;
+                case 0x30: return &opFX30;
+                case 0x33: return &opFX33;
+                case 0x3A: return &opFX3A;
+                case 0x55: return &opFX55<Quirks>;
+                case 0x65: return &opFX65<Quirks>;
+                case 0x75: return &opFX75;
+                case 0x85: return &opFX85;
+            }
+            return &invalidOpcode;
+    }
+    return &invalidOpcode;
+}
+
+// Instructions the decoder gets wrong for a profile
+template <class Quirks>
+static vector<int> misdecoded()
+{
+    vector<int> wrong;
+    for (int instruction = 0; instruction < 0x10000; instruction++)
+        if (decode_handler<Quirks>(instruction) != expected_handler<Quirks>(instruction)
+            || *decode<Quirks>(instruction).template target<OpcodeHandler>() != expected_handler<Quirks>(instruction))
+            wrong.push_back(instruction);
+    return wrong;
+}
+
+TEST_CASE( "Decoder" )
+{
+    SECTION( "every instruction decodes to its handler" )
+    {
+        REQUIRE( misdecoded<CowgodQuirks>().empty() );
+        REQUIRE( misdecoded<VipQuirks>().empty() );
+        REQUIRE( misdecoded<SchipQuirks>().empty() );
+        REQUIRE( misdecoded<XochipQuirks>().empty() );
+    }
+
+    SECTION( "the disassembler knows the same instructions" )
+    {
+        int disagreements = 0;
+        for (int instruction = 0; instruction < 0x10000; instruction++)
+        {
+            bool valid = decode_handler<CowgodQuirks>(instruction) != &invalidOpcode;
+            string text = disassemble(instruction);
+            bool listed = text.compare(0, 3, "DW ") != 0 && text.compare(0, 4, "SYS ") != 0;
+            if (valid != listed)
+                disagreements++;
+        }
+        REQUIRE( disagreements == 0 );
+        REQUIRE( disassemble(0x0123) == "SYS 0x123" );
+        REQUIRE( disassemble(0xF201) == "PLANE 2" );
+    }
+
+    SECTION( "the list is consistent" )
+    {
+        for (int i = 0; i < opcode_count; i++)
+        {
+            const OpcodeSpec &spec = opcode_specs[i];
+            REQUIRE( (spec.pattern & ~spec.mask) == 0 );
+            // Reachable: no earlier entry swallows the pattern
+            REQUIRE( opcode_index(spec.pattern) == i );
+        }
+        REQUIRE( opcode_spec(0x8AB9) == nullptr );
+        REQUIRE( string(opcode_spec(0xD125)->handler) == "opDXYN" );
+        REQUIRE( opcode_spec(0xD125)->quirked );
+    }
+
+    SECTION( "2NNN calls anywhere in memory" )
+    {
+        Memory mem;
+        REQUIRE( execute(0x2ABC, mem) == 0x2000 );
+        REQUIRE( mem.get_program_counter() == 0xABC );
+    }
+}
+
+TEST_CASE( "Explorer" )
+{
+    SECTION( "state hash" )
+    {
+        Memory a, b;
+        REQUIRE( a.get_state_hash() == b.get_state_hash() );
+        REQUIRE( a.get_state_hash() == a.compute_state_hash() );
+
+        // Writing a value back gives the same hash
+        a.mem_write(0x300, 0x12);
+        a.reg_write(3, 0x45);
+        REQUIRE( a.get_state_hash() != b.get_state_hash() );
+        a.mem_write(0x300, 0);
+        REQUIRE( a.get_state_hash() != b.get_state_hash() );
+        a.reg_write(3, 0);
+        REQUIRE( a.get_state_hash() == b.get_state_hash() );
+
+        // Pointers, timers and the screen count too
+        a.set_delay_timer(5);
+        REQUIRE( a.get_state_hash() != b.get_state_hash() );
+        a.set_delay_timer(-1);
+        a.screen_write(10, 1);
+        REQUIRE( a.get_state_hash() != b.get_state_hash() );
+
+        // Kept up to date by a program storing to memory:
+        // 6A7B A400 FA33 F355 D015
+        b.load_rom(vector<uint8_t>{0x6A, 0x7B, 0xA4, 0x00, 0xFA, 0x33, 0xF3, 0x55, 0xD0, 0x15});
+        run(b, 5);
+        REQUIRE( b.get_state_hash() == b.compute_state_hash() );
+        Memory copy = b;
+        REQUIRE( copy.get_state_hash() == b.get_state_hash() );
+    }
+
+    SECTION( "branching on FX0A" )
+    {
+        // Key 5 reaches an invalid opcode, every other key a dead end:
+        // 200: F00A  LD V0, K
+        // 202: 3005  SE V0, 5
+        // 204: 1204  JP 0x204
+        // 206: 0123  SYS 0x123
+        Memory mem;
+        mem.load_rom(vector<uint8_t>{0xF0, 0x0A, 0x30, 0x05, 0x12, 0x04, 0x01, 0x23});
+        ExploreConfig config;
+        config.max_frames = 5;
+        ExploreResult result = explore(mem, config);
+        REQUIRE( result.complete );
+        REQUIRE( result.states == 17 );
+        REQUIRE( result.depth == 1 );
+        REQUIRE( result.faults.size() == 1 );
+        REQUIRE( result.faults[0].halt.fault == Fault::InvalidOpcode );
+        REQUIRE( result.faults[0].halt.pc == 0x206 );
+        REQUIRE( result.faults[0].inputs == vector<uint16_t>{1 << 5} );
+
+        // Limits stop it early
+        config.max_states = 5;
+        REQUIRE( !explore(mem, config).complete );
+        config.max_states = 100000;
+        config.max_depth = 1;
+        REQUIRE( !explore(mem, config).complete );
+    }
+
+    SECTION( "branching on EX9E" )
+    {
+        // Polls key 3 until it's held:
+        // 200: 6003  LD V0, 3
+        // 202: E09E  SKP V0
+        // 204: 1202  JP 0x202
+        // 206: 00FD  EXIT
+        Memory mem;
+        mem.load_rom(vector<uint8_t>{0x60, 0x03, 0xE0, 0x9E, 0x12, 0x02, 0x00, 0xFD});
+        ExploreResult result = explore(mem);
+        REQUIRE( result.complete );
+        REQUIRE( result.faults.size() == 1 );
+        REQUIRE( result.faults[0].halt.fault == Fault::Exit );
+        REQUIRE( result.faults[0].inputs == vector<uint16_t>{1 << 3} );
+
+        // The same states whatever the number of threads
+        ExploreConfig config;
+        config.threads = 1;
+        ExploreResult single = explore(mem, config);
+        config.threads = 4;
+        ExploreResult several = explore(mem, config);
+        REQUIRE( single.states == result.states );
+        REQUIRE( several.states == result.states );
+        REQUIRE( several.instructions == single.instructions );
+    }
+
+    SECTION( "concurrent state set" )
+    {
+        StateSet set;
+        vector<thread> threads;
+        atomic<int> added {0};
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&set, &added]() {
+                for (uint64_t hash = 0; hash < 1000; hash++)
+                    added += set.insert(hash * 0x9E3779B97F4A7C15ull);
+            });
+        for (auto &inserter : threads)
+            inserter.join();
+        REQUIRE( added == 1000 );
+        REQUIRE( set.size() == 1000 );
+        REQUIRE( set.contains(0x9E3779B97F4A7C15ull) );
+        REQUIRE( !set.contains(1) );
+    }
+}
 
 TEST_CASE( "Chip-8 CPU" )
 {
@@ -376,6 +2446,20 @@ TEST_CASE( "Chip-8 CPU" )
         REQUIRE( mem.reg_read(0x5) == 60 );
 
     }
+    SECTION( "Execute FX0A" )
+    {
+        // FX0A waits for a key press and stores the key in VX
+        // No key pressed, FX0A repeats
+        mem.set_program_counter(0x202);
+        REQUIRE( execute(0xF30A, mem) == 0xF00A );
+        REQUIRE( mem.get_program_counter() == 0x200 );
+        // Key 0x9 pressed
+        mem.set_program_counter(0x202);
+        mem.set_key(0x9, 1);
+        REQUIRE( execute(0xF30A, mem) == 0xF00A );
+        REQUIRE( mem.get_program_counter() == 0x202 );
+        REQUIRE( mem.reg_read(0x3) == 0x9 );
+    }
     SECTION( "Execute FX15" )
     {
         // FX15 sets the delay timer to VX
@@ -441,6 +2525,13 @@ TEST_CASE( "Chip-8 CPU" )
             REQUIRE( mem.mem_read(0x300 + i) == i * 2 * (i % 2) );
         for (int i = 0xC; i <= 0xF; i++)
             REQUIRE( mem.mem_read(0x300 + i) == 0 );
+
+        // Across a page boundary and the end of memory
+        mem.set_address_pointer(0xFFE);
+        REQUIRE( execute(0xF355, mem) == 0xF055 );
+        REQUIRE( mem.mem_read(0xFFF) == 2 );
+        REQUIRE( mem.mem_read(0x001) == 6 );
+        REQUIRE( mem.get_state_hash() == mem.compute_state_hash() );
     }
     SECTION( "Execute FX65" )
     {
@@ -0,0 +1,44 @@
+#include "Recompiler.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+using namespace std;
+
+// Usage: chip8-aot [--quirks=cowgod|vip|schip|xochip] <rom> <function name> [output.cpp]
+// Translates a ROM into a C++ file defining
+//   long <function name>(Memory &mem, long cycles);
+int main(int argc, char **argv)
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    if (argc > 1 && string(argv[1]).compare(0, 9, "--quirks=") == 0)
+    {
+        if (!parse_quirks(argv[1] + 9, quirks))
+        {
+            cerr << "unknown quirks profile " << argv[1] + 9 << "\n";
+            return 2;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc != 3 && argc != 4)
+    {
+        cerr << "usage: chip8-aot [--quirks=cowgod|vip|schip|xochip] <rom> <function name> [output.cpp]\n";
+        return 2;
+    }
+    ifstream file(argv[1], ios::binary);
+    if (!file)
+    {
+        cerr << "can't open " << argv[1] << "\n";
+        return 1;
+    }
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if (argc == 4)
+    {
+        ofstream out(argv[3]);
+        recompile(rom, argv[2], out, 0x200, quirks);
+        return out ? 0 : 1;
+    }
+    recompile(rom, argv[2], cout, 0x200, quirks);
+    return 0;
+}
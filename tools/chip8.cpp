@@ -0,0 +1,161 @@
+#include "Frontend.h"
+#include "GdbServer.h"
+#include "Memory.h"
+#include "SharedFramebuffer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+using namespace std;
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " [options] <rom>\n"
+         << "  --quirks=cowgod|vip|schip|xochip  platform behavior (cowgod)\n"
+         << "  --ipf=N                           instructions per frame (10)\n"
+         << "  --frames=N                        stop after N frames\n"
+         << "  --fast                            don't keep to 60 Hz\n"
+         << "  --gdb=PORT|unix:PATH              accept GDB remote connections\n"
+         << "  --video=terminal|null|ppm:PREFIX|png:PREFIX|shm:NAME"
+#ifdef CHIP8_WITH_SDL
+         << "|sdl"
+#endif
+         << "\n";
+}
+
+// Usage: chip8 [options] <rom>
+// Runs a ROM with the chosen backends until Escape or --frames
+int main(int argc, char **argv)
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    int instructions_per_frame = 10;
+    long frames = -1;
+    bool throttle = true;
+    string video_name = "terminal";
+    string gdb_address;
+    string rom;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        auto value = [&](const string &option) {
+            return arg.compare(0, option.size(), option) == 0 ? arg.substr(option.size()) : string();
+        };
+        if (!value("--quirks=").empty())
+        {
+            if (!parse_quirks(value("--quirks="), quirks))
+            {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        else if (!value("--ipf=").empty())
+            instructions_per_frame = atoi(value("--ipf=").c_str());
+        else if (!value("--frames=").empty())
+            frames = atol(value("--frames=").c_str());
+        else if (!value("--video=").empty())
+            video_name = value("--video=");
+        else if (!value("--gdb=").empty())
+            gdb_address = value("--gdb=");
+        else if (arg == "--fast")
+            throttle = false;
+        else if (arg[0] != '-' && rom.empty())
+            rom = arg;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (rom.empty() || instructions_per_frame <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    Memory mem(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+    mem.set_quirks(quirks);
+    if (!mem.load_rom(rom))
+    {
+        cerr << "can't load " << rom << "\n";
+        return 1;
+    }
+
+    // Backends
+    unique_ptr<VideoSink> video;
+    unique_ptr<AudioSink> audio;
+    unique_ptr<InputSource> input;
+#ifdef CHIP8_WITH_SDL
+    unique_ptr<SdlFrontend> sdl;
+#endif
+    if (video_name == "terminal")
+    {
+        video.reset(new TerminalVideo(cout));
+        audio.reset(new TerminalAudio(cout));
+        input.reset(new TerminalInput());
+    }
+    else if (video_name == "null")
+        video.reset(new NullVideo());
+    else if (video_name.compare(0, 4, "ppm:") == 0 || video_name.compare(0, 4, "png:") == 0)
+        video.reset(new ImageVideo(video_name.substr(4), video_name[1] == 'n'));
+    else if (video_name.compare(0, 4, "shm:") == 0)
+    {
+        auto shared = new SharedFramebuffer(video_name.substr(4));
+        video.reset(shared);
+        if (!shared->is_open())
+        {
+            cerr << "can't create shared memory " << video_name.substr(4) << "\n";
+            return 1;
+        }
+    }
+#ifdef CHIP8_WITH_SDL
+    else if (video_name == "sdl")
+        sdl.reset(new SdlFrontend());
+#endif
+    else
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!audio)
+        audio.reset(new NullAudio());
+    if (!input)
+        input.reset(new NullInput());
+
+    VideoSink *video_sink = video.get();
+    AudioSink *audio_sink = audio.get();
+    InputSource *input_source = input.get();
+#ifdef CHIP8_WITH_SDL
+    if (sdl)
+    {
+        video_sink = sdl.get();
+        audio_sink = sdl.get();
+        input_source = sdl.get();
+    }
+#endif
+
+    Frontend frontend(mem, *video_sink, *audio_sink, *input_source);
+    frontend.set_instructions_per_frame(instructions_per_frame);
+    frontend.set_throttle(throttle);
+    unique_ptr<GdbServer> gdb;
+    if (!gdb_address.empty())
+    {
+        gdb.reset(new GdbServer(mem, gdb_address));
+        if (!gdb->is_open())
+        {
+            cerr << "can't listen on " << gdb_address << "\n";
+            return 1;
+        }
+        frontend.set_debug_server(gdb.get());
+    }
+    frontend.run(frames);
+
+    Halt halt = mem.get_halt();
+    if (halt.fault == Fault::None || halt.fault == Fault::Exit)
+        return 0;
+    char where[32];
+    snprintf(where, sizeof where, "0x%03X (%04X)", halt.pc, halt.instruction);
+    cerr << "halted: " << fault_name(halt.fault) << " at " << where << "\n";
+    return 1;
+}
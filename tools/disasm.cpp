@@ -0,0 +1,27 @@
+#include "Disassembler.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+using namespace std;
+
+// Usage: chip8-disasm <rom>
+// Writes an annotated listing of the ROM to stdout
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        cerr << "usage: " << argv[0] << " <rom>\n";
+        return 2;
+    }
+    ifstream file(argv[1], ios::binary);
+    if (!file)
+    {
+        cerr << "can't open " << argv[1] << "\n";
+        return 1;
+    }
+    vector<uint8_t> rom((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    ControlFlowGraph cfg(rom);
+    write_listing(cfg, cout);
+    return 0;
+}
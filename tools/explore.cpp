@@ -0,0 +1,88 @@
+#include "Explorer.h"
+#include "Memory.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+static const char *usage =
+    "usage: chip8-explore [options] <rom>\n"
+    "  --quirks=cowgod|vip|schip|xochip  platform behavior (cowgod)\n"
+    "  --ipf=N                           instructions per frame (10)\n"
+    "  --states=N                        stop after N states (100000)\n"
+    "  --depth=N                         stop after N input decisions (no limit)\n"
+    "  --frames=N                        frames to run without input before\n"
+    "                                    counting a state anyway (600)\n"
+    "  --threads=N                       worker threads (one per hardware thread)\n";
+
+// Usage: chip8-explore [options] <rom>
+// Explores the states a ROM can reach by branching on input and lists the
+// faults found, each with the keys held at every decision on the way
+int main(int argc, char **argv)
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    ExploreConfig config;
+    string rom;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!parse_quirks(arg.substr(9), quirks))
+            {
+                cerr << "unknown quirks profile " << arg.substr(9) << "\n";
+                return 2;
+            }
+        }
+        else if (arg.compare(0, 6, "--ipf=") == 0)
+            config.instructions_per_frame = atoi(arg.c_str() + 6);
+        else if (arg.compare(0, 9, "--states=") == 0)
+            config.max_states = strtoull(arg.c_str() + 9, nullptr, 10);
+        else if (arg.compare(0, 8, "--depth=") == 0)
+            config.max_depth = atoi(arg.c_str() + 8);
+        else if (arg.compare(0, 9, "--frames=") == 0)
+            config.max_frames = atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 10, "--threads=") == 0)
+            config.threads = atoi(arg.c_str() + 10);
+        else if (arg[0] != '-' && rom.empty())
+            rom = arg;
+        else
+        {
+            rom.clear();
+            break;
+        }
+    }
+    if (rom.empty() || config.instructions_per_frame <= 0 || config.max_frames <= 0)
+    {
+        cerr << usage;
+        return 2;
+    }
+
+    Memory mem(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+    mem.set_quirks(quirks);
+    if (!mem.load_rom(rom))
+    {
+        cerr << "can't load " << rom << "\n";
+        return 1;
+    }
+
+    ExploreResult result = explore(mem, config);
+    cout << result.states << " states, " << result.depth << " decisions deep, "
+         << result.instructions << " instructions"
+         << (result.complete ? ", all explored\n" : ", stopped at a limit\n");
+    for (const ExploredFault &fault : result.faults)
+    {
+        char where[32];
+        snprintf(where, sizeof where, " at %03X (%04X)", fault.halt.pc, fault.halt.instruction);
+        cout << fault_name(fault.halt.fault) << where << ", keys";
+        for (uint16_t keys : fault.inputs)
+        {
+            char held[8];
+            snprintf(held, sizeof held, " %04X", keys);
+            cout << held;
+        }
+        cout << "\n";
+    }
+    return result.faults.empty() ? 0 : 1;
+}
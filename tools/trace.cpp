@@ -0,0 +1,214 @@
+#include "Cpu.h"
+#include "Memory.h"
+#include "Trace.h"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+static void usage(const char *name)
+{
+    cerr << "usage: " << name << " record [options] <rom> <trace>\n"
+         << "  --quirks=cowgod|vip|schip|xochip  platform behavior (cowgod)\n"
+         << "  --ipf=N                           instructions per frame (10)\n"
+         << "  --frames=N                        frames to record (600)\n"
+         << "  --keys                            cycle through the keys like chip8-bench\n"
+         << "       " << name << " dump [filters] <trace>\n"
+         << "  --pc=ADDR[-ADDR]                  instructions in this range\n"
+         << "  --match=PATTERN                   e.g. Dxyn, 8xy4 (non-hex digits match anything)\n"
+         << "  --from=CYCLE --to=CYCLE           cycles in this range\n"
+         << "       " << name << " diff <trace> <trace>\n";
+}
+
+// Value of --name=, empty if arg is some other option
+static string option(const string &arg, const string &name)
+{
+    return arg.compare(0, name.size(), name) == 0 ? arg.substr(name.size()) : string();
+}
+
+static int record(int argc, char **argv)
+{
+    QuirksProfile quirks = QuirksProfile::Cowgod;
+    int instructions_per_frame = 10;
+    long frames = 600;
+    bool keys = false;
+    vector<string> paths;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (!option(arg, "--quirks=").empty())
+        {
+            if (!parse_quirks(option(arg, "--quirks="), quirks))
+                return 2;
+        }
+        else if (!option(arg, "--ipf=").empty())
+            instructions_per_frame = atoi(option(arg, "--ipf=").c_str());
+        else if (!option(arg, "--frames=").empty())
+            frames = atol(option(arg, "--frames=").c_str());
+        else if (arg == "--keys")
+            keys = true;
+        else if (arg[0] != '-')
+            paths.push_back(arg);
+        else
+            return 2;
+    }
+    if (paths.size() != 2 || instructions_per_frame <= 0 || frames < 0)
+        return 2;
+
+    Memory mem(quirks == QuirksProfile::Xochip ? 0x10000 : 4096);
+    mem.set_quirks(quirks);
+    if (!mem.load_rom(paths[0]))
+    {
+        cerr << "can't load " << paths[0] << "\n";
+        return 1;
+    }
+    ofstream out(paths[1], ios::binary);
+    if (!out)
+    {
+        cerr << "can't write " << paths[1] << "\n";
+        return 1;
+    }
+
+    TraceRecorder recorder(out);
+    for (long frame = 0; frame < frames; frame++)
+    {
+        if (keys)
+            mem.set_keys(frame % 10 < 5 ? 1 << (frame / 10 % 16) : 0);
+        recorder.run_frames(mem, 1, instructions_per_frame);
+    }
+    recorder.flush();
+    cout << recorder.get_record_count() << " instructions, " << out.tellp() << " bytes\n";
+    return 0;
+}
+
+// An instruction pattern like "Dxyn": hex digits must match, anything else doesn't matter
+static bool matches(const string &pattern, int instruction)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        char c = pattern[i];
+        if (isxdigit((unsigned char) c)
+            && (instruction >> (12 - 4 * i) & 0xF) != strtol(string(1, c).c_str(), nullptr, 16))
+            return false;
+    }
+    return true;
+}
+
+static int dump(int argc, char **argv)
+{
+    int pc_from = 0, pc_to = 0xFFFF;
+    string pattern;
+    uint64_t from = 0, to = UINT64_MAX;
+    string path;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (!option(arg, "--pc=").empty())
+        {
+            string range = option(arg, "--pc=");
+            size_t dash = range.find('-');
+            pc_from = strtol(range.c_str(), nullptr, 16);
+            pc_to = dash == string::npos ? pc_from : strtol(range.c_str() + dash + 1, nullptr, 16);
+        }
+        else if (!option(arg, "--match=").empty())
+            pattern = option(arg, "--match=");
+        else if (!option(arg, "--from=").empty())
+            from = strtoull(option(arg, "--from=").c_str(), nullptr, 10);
+        else if (!option(arg, "--to=").empty())
+            to = strtoull(option(arg, "--to=").c_str(), nullptr, 10);
+        else if (arg[0] != '-' && path.empty())
+            path = arg;
+        else
+            return 2;
+    }
+    if (path.empty() || (!pattern.empty() && pattern.size() != 4))
+        return 2;
+
+    ifstream in(path, ios::binary);
+    TraceReader reader(in);
+    if (!reader.is_valid())
+    {
+        cerr << path << " isn't a trace\n";
+        return 1;
+    }
+    TraceRecord record;
+    while (reader.next(record) && record.cycle <= to)
+    {
+        if (record.cycle < from || record.pc < pc_from || record.pc > pc_to)
+            continue;
+        if (!pattern.empty() && !matches(pattern, record.instruction))
+            continue;
+        cout << format_trace_record(record) << "\n";
+    }
+    return 0;
+}
+
+static bool same(const TraceRecord &a, const TraceRecord &b)
+{
+    for (int i = 0; i < 16; i++)
+        if (a.registers[i] != b.registers[i])
+            return false;
+    return a.cycle == b.cycle && a.pc == b.pc && a.instruction == b.instruction
+        && a.address_pointer == b.address_pointer && a.stack_pointer == b.stack_pointer
+        && a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer
+        && a.memory_address == b.memory_address && a.memory == b.memory;
+}
+
+// Exits 0 when the traces match, 1 at the first record where they don't
+static int diff(int argc, char **argv)
+{
+    if (argc != 4)
+        return 2;
+    ifstream in_a(argv[2], ios::binary), in_b(argv[3], ios::binary);
+    TraceReader a(in_a), b(in_b);
+    if (!a.is_valid() || !b.is_valid())
+    {
+        cerr << "not a trace\n";
+        return 1;
+    }
+
+    TraceRecord record_a, record_b, previous;
+    bool have_previous = false;
+    uint64_t count = 0;
+    while (true)
+    {
+        bool more_a = a.next(record_a);
+        bool more_b = b.next(record_b);
+        if (!more_a && !more_b)
+        {
+            cout << "identical, " << count << " instructions\n";
+            return 0;
+        }
+        if (more_a != more_b || !same(record_a, record_b))
+        {
+            cout << "diverged after " << count << " instructions\n";
+            if (have_previous)
+                cout << "   " << format_trace_record(previous) << "\n";
+            cout << "<  " << (more_a ? format_trace_record(record_a) : "(end)") << "\n";
+            cout << ">  " << (more_b ? format_trace_record(record_b) : "(end)") << "\n";
+            return 1;
+        }
+        previous = record_a;
+        have_previous = true;
+        count++;
+    }
+}
+
+// Usage: chip8-trace record|dump|diff ...
+// Records instruction traces of a ROM and reads them back offline
+int main(int argc, char **argv)
+{
+    int status = 2;
+    string command = argc > 1 ? argv[1] : "";
+    if (command == "record")
+        status = record(argc, argv);
+    else if (command == "dump")
+        status = dump(argc, argv);
+    else if (command == "diff")
+        status = diff(argc, argv);
+    if (status == 2)
+        usage(argv[0]);
+    return status;
+}